@@ -0,0 +1,37 @@
+// Replaces the global `operator new` so that every heap allocation is counted
+// against the current [FramePhase].
+//
+// Only link this into test and benchmark targets. Production binaries should
+// keep the default allocator.
+
+#include <cstdlib>
+#include <new>
+
+#include "perf.h"
+
+static bool _hookInstalled = barista::MarkAllocationHookInstalled();
+
+static void* _allocate(size_t size) {
+  barista::RecordAllocation(size);
+  void* ptr = malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void* operator new(size_t size) {
+  return _allocate(size);
+}
+
+void* operator new[](size_t size) {
+  return _allocate(size);
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  free(ptr);
+}
@@ -3,10 +3,12 @@
 //
 
 #include "api.h"
+#include "html.h"
 #include "sync.h"
 
 #include <algorithm>
 #include <cassert>
+#include <cstdlib>
 #include <map>
 #include <memory>
 #include <string>
@@ -18,23 +20,91 @@ using namespace std;
 
 namespace barista {
 
-bool _sameType(void *a, void *b) {
-  return typeid(a) == typeid(b);
+void Event::_parsePath() {
+  _isPathAddressed = true;
+  size_t start = 1;
+  while (start < _baristaId.size()) {
+    size_t end = _baristaId.find('/', start);
+    if (end == string::npos) {
+      end = _baristaId.size();
+    }
+    _path.push_back(atoi(_baristaId.substr(start, end - start).c_str()));
+    start = end + 1;
+  }
 }
 
 bool _canUpdate(shared_ptr<RenderNode> node, shared_ptr<Node> configuration) {
-  if (!_sameType(node->GetConfiguration().get(), configuration.get())) {
+  if (!node->CanUpdateUsing(configuration)) {
     return false;
   }
 
   return node->GetConfiguration()->GetKey() == configuration->GetKey();
 }
 
+// Updates the only child of [parent] using [configuration], or replaces it
+// with a new render node if it cannot be updated. Returns the child now in
+// place.
+shared_ptr<RenderNode> _updateChild(shared_ptr<RenderParent> parent, shared_ptr<RenderNode> child,
+                                    shared_ptr<Node> configuration, ElementUpdate& update) {
+  if (child != nullptr && _canUpdate(child, configuration)) {
+    child->Update(configuration, update);
+    return child;
+  }
+  if (child != nullptr) {
+    child->Recycle();
+    // The new child is rendered in place of the old one's DOM node.
+    update.Replace();
+  }
+  child = configuration->Instantiate(parent->GetTree());
+  child->Update(configuration, update);
+  child->Attach(parent);
+  return child;
+}
+
 RenderNode::RenderNode(shared_ptr<Tree> tree) : _tree(tree) { }
 
+int Node::_lookUpClassId(const type_info& type) {
+  // `type_info` objects are usually unique, so they are looked up by
+  // address first. Comparing them by name, as `type_index` does, costs a
+  // string comparison.
+  static unordered_map<const type_info*, int> classIdsByAddress;
+  static unordered_map<type_index, int> classIds;
+  auto byAddress = classIdsByAddress.find(&type);
+  if (byAddress != classIdsByAddress.end()) {
+    return byAddress->second;
+  }
+  auto classId = classIds.find(type_index(type));
+  int id = classId != classIds.end() ? classId->second : (int) classIds.size() + 1;
+  classIds[type_index(type)] = id;
+  classIdsByAddress[&type] = id;
+  return id;
+}
+
+bool RenderNode::CanUpdateUsing(shared_ptr<Node> newConfiguration) {
+  assert(newConfiguration != nullptr);
+  assert(_configuration != nullptr);
+  return _configuration->GetKind() == newConfiguration->GetKind();
+}
+
+void RenderNode::Recycle() {
+  VisitChildren([](shared_ptr<RenderNode> child) {
+    if (child != nullptr) {
+      child->Recycle();
+    }
+  });
+  Detach();
+}
+
+void RenderNode::ResetForReuse() {
+  _configuration = nullptr;
+  _parent.reset();
+  _indexInParent = 0;
+}
+
 void RenderNode::Update(shared_ptr<Node> newConfiguration, ElementUpdate& update) {
   assert(newConfiguration != nullptr);
   _configuration = newConfiguration;
+  _tree->GetCurrentFrameStats().RecordNodeVisit();
 }
 
 
@@ -42,25 +112,115 @@ RenderParent::RenderParent(shared_ptr<Tree> tree) : RenderNode(tree) { }
 
 void RenderParent::ScheduleUpdate() {
   _hasDescendantsNeedingUpdate = true;
+  RenderNode* child = this;
   shared_ptr<RenderParent> parent = GetParent();
   while (parent != nullptr) {
     parent->_hasDescendantsNeedingUpdate = true;
+    parent->MarkChildNeedingUpdate(*child);
+    child = parent.get();
     parent = parent->GetParent();
   }
 }
 
+void RenderParent::ResetForReuse() {
+  _hasDescendantsNeedingUpdate = true;
+  RenderNode::ResetForReuse();
+}
+
 void RenderParent::Update(shared_ptr<Node> newConfiguration, ElementUpdate& update) {
   _hasDescendantsNeedingUpdate = false;
   RenderNode::Update(newConfiguration, update);
 }
 
+shared_ptr<RenderNode> RenderNodePool::Acquire(int tag) {
+  auto freeList = _freeLists.find(tag);
+  if (freeList == _freeLists.end() || freeList->second.empty()) {
+    _misses++;
+    return nullptr;
+  }
+  _hits++;
+  _size--;
+  auto node = freeList->second.back();
+  freeList->second.pop_back();
+  return node;
+}
+
+void RenderNodePool::Release(int tag, shared_ptr<RenderNode> node) {
+  auto& freeList = _freeLists[tag];
+  if (freeList.size() >= _maxPerTag || _size >= _maxSize) {
+    _dropped++;
+    return;
+  }
+  freeList.push_back(node);
+  _size++;
+}
+
+void RenderNodePool::Clear() {
+  _freeLists.clear();
+  _size = 0;
+}
+
 string Tree::RenderFrame(int indent) {
-  auto treeUpdate = TreeUpdate();
-  RenderFrameIntoUpdate(treeUpdate);
-  return treeUpdate.Render(indent);
+  if (_snapshot != nullptr && !_isSnapshotFrameSent) {
+    // Shows the tree as it is going to be built.
+    _isSnapshotFrameSent = true;
+    _frameNumber++;
+    _currentFrameStats = FrameStats();
+    _currentFrameStats.RecordBytesEmitted(_snapshot->GetFrame().size());
+    _lastFrameStats = _currentFrameStats;
+    return _snapshot->GetFrame();
+  }
+  if (_snapshot != nullptr) {
+    _buildFromSnapshot();
+  }
+
+  TraceSpan frameSpan(_isTracing, "frame", "Frame");
+  int64_t startMicros = _recorder != nullptr ? TraceRecorder::NowMicros() : 0;
+  AllocationScope allocations;
+  string diff;
+  {
+    // Reused across frames, so that patch nodes are allocated only when a
+    // frame is bigger than all previous ones.
+    _frameUpdate.Reset();
+    _frameUpdate.SetStringTable(_usesStringTable ? &_stringTable : nullptr);
+    _frameUpdate.SetPathAddressedEvents(_usesPathAddressedEvents);
+    RenderFrameIntoUpdate(_frameUpdate);
+    if (_needsCreateFrame) {
+      // The client shows something else than the tree; start over.
+      _needsCreateFrame = false;
+      _frameUpdate.Reset();
+      TreeSnapshot unused;
+      _topLevelNode->WriteSnapshot(_frameUpdate.CreateRootElement(), unused);
+    }
+    TraceSpan serializeSpan(_isTracing, "serialize", "Serialize");
+    PhaseScope serialize(kPhaseSerialize);
+    if (_usesHydration && _frameNumber == 1) {
+      diff = _renderHydrationFrame(indent);
+    } else {
+      diff = _frameUpdate.Render(indent);
+    }
+    serializeSpan.AddArg("bytes", diff.size());
+  }
+  _lastFrameAllocations = allocations.GetAllocations();
+  _recordUpdateLatencies();
+  _currentFrameStats.RecordBytesEmitted(diff.size());
+  _lastFrameStats = _currentFrameStats;
+  if (_recorder != nullptr) {
+    // The encoding can be chosen after recording starts, but not after the
+    // first frame.
+    _recorder->RecordEncoding(_usesStringTable, _usesPathAddressedEvents);
+    _recorder->RecordFrame(indent, TraceRecorder::NowMicros() - startMicros, diff);
+  }
+  return diff;
 }
 
 void Tree::RenderFrameIntoUpdate(TreeUpdate & treeUpdate) {
+  TraceSpan span(_isTracing, "diff", "Reconcile");
+  PhaseScope diff(kPhaseDiff);
+  _currentFrameStats = FrameStats();
+  _frameNumber++;
+  _renderedUpdates.clear();
+  _startBackgroundUpdates();
   if (_topLevelNode == nullptr) {
     _topLevelNode = _topLevelWidget->Instantiate(shared_from_this());
     auto& rootInsertion = treeUpdate.CreateRootElement();
@@ -69,6 +229,61 @@ void Tree::RenderFrameIntoUpdate(TreeUpdate & treeUpdate) {
     auto& rootUpdate = treeUpdate.UpdateRootElement();
     _topLevelNode->Update(_topLevelWidget, rootUpdate);
   }
+  _currentFrameStats.RecordBackgroundUpdatesDeferred(_queuedBackgroundUpdates);
+  _lastFrameStats = _currentFrameStats;
+}
+
+void Tree::_queueBackgroundUpdate(shared_ptr<RenderStatefulWidget> node) {
+  _backgroundUpdates.push_back(node);
+  _queuedBackgroundUpdates++;
+}
+
+void Tree::_startBackgroundUpdates() {
+  int64_t startedMicros = 0;
+  int started = 0;
+  while (!_backgroundUpdates.empty()) {
+    auto node = _backgroundUpdates.front().lock();
+    if (node != nullptr && node->_isQueued) {
+      // Rebuilds too quick for the clock still count, so that a budget of 0
+      // starts one update per frame.
+      int64_t estimateMicros = max(node->_lastRebuildMicros, (int64_t) 1);
+      if (started > 0 && startedMicros + estimateMicros > _backgroundBudgetMicros) {
+        break;
+      }
+      startedMicros += estimateMicros;
+      started++;
+      node->_isQueued = false;
+      _queuedBackgroundUpdates--;
+      node->_markDirty();
+    }
+    _backgroundUpdates.pop_front();
+  }
+}
+
+void Tree::_didRebuild(RenderStatefulWidget& node) {
+  for (int priority = 0; priority < kUpdatePriorityCount; priority++) {
+    if (node._scheduledMicros[priority] >= 0) {
+      _renderedUpdates.push_back(
+          make_tuple((UpdatePriority) priority, node._scheduledMicros[priority], node._scheduledFrame[priority]));
+      _currentFrameStats.RecordUpdateRendered((UpdatePriority) priority);
+      node._scheduledMicros[priority] = -1;
+    }
+  }
+  if (node._isQueued) {
+    // Rebuilt before its turn, e.g. by an urgent update.
+    node._isQueued = false;
+    _queuedBackgroundUpdates--;
+  }
+}
+
+void Tree::_recordUpdateLatencies() {
+  int64_t nowMicros = TraceRecorder::NowMicros();
+  for (auto& update : _renderedUpdates) {
+    // An update scheduled after frame N is due in frame N + 1.
+    int64_t framesDeferred = max((int64_t) 0, _frameNumber - get<2>(update) - 1);
+    _updateLatencies[get<0>(update)].Record(nowMicros - get<1>(update), framesDeferred);
+  }
+  _renderedUpdates.clear();
 }
 
 void Tree::VisitChildren(RenderNodeVisitor visitor) {
@@ -76,7 +291,119 @@ void Tree::VisitChildren(RenderNodeVisitor visitor) {
 }
 
 void Tree::DispatchEvent(const Event& event) {
-  _topLevelNode->DispatchEvent(event);
+  if (_recorder != nullptr) {
+    _recorder->RecordEvent(event.GetType(), event.GetBaristaId(), event.GetData().dump());
+  }
+  if (_snapshot != nullptr) {
+    _buildFromSnapshot();
+  }
+  if (event.IsPathAddressed()) {
+    _topLevelNode->DispatchEventAtPath(event, 0);
+  } else {
+    _topLevelNode->DispatchEvent(event);
+  }
+}
+
+void Tree::StartRecording(uint32_t seed) {
+  assert(_topLevelNode == nullptr);
+  _recorder = make_shared<SessionRecorder>(seed);
+}
+
+void Tree::UseStringTable() {
+  assert(_topLevelNode == nullptr);
+  _usesStringTable = true;
+}
+
+void Tree::UseParallelSerialization(shared_ptr<TaskRunner> runner, size_t minTaskNodes) {
+  _taskRunner = runner;
+  _frameUpdate.SetParallelSerialization(runner.get(), minTaskNodes);
+}
+
+void Tree::UsePathAddressedEvents() {
+  assert(_topLevelNode == nullptr);
+  _usesPathAddressedEvents = true;
+}
+
+void Tree::UseHydration() {
+  assert(_topLevelNode == nullptr && _snapshot == nullptr);
+  _usesHydration = true;
+}
+
+void Tree::UseHydration(uint64_t serverMarkupHash) {
+  UseHydration();
+  _verifiesHydration = true;
+  _serverMarkupHash = serverMarkupHash;
+}
+
+string Tree::_renderHydrationFrame(int indent) {
+  vector<string> baristaIds;
+  uint64_t markupHash = HashMarkup(_frameUpdate.PrintHtml(), &baristaIds);
+  if (_verifiesHydration && markupHash != _serverMarkupHash) {
+    return _frameUpdate.Render(indent);
+  }
+  _isHydrated = true;
+  return _frameUpdate.RenderHydration(baristaIds, indent);
+}
+
+string Tree::TakeSnapshot() {
+  if (_snapshot != nullptr) {
+    // Not built yet, and thus unchanged.
+    return _snapshot->Serialize();
+  }
+  assert(_topLevelNode != nullptr);
+  TreeSnapshot snapshot;
+  TreeUpdate update;
+  update.SetPathAddressedEvents(_usesPathAddressedEvents);
+  _topLevelNode->WriteSnapshot(update.CreateRootElement(), snapshot);
+  snapshot.SetFrame(update.Render());
+  snapshot.SetNextBaristaId(RenderElement::GetNextBaristaId());
+  return snapshot.Serialize();
+}
+
+bool Tree::RestoreSnapshot(const string& bytes) {
+  assert(_topLevelNode == nullptr && _snapshot == nullptr);
+  unique_ptr<TreeSnapshot> snapshot(new TreeSnapshot());
+  if (!TreeSnapshot::Parse(bytes, *snapshot)) {
+    return false;
+  }
+  _snapshot = move(snapshot);
+  return true;
+}
+
+void Tree::_buildFromSnapshot() {
+  // IDs the snapshot does not provide must not collide with the ones it
+  // does.
+  if (RenderElement::GetNextBaristaId() < _snapshot->GetNextBaristaId()) {
+    RenderElement::SetNextBaristaId(_snapshot->GetNextBaristaId());
+  }
+  _isBuildingFromSnapshot = true;
+  TreeUpdate update;
+  update.SetPathAddressedEvents(_usesPathAddressedEvents);
+  RenderFrameIntoUpdate(update);
+  _isBuildingFromSnapshot = false;
+
+  _isRestoredFromSnapshot = _isSnapshotFrameSent && update.Render() == _snapshot->GetFrame() &&
+      _restoredBaristaIds == _snapshot->GetBaristaIds().size() && _restoredStates == _snapshot->GetStates().size();
+  _needsCreateFrame = !_isRestoredFromSnapshot;
+  _snapshot = nullptr;
+}
+
+void Tree::_restoreState(State& state) {
+  if (!_isBuildingFromSnapshot) {
+    return;
+  }
+  auto& states = _snapshot->GetStates();
+  size_t index = _restoredStates++;
+  if (index < states.size() && states[index].isSaved && states[index].typeName == typeid(state).name()) {
+    state.RestoreState(states[index].data);
+  }
+}
+
+string Tree::NextBaristaId() {
+  if (_isBuildingFromSnapshot && _restoredBaristaIds < _snapshot->GetBaristaIds().size()) {
+    return _snapshot->GetBaristaIds()[_restoredBaristaIds++];
+  }
+  return to_string(RenderElement::NextBid());
 }
 
 shared_ptr<RenderNode> StatelessWidget::Instantiate(shared_ptr<Tree> tree) {
@@ -87,7 +414,7 @@ shared_ptr<RenderNode> StatefulWidget::Instantiate(shared_ptr<Tree> t) {
   return make_shared<RenderStatefulWidget>(t);
 }
 
-void State::ScheduleUpdate() { _node->ScheduleUpdate(); }
+void State::ScheduleUpdate(UpdatePriority priority) { _node->ScheduleUpdate(priority); }
 
 void internalSetStateNode(shared_ptr<State> state, shared_ptr<RenderStatefulWidget> node) {
   state->_node = node;
@@ -98,32 +425,32 @@ void RenderStatelessWidget::DispatchEvent(const Event& event) {
   _child->DispatchEvent(event);
 }
 
-bool RenderStatelessWidget::CanUpdateUsing(shared_ptr<Node> newConfiguration) {
-  assert(newConfiguration != nullptr);
-  auto oldConfiguration = GetConfiguration();
-  assert(oldConfiguration != nullptr);
-  return typeid(oldConfiguration) == typeid(newConfiguration);
+bool RenderStatelessWidget::DispatchEventAtPath(const Event& event, size_t depth) {
+  return _child != nullptr && _child->DispatchEventAtPath(event, depth);
+}
+
+void RenderStatelessWidget::WriteSnapshot(ElementUpdate& update, TreeSnapshot& snapshot) {
+  _child->WriteSnapshot(update, snapshot);
 }
 
 void RenderStatelessWidget::Update(shared_ptr<Node> configPtr, ElementUpdate& update) {
   assert(dynamic_cast<StatelessWidget*>(configPtr.get()));
   auto newConfiguration = static_pointer_cast<StatelessWidget>(configPtr);
+  TraceSpan span(GetTree()->IsTracing(), "update", "");
+  span.SetTypeName(*newConfiguration);
 
   if (GetConfiguration() != newConfiguration) {
     // Build the new configuration and decide whether to reuse the child node
     // or replace with a new one.
-    shared_ptr<Node> newChildConfiguration = newConfiguration->Build();
-    if (_child != nullptr && _canUpdate(_child, newChildConfiguration)) {
-      _child->Update(newChildConfiguration, update);
-    } else {
-      // Replace child
-      if (_child != nullptr) {
-        _child->Detach();
-      }
-      _child = newChildConfiguration->Instantiate(GetTree());
-      _child->Update(newChildConfiguration, update);
-      _child->Attach(shared_from_this());
+    shared_ptr<Node> newChildConfiguration;
+    {
+      TraceSpan buildSpan(span.IsEnabled(), "build", "");
+      buildSpan.SetTypeName(*newConfiguration);
+      PhaseScope build(kPhaseBuild);
+      newChildConfiguration = newConfiguration->Build();
     }
+    GetTree()->GetCurrentFrameStats().RecordStatelessBuild();
+    _child = _updateChild(shared_from_this(), _child, newChildConfiguration, update);
   } else if (GetHasDescendantsNeedingUpdate()) {
     assert(_child != nullptr);
     // Own configuration is the same, but some children are scheduled to be
@@ -134,11 +461,62 @@ void RenderStatelessWidget::Update(shared_ptr<Node> configPtr, ElementUpdate& up
   RenderParent::Update(newConfiguration, update);
 }
 
+shared_ptr<RenderNode> KeepAlive::Instantiate(shared_ptr<Tree> tree) {
+  return make_shared<RenderKeepAlive>(tree);
+}
+
+void RenderKeepAlive::DispatchEvent(const Event& event) {
+  if (_child == nullptr) return;
+  _child->DispatchEvent(event);
+}
+
+bool RenderKeepAlive::DispatchEventAtPath(const Event& event, size_t depth) {
+  return _child != nullptr && _child->DispatchEventAtPath(event, depth);
+}
+
+void RenderKeepAlive::WriteSnapshot(ElementUpdate& update, TreeSnapshot& snapshot) {
+  _child->WriteSnapshot(update, snapshot);
+}
+
+void RenderKeepAlive::Update(shared_ptr<Node> configPtr, ElementUpdate& update) {
+  assert(dynamic_cast<KeepAlive*>(configPtr.get()));
+  auto newConfiguration = static_pointer_cast<KeepAlive>(configPtr);
+  auto newChildConfiguration = newConfiguration->GetChild();
+
+  if (_child == nullptr || _child->GetConfiguration() != newChildConfiguration) {
+    _child = _updateChild(shared_from_this(), _child, newChildConfiguration, update);
+  } else if (GetHasDescendantsNeedingUpdate()) {
+    // Same child, but something in it was scheduled to update, possibly
+    // while it was kept alive.
+    _child->Update(_child->GetConfiguration(), update);
+  }
+
+  RenderParent::Update(configPtr, update);
+}
+
 void RenderStatefulWidget::VisitChildren(RenderNodeVisitor visitor) {
   visitor(_child);
 }
 
 void RenderStatefulWidget::ScheduleUpdate() {
+  ScheduleUpdate(kUrgentUpdate);
+}
+
+void RenderStatefulWidget::ScheduleUpdate(UpdatePriority priority) {
+  auto tree = GetTree();
+  if (_scheduledMicros[priority] < 0) {
+    _scheduledMicros[priority] = TraceRecorder::NowMicros();
+    _scheduledFrame[priority] = tree->_frameNumber;
+  }
+  if (priority == kUrgentUpdate) {
+    _markDirty();
+  } else if (!_isDirty && !_isQueued) {
+    _isQueued = true;
+    tree->_queueBackgroundUpdate(shared_from_this());
+  }
+}
+
+void RenderStatefulWidget::_markDirty() {
   _isDirty = true;
   RenderParent::ScheduleUpdate();
 }
@@ -148,36 +526,46 @@ void RenderStatefulWidget::DispatchEvent(const Event& event) {
   _child->DispatchEvent(event);
 }
 
-bool RenderStatefulWidget::CanUpdateUsing(shared_ptr<Node> newConfiguration) {
-  assert(newConfiguration != nullptr);
-  auto oldConfiguration = GetConfiguration();
-  assert(oldConfiguration != nullptr);
-  return typeid(oldConfiguration) == typeid(newConfiguration);
+bool RenderStatefulWidget::DispatchEventAtPath(const Event& event, size_t depth) {
+  return _child != nullptr && _child->DispatchEventAtPath(event, depth);
+}
+
+void RenderStatefulWidget::WriteSnapshot(ElementUpdate& update, TreeSnapshot& snapshot) {
+  string data;
+  bool isSaved = _state->SaveState(data);
+  snapshot.AddState(typeid(*_state).name(), isSaved, data);
+  _child->WriteSnapshot(update, snapshot);
 }
 
 void RenderStatefulWidget::Update(shared_ptr<Node> configPtr, ElementUpdate& update) {
   assert(dynamic_cast<StatefulWidget*>(configPtr.get()));
   auto newConfiguration = static_pointer_cast<StatefulWidget>(configPtr);
-
-  if (GetConfiguration() != newConfiguration) {
-    // Build the new configuration and decide whether to reuse the child node
-    // or replace with a new one.
-    _state = newConfiguration->CreateState();
+  TraceSpan span(GetTree()->IsTracing(), "update", "");
+  span.SetTypeName(*newConfiguration);
+
+  if (_state == nullptr) {
+    {
+      PhaseScope build(kPhaseBuild);
+      _state = newConfiguration->CreateState();
+      _state->_config = newConfiguration;
+      internalSetStateNode(_state, shared_from_this());
+      GetTree()->_restoreState(*_state);
+    }
+    GetTree()->GetCurrentFrameStats().RecordStateCreated();
+    _rebuild(span, update);
+  } else if (GetConfiguration() != newConfiguration) {
+    // The parent rebuilt. Keep the state, hand it the new configuration and
+    // only rebuild if it asks for it.
+    auto oldConfiguration = _state->_config;
     _state->_config = newConfiguration;
-    internalSetStateNode(_state, shared_from_this());
-    shared_ptr<Node> newChildConfiguration = _state->Build();
-    if (_child != nullptr && _sameType(newChildConfiguration.get(), _child->GetConfiguration().get())) {
-      _child->Update(newChildConfiguration, update);
-    } else {
-      if (_child != nullptr) {
-        _child->Detach();
-      }
-      _child = newChildConfiguration->Instantiate(GetTree());
-      _child->Update(newChildConfiguration, update);
-      _child->Attach(shared_from_this());
+    _state->DidUpdateWidget(oldConfiguration);
+    if (_isDirty || _state->ShouldRebuild(oldConfiguration)) {
+      _rebuild(span, update);
+    } else if (GetHasDescendantsNeedingUpdate()) {
+      _child->Update(_child->GetConfiguration(), update);
     }
   } else if (_isDirty) {
-    _child->Update(_state->Build(), update);
+    _rebuild(span, update);
   } else if (GetHasDescendantsNeedingUpdate()) {
     // Own configuration is the same, but some children are scheduled to be
     // updated.
@@ -188,12 +576,44 @@ void RenderStatefulWidget::Update(shared_ptr<Node> configPtr, ElementUpdate& upd
   RenderParent::Update(newConfiguration, update);
 }
 
+void RenderStatefulWidget::_rebuild(TraceSpan& span, ElementUpdate& update) {
+  int64_t startMicros = TraceRecorder::NowMicros();
+  shared_ptr<Node> newChildConfiguration;
+  {
+    TraceSpan buildSpan(span.IsEnabled(), "build", "");
+    buildSpan.SetTypeName(*_state->_config);
+    PhaseScope build(kPhaseBuild);
+    newChildConfiguration = _state->Build();
+  }
+  GetTree()->GetCurrentFrameStats().RecordStatefulBuild();
+  _child = _updateChild(shared_from_this(), _child, newChildConfiguration, update);
+  _lastRebuildMicros = TraceRecorder::NowMicros() - startMicros;
+  GetTree()->_didRebuild(*this);
+}
+
 void RenderMultiChildParent::VisitChildren(RenderNodeVisitor visitor) {
   for (auto child : _currentChildren) {
     visitor(child);
   }
 }
 
+bool RenderMultiChildParent::DispatchEventAtPath(const Event& event, size_t depth) {
+  auto& path = event.GetPath();
+  if (depth >= path.size() || path[depth] < 0 || path[depth] >= (int) _currentChildren.size()) {
+    return false;
+  }
+  // Each child renders exactly one DOM node, and kept-alive children are out
+  // of the DOM, so DOM indices are indices into _currentChildren.
+  return _currentChildren[path[depth]]->DispatchEventAtPath(event, depth + 1);
+}
+
+void RenderMultiChildParent::WriteSnapshot(ElementUpdate& update, TreeSnapshot& snapshot) {
+  for (auto& child : _currentChildren) {
+    // A fresh build inserts each child at the end of an empty list.
+    child->WriteSnapshot(update.InsertChildElement(0), snapshot);
+  }
+}
+
 vector<int> ComputeLongestIncreasingSubsequence(vector<int> & sequence) {
   auto len = sequence.size();
   vector<int> predecessors;
@@ -254,18 +674,34 @@ void RenderMultiChildParent::Update(shared_ptr<Node> configPtr, ElementUpdate& u
   auto oldConfiguration = static_pointer_cast<MultiChildNode>(GetConfiguration());
 
   if (oldConfiguration == newConfiguration) {
-    // No need to diff child lists.
+    // No need to diff child lists. Only visit children that have updates
+    // scheduled, in order.
     if (GetHasDescendantsNeedingUpdate()) {
-      for (auto child = _currentChildren.begin(); child != _currentChildren.end(); child++) {
-        auto& childUpdate = update.UpdateChildElement(child - _currentChildren.begin());
-        (*child)->Update((*child)->GetConfiguration(), childUpdate);
+      vector<int> dirtyChildren;
+      dirtyChildren.swap(_childrenNeedingUpdate);
+      sort(dirtyChildren.begin(), dirtyChildren.end());
+      auto end = unique(dirtyChildren.begin(), dirtyChildren.end());
+      for (auto index = dirtyChildren.begin(); index != end; index++) {
+        auto& child = _currentChildren[*index];
+        auto& childUpdate = update.UpdateChildElement(*index);
+        child->Update(child->GetConfiguration(), childUpdate);
+        update.DiscardChildElementUpdateIfEmpty();
       }
     }
+    if (!_keptAlive.empty()) {
+      _evictExpired(update);
+    }
     RenderParent::Update(configPtr, update);
     return;
   }
 
   vector<shared_ptr<Node>> newChildren = newConfiguration->GetChildren();
+  // Leaf elements diff two empty lists; only trace and count the interesting
+  // ones.
+  bool isListDiff = !_currentChildren.empty() || !newChildren.empty();
+  TraceSpan span(isListDiff && GetTree()->IsTracing(), "diff", "ListDiff");
+  span.AddArg("oldChildren", _currentChildren.size());
+  span.AddArg("newChildren", newChildren.size());
 
   // A tuple with tracking information about a child node
   using TrackedChild = tuple<
@@ -305,11 +741,15 @@ void RenderMultiChildParent::Update(shared_ptr<Node> configPtr, ElementUpdate& u
     if (key != "") {
       auto baseEntry = keyMap.find(key);
       if (baseEntry != keyMap.end()) {
-        baseChild = currentChildren.begin() + baseEntry->second;
-        shared_ptr<RenderNode> currentChild = *(get<0>(*baseChild));
+        auto candidate = currentChildren.begin() + baseEntry->second;
+        shared_ptr<RenderNode> currentChild = *(get<0>(*candidate));
+        // A child whose key is reused by a node of a different kind is
+        // replaced rather than retained.
         if (currentChild->CanUpdateUsing(node)) {
-          auto& childUpdate = update.UpdateChildElement(get<1>(*baseChild));
+          auto& childUpdate = update.UpdateChildElement(get<1>(*candidate));
           currentChild->Update(node, childUpdate);
+          update.DiscardChildElementUpdateIfEmpty();
+          baseChild = candidate;
         }
       }
     } else {
@@ -320,9 +760,11 @@ void RenderMultiChildParent::Update(shared_ptr<Node> configPtr, ElementUpdate& u
       vector<TrackedChild>::iterator scanner = afterLastUsedUnkeyedChild;
       while(scanner != currentChildren.end()) {
         shared_ptr<RenderNode> currentChild = *(get<0>(*scanner));
-        if (currentChild->CanUpdateUsing(node)) {
+        // Keyed children are only ever matched by key.
+        if (currentChild->GetConfiguration()->GetKey() == "" && currentChild->CanUpdateUsing(node)) {
           auto& childUpdate = update.UpdateChildElement(get<1>(*scanner));
           currentChild->Update(node, childUpdate);
+          update.DiscardChildElementUpdateIfEmpty();
           baseChild = scanner;
           afterLastUsedUnkeyedChild = scanner + 1;
           break;
@@ -342,14 +784,26 @@ void RenderMultiChildParent::Update(shared_ptr<Node> configPtr, ElementUpdate& u
     targetList.push_back({node, baseIndex});
   }
 
+  FrameStats& stats = GetTree()->GetCurrentFrameStats();
+
   // Compute removes
   for (auto i = currentChildren.begin(); i != currentChildren.end(); i++) {
     if (!get<2>(*i)) {
-      update.RemoveChild((int) (i - currentChildren.begin()));
+      int index = (int) (i - currentChildren.begin());
+      if (_currentChildren[index]->GetConfiguration()->GetClassId() == Node::GetClassIdOf<KeepAlive>()) {
+        _keepAlive(index, update);
+      } else {
+        update.RemoveChild(index);
+        stats.RecordRemove();
+        _currentChildren[index]->Recycle();
+      }
     }
   }
 
   // Compute inserts and updates
+  if (isListDiff) {
+    stats.RecordListDiff(sequence.size());
+  }
   vector<int> lis = ComputeLongestIncreasingSubsequence(sequence);
   auto insertionPoint = lis.begin();
   vector<shared_ptr<RenderNode>> newChildVector;
@@ -377,8 +831,28 @@ void RenderMultiChildParent::Update(shared_ptr<Node> configPtr, ElementUpdate& u
       // New child
       shared_ptr<Node> childNode = get<0>(*targetEntry);
 
+      auto keptAlive = _keptAlive.end();
+      if (!_keptAlive.empty() && childNode->GetKey() != "") {
+        keptAlive = _keptAlive.find(childNode->GetKey());
+      }
+      if (keptAlive != _keptAlive.end()) {
+        shared_ptr<RenderNode> childRenderNode = get<0>(keptAlive->second);
+        if (childRenderNode->CanUpdateUsing(childNode)) {
+          // Put back the child kept alive, with whatever changed since.
+          auto& childRestore = update.RestoreChildElement(insertionIndex, keptAlive->first);
+          stats.RecordRestore();
+          _keptAlive.erase(keptAlive);
+          newChildVector.push_back(childRenderNode);
+          childRenderNode->Update(childNode, childRestore);
+          childRenderNode->Attach(shared_from_this());
+          continue;
+        }
+        _evict(keptAlive, update);
+      }
+
       // Lock the diff object so child nodes do not push diffs.
       auto& childInsertion = update.InsertChildElement(insertionIndex);
+      stats.RecordInsert();
       auto childRenderNode = childNode->Instantiate(GetTree());
       newChildVector.push_back(childRenderNode);
       childRenderNode->Update(childNode, childInsertion);
@@ -387,6 +861,7 @@ void RenderMultiChildParent::Update(shared_ptr<Node> configPtr, ElementUpdate& u
       if (baseIndex != insertionIndex) {
         // Moved child
         update.MoveChild(insertionIndex, baseIndex);
+        stats.RecordMove();
         newChildVector.push_back(_currentChildren[baseIndex]);
       } else {
         newChildVector.push_back(_currentChildren[baseIndex]);
@@ -394,8 +869,81 @@ void RenderMultiChildParent::Update(shared_ptr<Node> configPtr, ElementUpdate& u
     }
   }
   _currentChildren = newChildVector;
+  for (int i = 0; i < (int) _currentChildren.size(); i++) {
+    _currentChildren[i]->SetIndexInParent(i);
+  }
+  // Every child was visited above.
+  _childrenNeedingUpdate.clear();
+  if (!_keptAlive.empty()) {
+    _evictExpired(update);
+  }
 
   RenderParent::Update(configPtr, update);
 }
 
+void RenderMultiChildParent::ResetForReuse() {
+  // The children were recycled along with this node.
+  _currentChildren.clear();
+  _childrenNeedingUpdate.clear();
+  _keptAlive.clear();
+  RenderParent::ResetForReuse();
+}
+
+void RenderMultiChildParent::_keepAlive(int index, ElementUpdate& update) {
+  auto child = _currentChildren[index];
+  string key = child->GetConfiguration()->GetKey();
+  auto existing = _keptAlive.find(key);
+  if (existing != _keptAlive.end()) {
+    _evict(existing, update);
+  }
+  if (_keptAlive.size() == kMaxKeptAliveChildren) {
+    auto oldest = _keptAlive.begin();
+    for (auto entry = _keptAlive.begin(); entry != _keptAlive.end(); entry++) {
+      if (get<1>(entry->second) < get<1>(oldest->second)) {
+        oldest = entry;
+      }
+    }
+    _evict(oldest, update);
+  }
+
+  update.KeepChildAlive(index, key);
+  GetTree()->GetCurrentFrameStats().RecordKeepAlive();
+  // Detached, so that updates scheduled inside it stop at the child and are
+  // picked up when it is put back.
+  child->Detach();
+  _keptAlive[key] = make_tuple(child, GetTree()->GetFrameNumber());
+}
+
+void RenderMultiChildParent::_evict(map<string, tuple<shared_ptr<RenderNode>, int64_t>>::iterator keptAlive,
+                                    ElementUpdate& update) {
+  update.EvictKeptAliveChild(keptAlive->first);
+  GetTree()->GetCurrentFrameStats().RecordKeepAliveEviction();
+  get<0>(keptAlive->second)->Recycle();
+  _keptAlive.erase(keptAlive);
+}
+
+void RenderMultiChildParent::_evictExpired(ElementUpdate& update) {
+  int64_t frame = GetTree()->GetFrameNumber();
+  auto entry = _keptAlive.begin();
+  while (entry != _keptAlive.end()) {
+    auto next = entry;
+    next++;
+    auto child = get<0>(entry->second);
+    auto configuration = static_pointer_cast<KeepAlive>(child->GetConfiguration());
+    if (frame - get<1>(entry->second) > configuration->GetMaxFramesKeptAlive()) {
+      _evict(entry, update);
+    }
+    entry = next;
+  }
+}
+
+void RenderMultiChildParent::MarkChildNeedingUpdate(RenderNode& child) {
+  // Children that were removed, or not placed yet, are not tracked. The
+  // latter are visited by the list diff that places them.
+  int index = child.GetIndexInParent();
+  if (index < (int) _currentChildren.size() && _currentChildren[index].get() == &child) {
+    _childrenNeedingUpdate.push_back(index);
+  }
+}
+
 }
@@ -5,14 +5,21 @@
 #ifndef BARISTA2_API_H
 #define BARISTA2_API_H
 
+#include "perf.h"
+#include "record.h"
 #include "sync.h"
+#include "trace.h"
 #include "lib/json/src/json.hpp"
 
 #include <cassert>
+#include <deque>
 #include <functional>
+#include <map>
 #include <memory>
 #include <string>
+#include <tuple>
 #include <typeinfo>
+#include <unordered_map>
 #include <vector>
 
 using namespace std;
@@ -34,15 +41,61 @@ class RenderNode;
 class RenderParent;
 class Event;
 
+/// Identifies what a [Node] configures: its class and, for elements, its
+/// tag. A render node is only ever updated with configurations of the kind
+/// it was created from.
+class NodeKind {
+ public:
+  NodeKind(int classId, int tag) : _classId(classId), _tag(tag) { }
+
+  bool operator==(const NodeKind& other) const {
+    return _classId == other._classId && _tag == other._tag;
+  }
+  bool operator!=(const NodeKind& other) const { return !(*this == other); }
+
+ private:
+  // See [Node::GetClassId].
+  int _classId;
+
+  // Interned tag, or 0 for nodes without one.
+  int _tag;
+};
+
 class Node {
  public:
   Node() { }
   virtual string GetKey() { return _key; }
   virtual void SetKey(string key) { _key = key; }
   virtual shared_ptr<RenderNode> Instantiate(shared_ptr<Tree> t) = 0;
+  NodeKind GetKind() { return NodeKind(GetClassId(), _kindTag); }
+
+  /// A small number unique to the class of this node, looked up once per
+  /// node and once per class by its `type_info`.
+  int GetClassId() {
+    if (_classId == 0) {
+      _classId = _lookUpClassId(typeid(*this));
+    }
+    return _classId;
+  }
+
+  /// The class ID of nodes of class [T], see [GetClassId].
+  template<typename T>
+  static int GetClassIdOf() {
+    static const int classId = _lookUpClassId(typeid(T));
+    return classId;
+  }
+
+ protected:
+  /// Tells nodes of the same class apart in [GetKind], e.g. elements by tag.
+  void SetKindTag(int tag) { _kindTag = tag; }
 
  private:
+  static int _lookUpClassId(const type_info& type);
+
   string _key = "";
+  // 0 until looked up.
+  int _classId = 0;
+  int _kindTag = 0;
 };
 
 typedef function<void(shared_ptr<RenderNode>)> RenderNodeVisitor;
@@ -52,13 +105,15 @@ class RenderNode {
   RenderNode(shared_ptr<Tree> tree);
   virtual shared_ptr<Node> GetConfiguration() { return _configuration; }
   virtual shared_ptr<RenderParent> GetParent() { return _parent.lock(); }
-  virtual shared_ptr<Tree> GetTree() { return _tree; }
+  virtual const shared_ptr<Tree>& GetTree() { return _tree; }
   virtual void Detach() { _parent.reset(); }
   virtual void Attach(shared_ptr<RenderParent> newParent) { _parent = newParent; }
 
   /// Returns `true` iff the new configuration is compatible with this node and
   /// therefore it is legal to call [Update] with this configuration.
-  virtual bool CanUpdateUsing(shared_ptr<Node> newConfiguration) = 0;
+  ///
+  /// By default, configurations of the same [NodeKind] are compatible.
+  virtual bool CanUpdateUsing(shared_ptr<Node> newConfiguration);
 
   /// Updates this render node using [newConfiguration].
   virtual void Update(shared_ptr<Node> newConfiguration, ElementUpdate& update);
@@ -66,27 +121,120 @@ class RenderNode {
   virtual void VisitChildren(RenderNodeVisitor visitor) = 0;
   virtual void DispatchEvent(const Event& event) = 0;
 
+  /// Dispatches a path-addressed [event] whose path, from [depth] on, leads
+  /// from the DOM node of this render node to the target. Calls the
+  /// listeners of the element nearest to the target that has any.
+  ///
+  /// Returns `false` if neither the target nor any of its ancestors up to
+  /// this node has listeners, so that the caller can keep looking.
+  virtual bool DispatchEventAtPath(const Event& event, size_t depth) { return false; }
+
+  /// Writes this node, as it is now, into [update] the way [Update] writes
+  /// a new node, and appends its barista IDs and states to [snapshot] in
+  /// the order in which a fresh build would assign and create them.
+  virtual void WriteSnapshot(ElementUpdate& update, TreeSnapshot& snapshot) = 0;
+
+  /// Called when this node is removed from the tree for good. Detaches it
+  /// and its descendants, giving the ones that can be reused to the tree's
+  /// [RenderNodePool].
+  virtual void Recycle();
+
+  /// Position of this node among the children of a [RenderMultiChildParent]
+  /// as of the last frame.
+  int GetIndexInParent() { return _indexInParent; }
+  void SetIndexInParent(int index) { _indexInParent = index; }
+
+ protected:
+  /// Returns this node to the state it was instantiated in, so that it can
+  /// be updated with a new configuration as if it were new.
+  virtual void ResetForReuse();
+
  private:
   shared_ptr<Tree> _tree = nullptr;
   shared_ptr<Node> _configuration = nullptr;
   weak_ptr<RenderParent> _parent;
+  int _indexInParent = 0;
 };
 
+/// An event fired on a DOM element.
+///
+/// The target is either the barista ID of the nearest element with
+/// listeners or, when the tree uses path-addressed events (see
+/// [Tree::UsePathAddressedEvents]), the child indices leading from the
+/// app's root element to the element the event was fired on, written as
+/// "/0/3/1". "/" is the root element itself.
 class Event {
  public:
   Event(string type, string baristaId, string data)
       : _type(type), _baristaId(baristaId) {
     _data = nlohmann::json::parse(data);
+    if (!baristaId.empty() && baristaId[0] == '/') {
+      _parsePath();
+    }
   };
 
   const string GetType() const { return _type; }
   const string GetBaristaId() const { return _baristaId; }
   const nlohmann::json& GetData() const { return _data; }
 
+  /// Whether the target is a path rather than a barista ID.
+  bool IsPathAddressed() const { return _isPathAddressed; }
+
+  /// Child indices leading from the root element to the target.
+  const vector<int>& GetPath() const { return _path; }
+
  private:
+  void _parsePath();
+
   string _type;
   string _baristaId;
   nlohmann::json _data;
+  bool _isPathAddressed = false;
+  vector<int> _path;
+};
+
+/// Render nodes removed from the tree, kept for reuse by nodes of the same
+/// tag inserted later, so that lists with churning rows do not allocate and
+/// free a render node per row element.
+///
+/// Nodes are reset before they are released into the pool, but keep the
+/// memory their child lists hold.
+class RenderNodePool {
+ public:
+  static const size_t kDefaultMaxPerTag = 1024;
+  static const size_t kDefaultMaxSize = 4096;
+
+  /// Returns a released node for [tag], or `nullptr` if there is none.
+  shared_ptr<RenderNode> Acquire(int tag);
+
+  /// Keeps [node] for reuse by nodes of [tag], unless the pool is full.
+  void Release(int tag, shared_ptr<RenderNode> node);
+
+  /// Most nodes kept per tag, and in total. Setting either to 0 disables
+  /// pooling. Lowering them does not shrink the pool.
+  void SetMaxPerTag(size_t maxPerTag) { _maxPerTag = maxPerTag; }
+  void SetMaxSize(size_t maxSize) { _maxSize = maxSize; }
+
+  void Clear();
+
+  /// Number of nodes in the pool.
+  size_t GetSize() const { return _size; }
+
+  /// [Acquire] calls that returned a node, and ones that did not.
+  int64_t GetHits() const { return _hits; }
+  int64_t GetMisses() const { return _misses; }
+
+  /// [Release] calls that dropped the node because the pool was full.
+  int64_t GetDropped() const { return _dropped; }
+
+ private:
+  unordered_map<int, vector<shared_ptr<RenderNode>>> _freeLists;
+  size_t _size = 0;
+  size_t _maxPerTag = kDefaultMaxPerTag;
+  size_t _maxSize = kDefaultMaxSize;
+  int64_t _hits = 0;
+  int64_t _misses = 0;
+  int64_t _dropped = 0;
 };
 
 class Tree : public enable_shared_from_this<Tree> {
@@ -101,9 +249,188 @@ class Tree : public enable_shared_from_this<Tree> {
   string RenderFrame(int indent);
   void RenderFrameIntoUpdate(TreeUpdate & treeUpdate);
 
+  /// Heap allocations made by the last [RenderFrame], per phase.
+  ///
+  /// Only counted when the binary is linked with the allocation hook (see
+  /// alloc_hook.cpp); all zeros otherwise.
+  const PhaseAllocations& GetLastFrameAllocations() { return _lastFrameAllocations; }
+
+  /// Whether frames, builds, updates, list diffs and serialization are
+  /// recorded into the [TraceRecorder].
+  bool IsTracing() { return _isTracing; }
+  void SetTracing(bool isTracing) { _isTracing = isTracing; }
+
+  /// Returns recorded spans in Chrome's trace-event JSON format. Must not be
+  /// called while a frame is rendering (see [TraceRecorder::Dump]).
+  string DumpTrace() { return TraceRecorder::Dump(); }
+
+  /// Counters for the last completed [RenderFrame].
+  const FrameStats& GetLastFrameStats() { return _lastFrameStats; }
+
+  /// Counters for the frame being rendered. Render nodes record into it.
+  FrameStats& GetCurrentFrameStats() { return _currentFrameStats; }
+
+  /// Starts recording dispatched events and rendered frames so the session
+  /// can be replayed offline (see replay.cpp).
+  ///
+  /// Must be called before the first frame. Seeds `rand` with [seed], so
+  /// that app state derived from it is reproduced on replay.
+  void StartRecording(uint32_t seed);
+
+  /// The active recorder, or `nullptr` if the session is not being recorded.
+  shared_ptr<SessionRecorder> GetRecorder() { return _recorder; }
+
+  /// Makes update frames refer to previously sent strings by index (see
+  /// [StringTable]). The client must support string tables.
+  ///
+  /// Must be called before the first frame.
+  void UseStringTable();
+
+  /// Whether frames are encoded using a [StringTable].
+  bool UsesStringTable() { return _usesStringTable; }
+
+  /// Serializes frames in tasks of at least [minTaskNodes] patch nodes run
+  /// by [runner] (see [TreeUpdate::SetParallelSerialization]), or on the
+  /// rendering thread again if [runner] is `nullptr`.
+  void UseParallelSerialization(shared_ptr<TaskRunner> runner, size_t minTaskNodes);
+
+  /// Has the client address events by the path from the root element to
+  /// their target (see [Event]) rather than by barista ID, so that elements
+  /// with listeners are not given one.
+  ///
+  /// Must be called before the first frame.
+  void UsePathAddressedEvents();
+
+  /// Whether events are addressed by path.
+  bool UsesPathAddressedEvents() { return _usesPathAddressedEvents; }
+
+  /// Makes the first frame a "hydrate" frame rather than a "create" frame,
+  /// for a client whose host already shows the markup of the "create" frame,
+  /// e.g. because a tree of the same app rendered it on the server. Instead
+  /// of the markup, the frame carries the barista IDs of this tree's
+  /// elements (see [TreeUpdate::RenderHydration]).
+  ///
+  /// Must be called before the first frame.
+  void UseHydration();
+
+  /// Like [UseHydration], but only hydrates if [HashMarkup] of the markup
+  /// this tree would create is [serverMarkupHash], i.e. the hash of what the
+  /// client shows. The first frame is a "create" frame otherwise.
+  void UseHydration(uint64_t serverMarkupHash);
+
+  /// Whether the first frame was a "hydrate" frame.
+  bool IsHydrated() { return _isHydrated; }
+
+  /// Captures the tree as it is now, for [RestoreSnapshot]. See
+  /// [TreeSnapshot].
+  string TakeSnapshot();
+
+  /// Starts this tree from a snapshot taken of a tree of the same app.
+  ///
+  /// The first frame is the snapshot's, served without building anything.
+  /// The tree is built when it is first needed, i.e. for the next frame or
+  /// event, with states restored from their saved data and elements given
+  /// the barista IDs they had. If the result does not show exactly what the
+  /// snapshot did, the next frame is a "create" frame.
+  ///
+  /// Must be called before the first frame. Returns `false`, leaving the
+  /// tree as it was, if [bytes] is not a valid snapshot.
+  bool RestoreSnapshot(const string& bytes);
+
+  /// Whether the tree was built from a snapshot that it turned out to match.
+  bool IsRestoredFromSnapshot() { return _isRestoredFromSnapshot; }
+
+  /// Returns the barista ID for the next element that needs one. While the
+  /// tree is being built from a snapshot, these are the IDs the snapshot's
+  /// elements had.
+  string NextBaristaId();
+
+  /// Number of frames rendered so far, including the one being rendered.
+  int64_t GetFrameNumber() { return _frameNumber; }
+
+  /// Removed render nodes waiting to be reused.
+  RenderNodePool& GetRenderNodePool() { return _renderNodePool; }
+
+  static const int64_t kDefaultBackgroundBudgetMicros = 8000;
+
+  /// Time a frame may spend rebuilding states whose updates were scheduled
+  /// as [kBackgroundUpdate]. Urgent updates are always rendered by the next
+  /// frame; background ones are started in the order they were scheduled,
+  /// each estimated to take as long as its state's last rebuild, until the
+  /// next one would exceed the budget. At least one is started per frame.
+  void SetBackgroundBudget(int64_t micros) { _backgroundBudgetMicros = micros; }
+  int64_t GetBackgroundBudget() { return _backgroundBudgetMicros; }
+
+  /// Whether background updates are waiting for a frame. A host should keep
+  /// rendering frames while there are, even if no events come in.
+  bool HasBackgroundUpdates() { return _queuedBackgroundUpdates > 0; }
+
+  /// Latencies of the updates of [priority] rendered so far.
+  UpdateLatencyStats& GetUpdateLatencies(UpdatePriority priority) { return _updateLatencies[priority]; }
+
  private:
+  // Builds the tree restored from [_snapshot] and checks it against it.
+  void _buildFromSnapshot();
+
+  // Restores [state], just created, from [_snapshot], if it is being built.
+  void _restoreState(State& state);
+
+  // Renders [_frameUpdate], the first frame, for [UseHydration].
+  string _renderHydrationFrame(int indent);
+
+  void _queueBackgroundUpdate(shared_ptr<RenderStatefulWidget> node);
+
+  // Marks as many queued background updates as [_backgroundBudgetMicros]
+  // allows for the frame being rendered.
+  void _startBackgroundUpdates();
+
+  // Called when [node] rebuilt, which renders the updates scheduled on it.
+  void _didRebuild(RenderStatefulWidget& node);
+
+  // Records the latencies of [_renderedUpdates] at the end of a frame.
+  void _recordUpdateLatencies();
+
   shared_ptr<Node> _topLevelWidget = nullptr;
   shared_ptr<RenderNode> _topLevelNode = nullptr;
+  PhaseAllocations _lastFrameAllocations;
+  FrameStats _currentFrameStats;
+  FrameStats _lastFrameStats;
+  bool _isTracing = false;
+  shared_ptr<SessionRecorder> _recorder = nullptr;
+  bool _usesStringTable = false;
+  bool _usesPathAddressedEvents = false;
+  shared_ptr<TaskRunner> _taskRunner = nullptr;
+  StringTable _stringTable;
+  TreeUpdate _frameUpdate;
+  int64_t _frameNumber = 0;
+  RenderNodePool _renderNodePool;
+
+  // Set from [RestoreSnapshot] until the tree is built.
+  unique_ptr<TreeSnapshot> _snapshot;
+  bool _isSnapshotFrameSent = false;
+  bool _isBuildingFromSnapshot = false;
+  size_t _restoredBaristaIds = 0;
+  size_t _restoredStates = 0;
+  bool _isRestoredFromSnapshot = false;
+  // Set when the DOM the client has does not match the tree.
+  bool _needsCreateFrame = false;
+
+  bool _usesHydration = false;
+  bool _verifiesHydration = false;
+  uint64_t _serverMarkupHash = 0;
+  bool _isHydrated = false;
+
+  // Background updates in the order they were scheduled. Entries whose node
+  // was rebuilt meanwhile are skipped.
+  deque<weak_ptr<RenderStatefulWidget>> _backgroundUpdates;
+  int64_t _queuedBackgroundUpdates = 0;
+  int64_t _backgroundBudgetMicros = kDefaultBackgroundBudgetMicros;
+  // Updates rendered by the frame being rendered: their lane, and when and
+  // in which frame they were scheduled.
+  vector<tuple<UpdatePriority, int64_t, int64_t>> _renderedUpdates;
+  UpdateLatencyStats _updateLatencies[kUpdatePriorityCount];
+
+  friend class RenderStatefulWidget;
 };
 
 class RenderParent : public RenderNode {
@@ -113,6 +440,13 @@ class RenderParent : public RenderNode {
   virtual void ScheduleUpdate();
   virtual void Update(shared_ptr<Node> newConfiguration, ElementUpdate& update);
 
+  /// Called by [ScheduleUpdate] on every ancestor with the child of that
+  /// ancestor through which the update was scheduled.
+  virtual void MarkChildNeedingUpdate(RenderNode& child) { }
+
+ protected:
+  virtual void ResetForReuse();
+
  private:
   bool _hasDescendantsNeedingUpdate = true;
 };
@@ -140,9 +474,29 @@ class StatefulWidget : public Widget, public enable_shared_from_this<StatefulWid
 class State {
  public:
   shared_ptr<StatefulWidget> GetConfig() { return _config; }
-  void ScheduleUpdate();
+
+  /// Has [Build] called again for a frame soon, depending on [priority].
+  void ScheduleUpdate(UpdatePriority priority = kUrgentUpdate);
   virtual shared_ptr<Node> Build() = 0;
 
+  /// Called when the parent rebuilds the widget with a new configuration of
+  /// the same kind. The state is kept, and [GetConfig] already returns the
+  /// new configuration.
+  virtual void DidUpdateWidget(shared_ptr<StatefulWidget> oldConfig) { }
+
+  /// Whether [Build] must be called again after the configuration changed
+  /// from [oldConfig] to [GetConfig]. Override to skip rebuilding when the
+  /// inputs the state reads did not change.
+  virtual bool ShouldRebuild(shared_ptr<StatefulWidget> oldConfig) { return true; }
+
+  /// Writes the data [Build] depends on into [data] for a [TreeSnapshot]
+  /// and returns `true`, or returns `false` if there is nothing to save.
+  virtual bool SaveState(string& data) { return false; }
+
+  /// Called with the data saved by [SaveState] when the state is recreated
+  /// from a snapshot, before its first [Build].
+  virtual void RestoreState(const string& data) { }
+
  private:
   shared_ptr<RenderStatefulWidget> _node = nullptr;
   shared_ptr<StatefulWidget> _config = nullptr;
@@ -157,8 +511,9 @@ class RenderStatelessWidget : public RenderParent, public enable_shared_from_thi
   RenderStatelessWidget(shared_ptr<Tree> tree) : RenderParent(tree) {}
   virtual void VisitChildren(RenderNodeVisitor visitor) { visitor(_child); }
   virtual void DispatchEvent(const Event& event);
-  virtual bool CanUpdateUsing(shared_ptr<Node> newConfiguration);
+  virtual bool DispatchEventAtPath(const Event& event, size_t depth);
   virtual void Update(shared_ptr<Node> newConfiguration, ElementUpdate& update);
+  virtual void WriteSnapshot(ElementUpdate& update, TreeSnapshot& snapshot);
 
  private:
   shared_ptr<RenderNode> _child = nullptr;
@@ -177,31 +532,118 @@ class MultiChildNode : public Node {
   vector<shared_ptr<Node>> _children;
 };
 
+/// Keeps [child] around, along with its render nodes, states and DOM, when
+/// it is removed from a list of children, so that it is put back cheaply if
+/// it comes back within [GetMaxFramesKeptAlive] frames.
+///
+/// Only children of a [RenderMultiChildParent], such as an element's, are
+/// kept alive, under [key], which is also the node's key. A parent keeps at
+/// most [RenderMultiChildParent::kMaxKeptAliveChildren] children; the ones
+/// removed longest ago go first. Passing the same [child] instance again
+/// skips rebuilding it when it is put back.
+///
+/// Parents recognize it by class ID (see [Node::GetClassIdOf]), so it is
+/// final.
+class KeepAlive final : public Widget {
+ public:
+  static const int64_t kDefaultMaxFramesKeptAlive = 600;
+
+  KeepAlive(string key, shared_ptr<Node> child) : Widget(), _child(child) {
+    assert(key != "");
+    assert(child != nullptr);
+    SetKey(key);
+  }
+  virtual shared_ptr<RenderNode> Instantiate(shared_ptr<Tree> tree);
+  shared_ptr<Node> GetChild() { return _child; }
+
+  int64_t GetMaxFramesKeptAlive() { return _maxFramesKeptAlive; }
+  void SetMaxFramesKeptAlive(int64_t frames) { _maxFramesKeptAlive = frames; }
+
+ private:
+  shared_ptr<Node> _child;
+  int64_t _maxFramesKeptAlive = kDefaultMaxFramesKeptAlive;
+};
+
+class RenderKeepAlive : public RenderParent, public enable_shared_from_this<RenderKeepAlive> {
+ public:
+  RenderKeepAlive(shared_ptr<Tree> tree) : RenderParent(tree) {}
+  virtual void VisitChildren(RenderNodeVisitor visitor) { visitor(_child); }
+  virtual void DispatchEvent(const Event& event);
+  virtual bool DispatchEventAtPath(const Event& event, size_t depth);
+  virtual void Update(shared_ptr<Node> newConfiguration, ElementUpdate& update);
+  virtual void WriteSnapshot(ElementUpdate& update, TreeSnapshot& snapshot);
+
+ private:
+  shared_ptr<RenderNode> _child = nullptr;
+};
+
 class RenderStatefulWidget : public RenderParent, public enable_shared_from_this<RenderStatefulWidget> {
  public:
   RenderStatefulWidget(shared_ptr<Tree> tree) : RenderParent(tree) {}
   virtual void VisitChildren(RenderNodeVisitor visitor);
   virtual void DispatchEvent(const Event& event);
+  virtual bool DispatchEventAtPath(const Event& event, size_t depth);
   virtual void ScheduleUpdate();
-  virtual bool CanUpdateUsing(shared_ptr<Node> newConfiguration);
+  void ScheduleUpdate(UpdatePriority priority);
   virtual void Update(shared_ptr<Node> newConfiguration, ElementUpdate& update);
+  virtual void WriteSnapshot(ElementUpdate& update, TreeSnapshot& snapshot);
   virtual shared_ptr<State> GetState() { return _state; }
 
  private:
+  // Builds [_state] and updates the child with the result.
+  void _rebuild(TraceSpan& span, ElementUpdate& update);
+
+  // Makes the next frame rebuild this node.
+  void _markDirty();
+
   shared_ptr<State> _state = nullptr;
   shared_ptr<RenderNode> _child = nullptr;
   bool _isDirty = false;
+
+  // When the update scheduled in each lane was, in microseconds (see
+  // [TraceRecorder::NowMicros]), or -1 if there is none, and the frame
+  // number at the time.
+  int64_t _scheduledMicros[kUpdatePriorityCount] = {-1, -1};
+  int64_t _scheduledFrame[kUpdatePriorityCount] = {};
+  // Whether a background update waits in the tree's queue.
+  bool _isQueued = false;
+  // How long the last rebuild took, the estimate for the next one.
+  int64_t _lastRebuildMicros = 0;
+
+  friend class Tree;
 };
 
 class RenderMultiChildParent : public RenderParent, public enable_shared_from_this<RenderMultiChildParent> {
  public:
+  /// Most children a parent keeps alive at a time (see [KeepAlive]).
+  static const size_t kMaxKeptAliveChildren = 8;
+
   RenderMultiChildParent(shared_ptr<Tree> tree) : RenderParent(tree) {}
 
   virtual void VisitChildren(RenderNodeVisitor visitor);
+  virtual bool DispatchEventAtPath(const Event& event, size_t depth);
   virtual void Update(shared_ptr<Node> newConfiguration, ElementUpdate& update);
+  virtual void WriteSnapshot(ElementUpdate& update, TreeSnapshot& snapshot);
+  virtual void MarkChildNeedingUpdate(RenderNode& child);
+
+ protected:
+  virtual void ResetForReuse();
 
  private:
   vector<shared_ptr<RenderNode>> _currentChildren;
+
+  // Indices into _currentChildren of the children that have updates
+  // scheduled, possibly repeated. When only descendants changed, just
+  // these children are updated.
+  vector<int> _childrenNeedingUpdate;
+
+  // Removed [KeepAlive] children, by key, along with the frame they were
+  // removed in. Their DOM is kept by the client under the same key.
+  map<string, tuple<shared_ptr<RenderNode>, int64_t>> _keptAlive;
+
+  void _keepAlive(int index, ElementUpdate& update);
+  void _evict(map<string, tuple<shared_ptr<RenderNode>, int64_t>>::iterator keptAlive, ElementUpdate& update);
+  void _evictExpired(ElementUpdate& update);
 };
 
 }  // namespace barista
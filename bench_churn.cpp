@@ -0,0 +1,79 @@
+#include <chrono>
+#include <iostream>
+
+#include "api.h"
+#include "html.h"
+#include "test.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace barista;
+
+// Measures row churn: each frame removes the first 100 rows of a table and
+// appends 100 new ones, with and without the [RenderNodePool].
+
+class ChurnState : public State {
+ public:
+  int first = 0;
+  int rows = 1000;
+
+  virtual shared_ptr<Node> Build() {
+    auto table = El("table");
+    for (int i = first; i < first + rows; i++) {
+      auto row = table->El("tr");
+      row->SetKey(to_string(i));
+      row->El("th")->SetText(to_string(i));
+      for (int column = 0; column < 4; column++) {
+        auto cell = row->El("td");
+        cell->AddClassName("cell");
+        cell->El("span")->SetText(to_string(i * 4 + column));
+      }
+    }
+    return table;
+  }
+};
+
+class Churn : public StatefulWidget {
+ public:
+  shared_ptr<ChurnState> state = nullptr;
+
+  virtual shared_ptr<State> CreateState() {
+    return state = make_shared<ChurnState>();
+  }
+};
+
+void Benchmark(bool usePool) {
+  auto widget = make_shared<Churn>();
+  auto tree = make_shared<Tree>(widget);
+  if (!usePool) {
+    tree->GetRenderNodePool().SetMaxPerTag(0);
+  }
+  tree->RenderFrame();
+  auto& pool = tree->GetRenderNodePool();
+  int64_t hitsBefore = pool.GetHits();
+  int64_t missesBefore = pool.GetMisses();
+
+  const int frames = 100;
+  double millis = 0;
+  int64_t allocations = 0;
+  for (int frame = 0; frame < frames; frame++) {
+    widget->state->first += 100;
+    widget->state->ScheduleUpdate();
+    auto start = steady_clock::now();
+    tree->RenderFrame();
+    duration<double> elapsed = steady_clock::now() - start;
+    millis += elapsed.count() * 1000;
+    allocations += tree->GetLastFrameAllocations().Get(kPhaseDiff).GetCount();
+  }
+  cout << (usePool ? "pooled:   " : "unpooled: ") << millis / frames << "ms per frame, "
+       << allocations / frames << " diff allocs per frame, pool hits " << pool.GetHits() - hitsBefore
+       << ", misses " << pool.GetMisses() - missesBefore << endl;
+}
+
+int main() {
+  for (int round = 0; round < 2; round++) {
+    Benchmark(false);
+    Benchmark(true);
+  }
+  return 0;
+}
@@ -0,0 +1,119 @@
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "api.h"
+#include "html.h"
+#include "html_writer.h"
+#include "sync.h"
+#include "test.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace barista;
+
+// Measures printing multi-megabyte "create" frames with each of the
+// scanners [HtmlWriter] can use to find characters that need escaping, and
+// the scanners on their own.
+
+static const char* kScannerNames[] = {"scalar", "sse2", "avx2"};
+
+// User content of up to [maxWords] words: mostly plain ones, now and then
+// one that needs escaping.
+string RandomContent(mt19937& random, int maxWords) {
+  static vector<string> words = {"lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing",
+                                 "elit", "sed", "do", "eiusmod", "tempor", "incididunt", "labore"};
+  static vector<string> specials = {"R&D", "<none>", "\"quoted\"", "a > b"};
+  string content;
+  int length = 1 + random() % maxWords;
+  for (int i = 0; i < length; i++) {
+    content += i > 0 ? " " : "";
+    content += random() % 20 == 0 ? specials[random() % specials.size()] : words[random() % words.size()];
+  }
+  return content;
+}
+
+shared_ptr<Node> BuildTable(int rows, int maxWords, mt19937& random) {
+  auto table = El("table");
+  for (int r = 0; r < rows; r++) {
+    auto row = table->El("tr");
+    row->SetKey(to_string(r));
+    for (int c = 0; c < 8; c++) {
+      auto cell = row->El("td");
+      cell->SetAttribute("title", RandomContent(random, maxWords));
+      cell->SetText(RandomContent(random, maxWords));
+    }
+  }
+  return table;
+}
+
+void BenchmarkScan() {
+  mt19937 random(1);
+  string text;
+  while (text.size() < (8 << 20)) {
+    text += RandomContent(random, 10) + " ";
+  }
+  // No character to find, so that every byte is scanned.
+  for (char& c : text) {
+    if (c == '&' || c == '<' || c == '>' || c == '"') {
+      c = '.';
+    }
+  }
+  cout << "Scanning " << (text.size() >> 20) << "MB:" << endl;
+  for (int scanner = kScalarHtmlScanner; scanner <= kAvx2HtmlScanner; scanner++) {
+    if (!IsHtmlScannerSupported((HtmlScanner) scanner)) {
+      continue;
+    }
+    UseHtmlScanner((HtmlScanner) scanner);
+    auto start = steady_clock::now();
+    size_t found = 0;
+    for (int i = 0; i < 10; i++) {
+      found += FindHtmlEscape(text.data(), text.size(), true);
+    }
+    duration<double> elapsed = steady_clock::now() - start;
+    cout << "  " << kScannerNames[scanner] << ": " << text.size() * 10 / elapsed.count() / (1 << 20)
+         << "MB/s" << (found == text.size() * 10 ? "" : " (found something)") << endl;
+  }
+}
+
+void BenchmarkCreateFrame(int rows, int maxWords) {
+  mt19937 random(rows);
+  auto tree = make_shared<Tree>(BuildTable(rows, maxWords, random));
+  TreeUpdate update;
+  tree->RenderFrameIntoUpdate(update);
+  size_t frameSize = update.Render().size();
+  cout << rows << " rows of up to " << maxWords << " words per cell, " << frameSize / 1024
+       << "KB create frame:" << endl;
+  for (int scanner = kScalarHtmlScanner; scanner <= kAvx2HtmlScanner; scanner++) {
+    if (!IsHtmlScannerSupported((HtmlScanner) scanner)) {
+      continue;
+    }
+    UseHtmlScanner((HtmlScanner) scanner);
+    // Printing the markup, then all of the frame, which also encodes the
+    // markup as JSON.
+    auto start = steady_clock::now();
+    for (int i = 0; i < 5; i++) {
+      update.PrintHtml();
+    }
+    duration<double> print = (steady_clock::now() - start) / 5;
+    start = steady_clock::now();
+    for (int i = 0; i < 5; i++) {
+      update.Render();
+    }
+    duration<double> render = (steady_clock::now() - start) / 5;
+    cout << "  " << kScannerNames[scanner] << ": print " << print.count() * 1000 << "ms ("
+         << frameSize / print.count() / (1 << 20) << "MB/s), frame " << render.count() * 1000 << "ms" << endl;
+  }
+}
+
+int main() {
+  BenchmarkScan();
+  for (int rows : {2000, 10000, 40000}) {
+    BenchmarkCreateFrame(rows, 10);
+  }
+  // Paragraphs rather than labels.
+  BenchmarkCreateFrame(2000, 200);
+  UseHtmlScanner(GetBestHtmlScanner());
+  return 0;
+}
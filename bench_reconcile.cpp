@@ -0,0 +1,90 @@
+#include <chrono>
+#include <iostream>
+
+#include "api.h"
+#include "html.h"
+#include "test.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace barista;
+
+// Measures reconciliation: each frame rebuilds every row of a list and
+// matches the new nodes against the render nodes of the previous frame.
+// Little changes, so the time goes into deciding which render nodes can be
+// updated and walking them. Build with -DNDEBUG to leave out the asserts.
+
+class Cell : public StatelessWidget {
+ public:
+  Cell(int value) : _value(value) { }
+
+  virtual shared_ptr<Node> Build() {
+    auto cell = El("td");
+    cell->AddClassName("cell");
+    cell->AddChild(Tx(to_string(_value)));
+    return cell;
+  }
+
+ private:
+  int _value;
+};
+
+class TableState : public State {
+ public:
+  TableState(int rows) : _rows(rows) { }
+
+  int frame = 0;
+
+  virtual shared_ptr<Node> Build() {
+    auto table = El("table");
+    for (int i = 0; i < _rows; i++) {
+      auto row = table->El("tr");
+      row->SetKey(to_string(i));
+      row->El("th")->SetText("Row");
+      for (int column = 0; column < 4; column++) {
+        row->AddChild(make_shared<Cell>(i * 4 + column + (i == frame % _rows ? frame : 0)));
+      }
+      row->AddChild(El(i % 2 == 0 ? "td" : "th"));
+    }
+    return table;
+  }
+
+ private:
+  int _rows;
+};
+
+class Table : public StatefulWidget {
+ public:
+  Table(int rows) : _rows(rows) { }
+
+  shared_ptr<TableState> state = nullptr;
+
+  virtual shared_ptr<State> CreateState() {
+    return state = make_shared<TableState>(_rows);
+  }
+
+ private:
+  int _rows;
+};
+
+int main() {
+  for (int rows : {100, 1000, 10000}) {
+    auto widget = make_shared<Table>(rows);
+    auto tree = make_shared<Tree>(widget);
+    tree->RenderFrame();
+
+    const int frames = 50;
+    double diffMillis = 0;
+    for (int frame = 1; frame <= frames; frame++) {
+      widget->state->frame = frame;
+      widget->state->ScheduleUpdate();
+      auto start = steady_clock::now();
+      tree->RenderFrame();
+      duration<double> elapsed = steady_clock::now() - start;
+      diffMillis += elapsed.count() * 1000;
+    }
+    cout << rows << " rows: " << diffMillis / frames << "ms per frame ("
+         << diffMillis * 1000 / frames / rows << "us per row)" << endl;
+  }
+  return 0;
+}
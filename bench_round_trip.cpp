@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "api.h"
+#include "dom.h"
+#include "html.h"
+#include "sample_widgets.h"
+#include "virtual_list.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace barista;
+
+// Measures full round trips without a browser: event dispatch, diff and
+// serialization in `RenderFrame`, JSON parsing, and applying the patch to
+// the in-memory [Dom].
+
+class PhaseTimes {
+ public:
+  void Add(double dispatch, double render, double parse, double apply) {
+    _dispatch.push_back(dispatch);
+    _render.push_back(render);
+    _parse.push_back(parse);
+    _apply.push_back(apply);
+    _total.push_back(dispatch + render + parse + apply);
+  }
+
+  void Print(string label) {
+    cout << label << " (" << _total.size() << " round trips):" << endl;
+    _print("  dispatch", _dispatch);
+    _print("  render  ", _render);
+    _print("  parse   ", _parse);
+    _print("  apply   ", _apply);
+    _print("  total   ", _total);
+  }
+
+ private:
+  void _print(string label, vector<double> samples) {
+    sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (double sample : samples) {
+      sum += sample;
+    }
+    cout << label << ": mean " << sum / samples.size() << "ms, p50 "
+         << samples[samples.size() / 2] << "ms, p99 "
+         << samples[(size_t) ((samples.size() - 1) * 0.99)] << "ms" << endl;
+  }
+
+  vector<double> _dispatch;
+  vector<double> _render;
+  vector<double> _parse;
+  vector<double> _apply;
+  vector<double> _total;
+};
+
+double MillisSince(steady_clock::time_point start) {
+  duration<double> elapsed = steady_clock::now() - start;
+  return elapsed.count() * 1000;
+}
+
+// Sends [event] and carries the resulting frame all the way into [dom].
+void RoundTrip(shared_ptr<Tree> tree, Dom& dom, const Event& event, PhaseTimes& times) {
+  auto start = steady_clock::now();
+  tree->DispatchEvent(event);
+  double dispatch = MillisSince(start);
+
+  start = steady_clock::now();
+  auto frame = tree->RenderFrame();
+  double render = MillisSince(start);
+
+  start = steady_clock::now();
+  auto js = nlohmann::json::parse(frame);
+  double parse = MillisSince(start);
+
+  start = steady_clock::now();
+  dom.ApplyFrame(js);
+  double apply = MillisSince(start);
+
+  times.Add(dispatch, render, parse, apply);
+}
+
+// Clicks random buttons of SampleApp: status changes, row removals and the
+// "Add Row" button.
+void BenchmarkSampleApp(bool useStringTable) {
+  mt19937 random(1);
+  srand(1);
+  RenderElement::DangerouslyResetBaristaIdCounterForTesting();
+  auto tree = make_shared<Tree>(make_shared<SampleApp>());
+  if (useStringTable) {
+    tree->UseStringTable();
+  }
+  Dom dom;
+  auto start = steady_clock::now();
+  dom.ApplyFrame(tree->RenderFrame());
+  cout << "SampleApp initial render and apply: " << MillisSince(start) << "ms" << endl;
+
+  PhaseTimes times;
+  int64_t bytes = 0;
+  for (int i = 0; i < 200; i++) {
+    auto bids = dom.GetBaristaIds();
+    RoundTrip(tree, dom, Event("click", bids[random() % bids.size()], "{}"), times);
+    bytes += tree->GetLastFrameStats().GetBytesEmitted();
+  }
+  string label = useStringTable ? "SampleApp clicks, string table" : "SampleApp clicks";
+  times.Print(label);
+  cout << "  bytes   : " << bytes / 200 << " per frame" << endl;
+}
+
+void BenchmarkVirtualListScroll() {
+  RenderElement::DangerouslyResetBaristaIdCounterForTesting();
+  auto viewport = make_shared<Viewport>(600, 20);
+  auto tree = make_shared<Tree>(make_shared<VirtualList>(100000, [](int index) {
+    auto row = El("div");
+    row->AddClassName("row");
+    row->AddChild(Tx("Row " + to_string(index)));
+    return row;
+  }, viewport));
+  Dom dom;
+  dom.ApplyFrame(tree->RenderFrame());
+
+  PhaseTimes times;
+  for (int step = 1; step <= 500; step++) {
+    auto data = "{\"scrollTop\": " + to_string(step * 60) + "}";
+    RoundTrip(tree, dom, Event("scroll", "1", data), times);
+  }
+  times.Print("VirtualList scroll, 100k rows");
+}
+
+int main() {
+  BenchmarkSampleApp(false);
+  BenchmarkSampleApp(true);
+  BenchmarkVirtualListScroll();
+  return 0;
+}
@@ -0,0 +1,195 @@
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "api.h"
+#include "element_template.h"
+#include "html.h"
+#include "test.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace barista;
+
+// Compares a todo list whose rows are built from an [ElementTemplate] with
+// the same list built from plain [Element]s, as in `_renderTodoItem` of
+// todo_widgets.h. Each update frame rebuilds every row and toggles a few.
+
+class Row {
+ public:
+  int64_t key;
+  string title;
+  bool completed = false;
+  bool editing = false;
+};
+
+enum RowSlot {
+  kRowClasses,
+  kControlsClasses,
+  kChecked,
+  kToggle,
+  kTitle,
+  kDestroy,
+  kEditorClasses,
+  kEditorValue,
+};
+
+shared_ptr<ElementTemplate> RowTemplate() {
+  static shared_ptr<ElementTemplate> compiled = ElementTemplate::Compile(
+      TemplateElement("li")
+          .ClassSlot(kRowClasses)
+          .AddChild(TemplateElement("div")
+              .ClassSlot(kControlsClasses)
+              .AddChild(TemplateElement("input")
+                  .SetAttribute("type", "checkbox")
+                  .AddClassName("toggle")
+                  .AttributeSlot(kChecked, "checked")
+                  .ListenerSlot(kToggle, "click"))
+              .AddChild(TemplateElement("label").TextSlot(kTitle))
+              .AddChild(TemplateElement("button")
+                  .AddClassName("destroy")
+                  .ListenerSlot(kDestroy, "click")))
+          .AddChild(TemplateElement("div")
+              .AddChild(TemplateElement("input")
+                  .SetAttribute("type", "text")
+                  .AddClassName("edit")
+                  .ClassSlot(kEditorClasses)
+                  .AttributeSlot(kEditorValue, "value")))
+  );
+  return compiled;
+}
+
+shared_ptr<Node> BuildRowFromTemplate(const Row& row) {
+  auto li = make_shared<TemplateNode>(RowTemplate());
+  li->SetKey(to_string(row.key));
+  if (row.completed) {
+    li->AddClassName(kRowClasses, "completed");
+    li->SetAttribute(kChecked, "");
+  }
+  if (row.editing) {
+    li->AddClassName(kControlsClasses, "hidden");
+    li->AddClassName(kEditorClasses, "visible");
+  }
+  li->AddEventListener(kToggle, [](const Event& _) {});
+  li->SetText(kTitle, row.title);
+  li->AddEventListener(kDestroy, [](const Event& _) {});
+  li->SetAttribute(kEditorValue, row.title);
+  return li;
+}
+
+shared_ptr<Node> BuildRowFromElements(const Row& row) {
+  auto li = El("li");
+  li->SetKey(to_string(row.key));
+  auto controls = li->El("div");
+  if (row.editing) {
+    controls->AddClassName("hidden");
+  }
+  auto checkbox = controls->El("input");
+  checkbox->SetAttribute("type", "checkbox");
+  if (row.completed) {
+    li->AddClassName("completed");
+    checkbox->SetAttribute("checked", "");
+  }
+  checkbox->AddClassName("toggle");
+  checkbox->AddEventListener("click", [](const Event& _) {});
+  controls->El("label")->SetText(row.title);
+  auto removeButton = controls->El("button");
+  removeButton->AddClassName("destroy");
+  removeButton->AddEventListener("click", [](const Event& _) {});
+  auto input = li->El("div")->El("input");
+  input->SetAttribute("type", "text");
+  input->AddClassName("edit");
+  if (row.editing) {
+    input->AddClassName("visible");
+  }
+  input->SetAttribute("value", row.title);
+  return li;
+}
+
+class TodoListState : public State {
+ public:
+  TodoListState(int size, bool useTemplates) : _useTemplates(useTemplates) {
+    for (int i = 0; i < size; i++) {
+      Row row;
+      row.key = i;
+      row.title = "Todo item number " + to_string(i);
+      rows.push_back(row);
+    }
+  }
+
+  vector<Row> rows;
+
+  virtual shared_ptr<Node> Build() {
+    auto list = El("ul");
+    for (auto& row : rows) {
+      list->AddChild(_useTemplates ? BuildRowFromTemplate(row) : BuildRowFromElements(row));
+    }
+    return list;
+  }
+
+ private:
+  bool _useTemplates;
+};
+
+class TodoList : public StatefulWidget {
+ public:
+  TodoList(int size, bool useTemplates) : _size(size), _useTemplates(useTemplates) { }
+
+  shared_ptr<TodoListState> state = nullptr;
+
+  virtual shared_ptr<State> CreateState() {
+    return state = make_shared<TodoListState>(_size, _useTemplates);
+  }
+
+ private:
+  int _size;
+  bool _useTemplates;
+};
+
+double MillisSince(steady_clock::time_point start) {
+  duration<double> elapsed = steady_clock::now() - start;
+  return elapsed.count() * 1000;
+}
+
+void Benchmark(int size, bool useTemplates) {
+  mt19937 random(1);
+  auto widget = make_shared<TodoList>(size, useTemplates);
+  auto tree = make_shared<Tree>(widget);
+  auto start = steady_clock::now();
+  auto html = tree->RenderFrame();
+  double create = MillisSince(start);
+  int64_t createAllocations = tree->GetLastFrameAllocations().Get(kPhaseDiff).GetCount();
+
+  const int frames = 100;
+  double update = 0;
+  int64_t updateAllocations = 0;
+  for (int frame = 0; frame < frames; frame++) {
+    for (int i = 0; i < 3; i++) {
+      auto& row = widget->state->rows[random() % size];
+      if (random() % 2) {
+        row.completed = !row.completed;
+      } else {
+        row.editing = !row.editing;
+      }
+    }
+    widget->state->ScheduleUpdate();
+    start = steady_clock::now();
+    tree->RenderFrame();
+    update += MillisSince(start);
+    updateAllocations += tree->GetLastFrameAllocations().Get(kPhaseDiff).GetCount();
+  }
+
+  cout << "  " << (useTemplates ? "template" : "elements") << ": create " << create << "ms ("
+       << html.size() << " bytes, " << createAllocations << " diff allocs); update "
+       << update / frames << "ms per frame (" << updateAllocations / frames << " diff allocs)" << endl;
+}
+
+int main() {
+  for (int size : {100, 1000, 10000}) {
+    cout << size << " rows:" << endl;
+    Benchmark(size, false);
+    Benchmark(size, true);
+  }
+  return 0;
+}
@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "api.h"
+#include "html.h"
+#include "test.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace barista;
+
+// Measures input-to-frame latency while a large table refreshes: each frame
+// follows a keystroke echoed in a text field, and every 40th keystroke also
+// refreshes all sections of the table, either in the urgent lane like the
+// keystroke or in the background lane (see [UpdatePriority]).
+
+class TextFieldState : public State {
+ public:
+  string text;
+
+  virtual shared_ptr<Node> Build() {
+    auto field = El("input");
+    field->SetAttribute("value", text);
+    return field;
+  }
+};
+
+class TextField : public StatefulWidget {
+ public:
+  shared_ptr<TextFieldState> state = nullptr;
+
+  virtual shared_ptr<State> CreateState() {
+    return state = make_shared<TextFieldState>();
+  }
+};
+
+class TableSectionState : public State {
+ public:
+  int section = 0;
+  int version = 0;
+
+  virtual shared_ptr<Node> Build() {
+    auto body = El("tbody");
+    for (int i = 0; i < 50; i++) {
+      auto row = body->El("tr");
+      row->SetKey(to_string(i));
+      for (int column = 0; column < 4; column++) {
+        row->El("td")->SetText(to_string((section * 50 + i) * 4 + column + version));
+      }
+    }
+    return body;
+  }
+};
+
+class TableSection : public StatefulWidget {
+ public:
+  TableSection(vector<shared_ptr<TableSectionState>>& states) : _states(states) { }
+
+  virtual shared_ptr<State> CreateState() {
+    auto state = make_shared<TableSectionState>();
+    state->section = _states.size();
+    _states.push_back(state);
+    return state;
+  }
+
+ private:
+  vector<shared_ptr<TableSectionState>>& _states;
+};
+
+double Percentile(vector<double> values, double fraction) {
+  sort(values.begin(), values.end());
+  return values[(size_t) ((values.size() - 1) * fraction)];
+}
+
+void Benchmark(UpdatePriority refreshPriority) {
+  auto field = make_shared<TextField>();
+  vector<shared_ptr<TableSectionState>> sections;
+  auto app = El("div");
+  app->AddChild(field);
+  auto table = app->El("table");
+  for (int i = 0; i < 40; i++) {
+    table->AddChild(make_shared<TableSection>(sections));
+  }
+  auto tree = make_shared<Tree>(app);
+  tree->SetBackgroundBudget(4000);
+  tree->RenderFrame();
+
+  const int keystrokes = 200;
+  vector<double> frameMillis;
+  for (int keystroke = 0; keystroke < keystrokes; keystroke++) {
+    field->state->text += 'a';
+    field->state->ScheduleUpdate(kUrgentUpdate);
+    if (keystroke % 40 == 0) {
+      for (auto& section : sections) {
+        section->version++;
+        section->ScheduleUpdate(refreshPriority);
+      }
+    }
+    auto start = steady_clock::now();
+    tree->RenderFrame();
+    duration<double> elapsed = steady_clock::now() - start;
+    frameMillis.push_back(elapsed.count() * 1000);
+  }
+  while (tree->HasBackgroundUpdates()) {
+    tree->RenderFrame();
+  }
+
+  auto& input = tree->GetUpdateLatencies(kUrgentUpdate);
+  auto& refresh = tree->GetUpdateLatencies(refreshPriority);
+  cout << "Refreshing in the " << (refreshPriority == kUrgentUpdate ? "urgent" : "background") << " lane:" << endl;
+  cout << "  keystroke frames: p50 " << Percentile(frameMillis, 0.5) << "ms, p90 " << Percentile(frameMillis, 0.9)
+       << "ms, max " << Percentile(frameMillis, 1) << "ms" << endl;
+  cout << "  urgent updates:     " << input.ToJson() << endl;
+  if (refreshPriority != kUrgentUpdate) {
+    cout << "  background updates: " << refresh.ToJson() << endl;
+  }
+}
+
+int main() {
+  Benchmark(kUrgentUpdate);
+  Benchmark(kBackgroundUpdate);
+  return 0;
+}
@@ -0,0 +1,76 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "api.h"
+#include "html.h"
+#include "test.h"
+#include "virtual_list.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace barista;
+
+// Roughly the shape of a SampleApp row: a few nested elements, text and a
+// listener.
+shared_ptr<Node> BuildRow(int index) {
+  auto row = El("div");
+  row->AddClassName("row");
+  auto label = row->El("span");
+  label->AddClassName("label");
+  label->AddChild(Tx("Row " + to_string(index)));
+  auto button = row->El("button");
+  button->AddChild(Tx("Select"));
+  button->AddEventListener("click", [](const Event& event) { });
+  return row;
+}
+
+double Percentile(vector<double> samples, double p) {
+  sort(samples.begin(), samples.end());
+  size_t i = (size_t) (p * (samples.size() - 1));
+  return samples[i];
+}
+
+void BenchmarkScroll(int rowCount) {
+  const int kSteps = 500;
+  const int kRowHeight = 20;
+
+  RenderElement::DangerouslyResetBaristaIdCounterForTesting();
+  auto viewport = make_shared<Viewport>(600, kRowHeight);
+  auto tree = make_shared<Tree>(make_shared<VirtualList>(rowCount, BuildRow, viewport));
+
+  auto before_boot = steady_clock::now();
+  tree->RenderFrame();
+  duration<double> boot = steady_clock::now() - before_boot;
+
+  // Scrolls 3 rows at a time, like a mouse wheel notch. The scroll container
+  // is the first element with a listener, hence barista ID "1".
+  vector<double> steps;
+  int64_t bytes = 0;
+  for (int step = 1; step <= kSteps; step++) {
+    auto before_step = steady_clock::now();
+    auto data = "{\"scrollTop\": " + to_string(step * 3 * kRowHeight) + "}";
+    tree->DispatchEvent(Event("scroll", "1", data));
+    bytes += tree->RenderFrame().size();
+    duration<double> delta = steady_clock::now() - before_step;
+    steps.push_back(delta.count() * 1000);
+  }
+
+  double total = 0;
+  for (double step : steps) {
+    total += step;
+  }
+  cout << rowCount << " rows: boot " << boot.count() * 1000 << "ms; scroll step mean "
+       << total / kSteps << "ms, p50 " << Percentile(steps, 0.5) << "ms, p99 "
+       << Percentile(steps, 0.99) << "ms, max " << Percentile(steps, 1.0) << "ms; "
+       << bytes / kSteps << " bytes/step" << endl;
+  cout << "  last step stats: " << tree->GetLastFrameStats().ToJson() << endl;
+}
+
+int main() {
+  BenchmarkScroll(10000);
+  BenchmarkScroll(100000);
+  BenchmarkScroll(1000000);
+  return 0;
+}
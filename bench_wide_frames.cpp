@@ -0,0 +1,88 @@
+#include <chrono>
+#include <iostream>
+
+#include "api.h"
+#include "html.h"
+#include "test.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace barista;
+
+// Measures frames that insert many siblings at once: the initial render of
+// a wide list, and showing it again after it was hidden. These build the
+// widest patch trees.
+
+class WideListState : public State {
+ public:
+  WideListState(int width) : _width(width) { }
+
+  bool visible = true;
+
+  virtual shared_ptr<Node> Build() {
+    auto container = El("div");
+    if (visible) {
+      auto list = container->El("div");
+      for (int i = 0; i < _width; i++) {
+        auto row = list->El("div");
+        row->AddClassName("row");
+        row->El("span")->AddChild(Tx("Row " + to_string(i)));
+        row->El("span")->SetText("x");
+      }
+    }
+    return container;
+  }
+
+ private:
+  int _width;
+};
+
+class WideList : public StatefulWidget {
+ public:
+  WideList(int width) : _width(width) { }
+
+  shared_ptr<WideListState> state = nullptr;
+
+  virtual shared_ptr<State> CreateState() {
+    return state = make_shared<WideListState>(_width);
+  }
+
+ private:
+  int _width;
+};
+
+void PrintFrame(string label, shared_ptr<Tree> tree, double millis, int width) {
+  auto& allocations = tree->GetLastFrameAllocations();
+  cout << "  " << label << ": " << millis << "ms (" << millis * 1000 / width << "us per row); diff "
+       << allocations.Get(kPhaseDiff).GetCount() << " allocs/"
+       << allocations.Get(kPhaseDiff).GetBytes() << " bytes" << endl;
+}
+
+void BenchmarkWidth(int width) {
+  auto widget = make_shared<WideList>(width);
+  auto tree = make_shared<Tree>(widget);
+  cout << width << " rows:" << endl;
+
+  auto start = steady_clock::now();
+  tree->RenderFrame();
+  duration<double> elapsed = steady_clock::now() - start;
+  PrintFrame("create", tree, elapsed.count() * 1000, width);
+
+  for (int flip = 1; flip <= 4; flip++) {
+    widget->state->visible = !widget->state->visible;
+    widget->state->ScheduleUpdate();
+    start = steady_clock::now();
+    tree->RenderFrame();
+    elapsed = steady_clock::now() - start;
+    if (widget->state->visible) {
+      PrintFrame("show #" + to_string(flip / 2), tree, elapsed.count() * 1000, width);
+    }
+  }
+}
+
+int main() {
+  for (int width : {1000, 10000, 100000}) {
+    BenchmarkWidth(width);
+  }
+  return 0;
+}
@@ -8,6 +8,7 @@ import 'common.dart';
 
 int minMultiplier = 1;
 int maxMultiplier = 6;
+bool useTemplates = false;
 
 ArgParser argParser = new ArgParser()
   ..addOption('min', callback: (v) {
@@ -17,6 +18,11 @@ ArgParser argParser = new ArgParser()
   ..addOption('max', callback: (v) {
     if (v == null) return;
     maxMultiplier = int.parse(v);
+  })
+  ..addFlag('templates',
+      help: 'Build the C++ app from element templates (see make_giant.dart).',
+      callback: (bool v) {
+    useTemplates = v;
   });
 
 Future<Null> main(List<String> rawArgs) async {
@@ -34,7 +40,11 @@ Future<Null> main(List<String> rawArgs) async {
     Directory dist = await recreateDir('${rootDist.path}/$m');
 
     print('Building benchmark with multiplier $m');
-    await exec('dart', ['bin/make_giant.dart', '-m', '$m']);
+    var makeGiantArgs = ['bin/make_giant.dart', '-m', '$m'];
+    if (useTemplates) {
+      makeGiantArgs.add('--templates');
+    }
+    await exec('dart', makeGiantArgs);
 
     List<BuildResult> builds = await Future.wait(<Future<BuildResult>>[
       _buildWasm(),
@@ -46,9 +46,15 @@ void parseArgs(List<String> rawArgs) {
 Future<Null> compileBaristaLibraries() async {
   await cc('lib/json/src/json.hpp', 'json.bc');
   await cc('sync.cpp', 'sync.bc');
+  await cc('html_writer.cpp', 'html_writer.bc');
   await cc('api.cpp', 'api.bc');
   await cc('style.cpp', 'style.bc');
   await cc('html.cpp', 'html.bc');
+  await cc('perf.cpp', 'perf.bc');
+  await cc('record.cpp', 'record.bc');
+  await cc('trace.cpp', 'trace.bc');
+  await cc('virtual_list.cpp', 'virtual_list.bc');
+  await cc('element_template.cpp', 'element_template.bc');
 }
 
 Future<Null> compileMainApp() async {
@@ -57,14 +63,22 @@ Future<Null> compileMainApp() async {
     [
       'json.bc',
       'sync.bc',
+      'html_writer.bc',
       'api.bc',
       'style.bc',
       'html.bc',
+      'perf.bc',
+      'record.bc',
+      'trace.bc',
+      'virtual_list.bc',
+      'element_template.bc',
       'main.bc',
     ],
     'main.js',
     exportedFunctions: [
       '_RenderFrame',
+      '_GetLastFrameStats',
+      '_GetSessionRecording',
       '_DispatchEvent',
       '_main',
     ],
@@ -80,14 +94,22 @@ Future<Null> compileTodoApp() async {
     [
       'json.bc',
       'sync.bc',
+      'html_writer.bc',
       'api.bc',
       'style.bc',
       'html.bc',
+      'perf.bc',
+      'record.bc',
+      'trace.bc',
+      'virtual_list.bc',
+      'element_template.bc',
       'todo.bc',
     ],
     'todo.js',
     exportedFunctions: [
       '_RenderFrame',
+      '_GetLastFrameStats',
+      '_GetSessionRecording',
       '_DispatchEvent',
       '_main',
     ],
@@ -102,14 +124,21 @@ Future<Null> compileGiantApp() async {
       [
         'json.bc',
         'sync.bc',
+        'html_writer.bc',
         'api.bc',
         'style.bc',
         'html.bc',
+        'perf.bc',
+        'record.bc',
+        'trace.bc',
+        'virtual_list.bc',
+        'element_template.bc',
         'giant.bc',
       ],
       'giant.js',
       exportedFunctions: [
         '_RenderFrame',
+        '_GetLastFrameStats',
         '_DispatchEvent',
         '_main',
       ],
@@ -124,15 +153,25 @@ Future<Null> compileGiantApp() async {
 
 Future<Null> compileBaristaTests() async {
   await cc('test.cpp', 'test.bc');
+  await cc('alloc_hook.cpp', 'alloc_hook.bc');
+  await cc('dom.cpp', 'dom.bc');
   await cc('test_all.cpp', 'test_all.bc');
   await cc(
     [
       'json.bc',
       'sync.bc',
+      'html_writer.bc',
       'api.bc',
       'style.bc',
       'html.bc',
+      'perf.bc',
+      'record.bc',
+      'trace.bc',
+      'virtual_list.bc',
+      'element_template.bc',
       'test.bc',
+      'dom.bc',
+      'alloc_hook.bc',
       'test_all.bc'
     ],
     'test_all.js',
@@ -10,11 +10,17 @@ import 'package:barista2/src/ng2ts_generator.dart' as ng2ts;
 import 'package:barista2/src/inferno_generator.dart' as inferno;
 
 Future<Null> main(List<String> rawArgs) async {
+  bool useTemplates = false;
   var argParser = new ArgParser()
     ..addOption('multiplier', abbr: 'm', callback: (String v) {
       if (v != null) {
         multiplier = int.parse(v);
       }
+    })
+    ..addFlag('templates',
+        help: 'Emit C++ element subtrees as precompiled element templates.',
+        callback: (bool v) {
+      useTemplates = v;
     });
   argParser.parse(rawArgs);
 
@@ -34,7 +40,7 @@ Future<Null> main(List<String> rawArgs) async {
   print('  ${Field.fieldCount} fields');
   print('  Average fields/widget: ${Field.fieldCount / totalWidgets}');
 
-  new cpp.CodeEmitter().render(app).forEach((String file, String code) {
+  new cpp.CodeEmitter(useTemplates: useTemplates).render(app).forEach((String file, String code) {
     new File(file).writeAsStringSync(code.toString());
   });
 
@@ -11,16 +11,24 @@ CC="emcc -std=c++11 -O3 -s ASSERTIONS=1 -s NO_EXIT_RUNTIME=1"
 # Compile libs
 $CC lib/json/src/json.hpp -o json.bc
 $CC sync.cpp -o sync.bc
+$CC html_writer.cpp -o html_writer.bc
 $CC api.cpp -o api.bc
 $CC style.cpp -o style.bc
 $CC html.cpp -o html.bc
+$CC perf.cpp -o perf.bc
+$CC record.cpp -o record.bc
+$CC trace.cpp -o trace.bc
+$CC virtual_list.cpp -o virtual_list.bc
+$CC element_template.cpp -o element_template.bc
 
 # Compile sample app
 $CC main.cpp -o main.bc
-$CC json.bc sync.bc api.bc style.bc html.bc main.bc -o main.js \
-  -s EXPORTED_FUNCTIONS="['_RenderFrame', '_DispatchEvent', '_main']"
+$CC json.bc sync.bc html_writer.bc api.bc style.bc html.bc perf.bc record.bc trace.bc virtual_list.bc element_template.bc main.bc -o main.js \
+  -s EXPORTED_FUNCTIONS="['_RenderFrame', '_GetLastFrameStats', '_GetSessionRecording', '_DispatchEvent', '_main']"
 
 # Compile tests
 $CC test.cpp -o test.bc
+$CC alloc_hook.cpp -o alloc_hook.bc
+$CC dom.cpp -o dom.bc
 $CC test_all.cpp -o test_all.bc
-$CC json.bc sync.bc api.bc style.bc html.bc test.bc test_all.bc -o test_all.js
+$CC json.bc sync.bc html_writer.bc api.bc style.bc html.bc perf.bc record.bc trace.bc virtual_list.bc element_template.bc test.bc dom.bc alloc_hook.bc test_all.bc -o test_all.js
@@ -5,8 +5,22 @@
 #ifndef BARISTA2_COMMON_H
 #define BARISTA2_COMMON_H
 
+#include <cstdint>
+
 #define PRIVATE_COPY_AND_ASSIGN(TypeName) \
-  TypeName(const TypeName&) = default;      \
-  TypeName& operator=(const TypeName&) = default
+  TypeName(const TypeName&) = delete;      \
+  TypeName& operator=(const TypeName&) = delete
+
+namespace barista {
+
+/// Initial value of a 64-bit FNV-1a hash, see [Fnv1aUpdate].
+const uint64_t kFnv1aOffsetBasis = 14695981039346656037ULL;
+
+/// Folds [byte] into the 64-bit FNV-1a [hash].
+inline uint64_t Fnv1aUpdate(uint64_t hash, unsigned char byte) {
+  return (hash ^ byte) * 1099511628211ULL;
+}
+
+}  // namespace barista
 
 #endif //BARISTA2_COMMON_H
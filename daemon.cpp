@@ -0,0 +1,129 @@
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "api.h"
+#include "sample_widgets.h"
+#include "server.h"
+#include "todo_widgets.h"
+
+using namespace std;
+using namespace barista;
+
+// Renders barista apps natively for clients connected over a Unix domain
+// socket, one [Tree] per connection, or for a single client over
+// stdin/stdout. See [RendererSession] for the protocol and load_gen.cpp
+// for a client.
+//
+// With --serialize-threads, frames are serialized by a pool of that many
+// threads shared by all connections, in addition to the rendering thread.
+//
+// Usage: daemon <sample|todo> [--socket <path>] [--path-events] [--serialize-threads N]
+
+shared_ptr<Node> CreateApp(const string& name) {
+  if (name == "sample") {
+    return make_shared<SampleApp>();
+  }
+  if (name == "todo") {
+    return make_shared<TodoApp>();
+  }
+  return nullptr;
+}
+
+// Patch subtrees smaller than this are not worth handing to another thread.
+static const size_t kMinSerializeTaskNodes = 2000;
+
+shared_ptr<Tree> CreateTree(const string& appName, bool pathEvents, shared_ptr<ThreadPool> serializers) {
+  auto tree = make_shared<Tree>(CreateApp(appName));
+  if (pathEvents) {
+    tree->UsePathAddressedEvents();
+  }
+  if (serializers != nullptr) {
+    tree->UseParallelSerialization(serializers, kMinSerializeTaskNodes);
+  }
+  return tree;
+}
+
+void Serve(shared_ptr<Tree> tree, int inputFd, int outputFd, int connection) {
+  RendererSession session(tree, inputFd, outputFd);
+  session.Run();
+  cerr << "Connection " << connection << " closed: " << session.GetEventCount() << " events, "
+       << session.GetFrameCount() << " frames, at most " << session.GetMaxQueuedBytes()
+       << " bytes queued" << endl;
+}
+
+int main(int argc, char** argv) {
+  string socketPath = "";
+  bool pathEvents = false;
+  int serializeThreads = 0;
+  for (int i = 2; i < argc; i++) {
+    if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+      socketPath = argv[++i];
+    } else if (strcmp(argv[i], "--path-events") == 0) {
+      pathEvents = true;
+    } else if (strcmp(argv[i], "--serialize-threads") == 0 && i + 1 < argc) {
+      serializeThreads = atoi(argv[++i]);
+    } else {
+      argc = 0;
+    }
+  }
+  if (argc < 2 || serializeThreads < 0) {
+    cerr << "Usage: daemon <sample|todo> [--socket <path>] [--path-events] [--serialize-threads N]" << endl;
+    return 2;
+  }
+  string appName = argv[1];
+  if (CreateApp(appName) == nullptr) {
+    cerr << "Unknown app: " << appName << endl;
+    return 2;
+  }
+
+  shared_ptr<ThreadPool> serializers = nullptr;
+  if (serializeThreads > 0) {
+    serializers = make_shared<ThreadPool>(serializeThreads);
+  }
+
+  // Clients that go away are noticed by failed writes.
+  signal(SIGPIPE, SIG_IGN);
+
+  if (socketPath == "") {
+    // Apps may print to stdout; send that to stderr rather than into the
+    // frames.
+    int frameFd = dup(STDOUT_FILENO);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+    Serve(CreateTree(appName, pathEvents, serializers), STDIN_FILENO, frameFd, 0);
+    return 0;
+  }
+
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socketPath.size() >= sizeof(address.sun_path)) {
+    cerr << "Socket path too long: " << socketPath << endl;
+    return 2;
+  }
+  strcpy(address.sun_path, socketPath.c_str());
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(socketPath.c_str());
+  if (listener < 0 || ::bind(listener, (sockaddr*) &address, sizeof(address)) != 0 || listen(listener, 64) != 0) {
+    cerr << "Cannot listen on " << socketPath << ": " << strerror(errno) << endl;
+    return 1;
+  }
+  cerr << "Serving " << appName << " on " << socketPath << endl;
+
+  for (int connection = 1;; connection++) {
+    int client = accept(listener, nullptr, nullptr);
+    if (client < 0) {
+      continue;
+    }
+    thread([appName, pathEvents, serializers, client, connection] {
+      Serve(CreateTree(appName, pathEvents, serializers), client, client, connection);
+      close(client);
+    }).detach();
+  }
+}
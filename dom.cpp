@@ -0,0 +1,703 @@
+#include "dom.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <cstdlib>
+#include <iostream>
+
+namespace barista {
+
+namespace {
+
+const vector<string> _voidElements = {
+    "area", "base", "br", "col", "embed", "hr", "img", "input", "link", "meta", "source",
+    "track", "wbr",
+};
+
+bool _isVoidElement(const string& tag) {
+  return find(_voidElements.begin(), _voidElements.end(), tag) != _voidElements.end();
+}
+
+bool _isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+string _toLower(string s) {
+  for (char& c : s) {
+    c = (char) tolower(c);
+  }
+  return s;
+}
+
+void _appendUtf8(string& out, uint32_t codePoint) {
+  if (codePoint < 0x80) {
+    out.push_back((char) codePoint);
+  } else if (codePoint < 0x800) {
+    out.push_back((char) (0xC0 | (codePoint >> 6)));
+    out.push_back((char) (0x80 | (codePoint & 0x3F)));
+  } else if (codePoint < 0x10000) {
+    out.push_back((char) (0xE0 | (codePoint >> 12)));
+    out.push_back((char) (0x80 | ((codePoint >> 6) & 0x3F)));
+    out.push_back((char) (0x80 | (codePoint & 0x3F)));
+  } else {
+    out.push_back((char) (0xF0 | (codePoint >> 18)));
+    out.push_back((char) (0x80 | ((codePoint >> 12) & 0x3F)));
+    out.push_back((char) (0x80 | ((codePoint >> 6) & 0x3F)));
+    out.push_back((char) (0x80 | (codePoint & 0x3F)));
+  }
+}
+
+// Decodes the character references that HTML serializers emit. Anything
+// else, e.g. a bare "&", is kept as is, like the browser does.
+string _decodeEntities(const string& text) {
+  if (text.find('&') == string::npos) {
+    return text;
+  }
+  string out;
+  out.reserve(text.size());
+  for (size_t i = 0; i < text.size(); i++) {
+    if (text[i] != '&') {
+      out.push_back(text[i]);
+      continue;
+    }
+    size_t semicolon = text.find(';', i);
+    if (semicolon == string::npos || semicolon - i > 10) {
+      out.push_back('&');
+      continue;
+    }
+    string name = text.substr(i + 1, semicolon - i - 1);
+    if (name == "amp") {
+      out.push_back('&');
+    } else if (name == "lt") {
+      out.push_back('<');
+    } else if (name == "gt") {
+      out.push_back('>');
+    } else if (name == "quot") {
+      out.push_back('"');
+    } else if (name == "apos") {
+      out.push_back('\'');
+    } else if (name == "nbsp") {
+      _appendUtf8(out, 0xA0);
+    } else if (name.size() > 1 && name[0] == '#') {
+      bool hex = name[1] == 'x' || name[1] == 'X';
+      char* end = nullptr;
+      string digits = name.substr(hex ? 2 : 1);
+      unsigned long codePoint = strtoul(digits.c_str(), &end, hex ? 16 : 10);
+      if (digits.empty() || *end != '\0') {
+        out.push_back('&');
+        continue;
+      }
+      _appendUtf8(out, (uint32_t) codePoint);
+    } else {
+      out.push_back('&');
+      continue;
+    }
+    i = semicolon;
+  }
+  return out;
+}
+
+void _printEscaped(string& out, const string& text) {
+  for (char c : text) {
+    switch (c) {
+      case '&': out.append("&amp;"); break;
+      case '<': out.append("&lt;"); break;
+      case '>': out.append("&gt;"); break;
+      case '"': out.append("&quot;"); break;
+      default: out.push_back(c);
+    }
+  }
+}
+
+void _fail(const string& message, const nlohmann::json& update) {
+  cerr << "Failed to apply update: " << message << endl << update.dump(2) << endl;
+  abort();
+}
+
+}  // namespace
+
+shared_ptr<DomNode> DomNode::CreateElement(string tag) {
+  auto node = shared_ptr<DomNode>(new DomNode(kDomElement));
+  node->_tag = tag;
+  return node;
+}
+
+shared_ptr<DomNode> DomNode::CreateText(string value) {
+  auto node = shared_ptr<DomNode>(new DomNode(kDomText));
+  node->_value = value;
+  return node;
+}
+
+shared_ptr<DomNode> DomNode::CreateComment(string data) {
+  auto node = shared_ptr<DomNode>(new DomNode(kDomComment));
+  node->_value = data;
+  return node;
+}
+
+bool DomNode::HasAttribute(const string& name) const {
+  if (name == "class") {
+    return !_classList.empty();
+  }
+  for (auto& attribute : _attributes) {
+    if (attribute.first == name) {
+      return true;
+    }
+  }
+  return false;
+}
+
+string DomNode::GetAttribute(const string& name) const {
+  for (auto& attribute : _attributes) {
+    if (attribute.first == name) {
+      return attribute.second;
+    }
+  }
+  return "";
+}
+
+void DomNode::SetAttribute(const string& name, const string& value) {
+  if (name == "class") {
+    _classList.clear();
+    size_t start = 0;
+    while (start < value.size()) {
+      while (start < value.size() && _isSpace(value[start])) {
+        start++;
+      }
+      size_t end = start;
+      while (end < value.size() && !_isSpace(value[end])) {
+        end++;
+      }
+      if (end > start) {
+        AddClass(value.substr(start, end - start));
+      }
+      start = end;
+    }
+    return;
+  }
+  for (auto& attribute : _attributes) {
+    if (attribute.first == name) {
+      attribute.second = value;
+      return;
+    }
+  }
+  _attributes.push_back({name, value});
+}
+
+void DomNode::RemoveAttribute(const string& name) {
+  if (name == "class") {
+    _classList.clear();
+    return;
+  }
+  for (auto attribute = _attributes.begin(); attribute != _attributes.end(); attribute++) {
+    if (attribute->first == name) {
+      _attributes.erase(attribute);
+      return;
+    }
+  }
+}
+
+void DomNode::AddClass(const string& name) {
+  if (find(_classList.begin(), _classList.end(), name) == _classList.end()) {
+    _classList.push_back(name);
+  }
+}
+
+shared_ptr<DomNode> DomNode::ChildAt(int index) const {
+  if (index < 0 || index >= (int) _children.size()) {
+    return nullptr;
+  }
+  return _children[index];
+}
+
+shared_ptr<DomNode> DomNode::GetNextSibling() const {
+  auto parent = GetParent();
+  if (parent == nullptr) {
+    return nullptr;
+  }
+  auto& siblings = parent->_children;
+  for (size_t i = 0; i + 1 < siblings.size(); i++) {
+    if (siblings[i].get() == this) {
+      return siblings[i + 1];
+    }
+  }
+  return nullptr;
+}
+
+void DomNode::InsertBefore(shared_ptr<DomNode> child, shared_ptr<DomNode> reference) {
+  // Inserting a node before itself is a no-op in the DOM.
+  if (child == reference) {
+    return;
+  }
+  child->Remove();
+  auto position = _children.end();
+  if (reference != nullptr) {
+    position = find(_children.begin(), _children.end(), reference);
+    assert(position != _children.end());
+  }
+  _children.insert(position, child);
+  child->_parent = shared_from_this();
+}
+
+void DomNode::RemoveChild(shared_ptr<DomNode> child) {
+  auto position = find(_children.begin(), _children.end(), child);
+  assert(position != _children.end());
+  _children.erase(position);
+  child->_parent.reset();
+}
+
+void DomNode::ReplaceChild(shared_ptr<DomNode> newChild, shared_ptr<DomNode> oldChild) {
+  InsertBefore(newChild, oldChild);
+  RemoveChild(oldChild);
+}
+
+void DomNode::Remove() {
+  auto parent = GetParent();
+  if (parent != nullptr) {
+    parent->RemoveChild(shared_from_this());
+  }
+}
+
+void DomNode::SetInnerText(const string& text) {
+  for (auto& child : _children) {
+    child->_parent.reset();
+  }
+  _children.clear();
+  if (!text.empty()) {
+    AppendChild(CreateText(text));
+  }
+}
+
+void DomNode::SetInnerHtml(const string& html) {
+  SetInnerText("");
+  for (auto& node : ParseHtml(html)) {
+    AppendChild(node);
+  }
+}
+
+string DomNode::ToCanonicalString(bool normalizeBids) const {
+  string out;
+  _printCanonical(out, normalizeBids);
+  return out;
+}
+
+void DomNode::_printCanonical(string& out, bool normalizeBids) const {
+  if (_type == kDomText) {
+    out.append("\"");
+    _printEscaped(out, _value);
+    out.append("\"");
+    return;
+  }
+  if (_type == kDomComment) {
+    out.append("<!--" + _value + "-->");
+    return;
+  }
+
+  out.append("<" + _tag);
+  auto attributes = _attributes;
+  sort(attributes.begin(), attributes.end());
+  for (auto& attribute : attributes) {
+    out.append(" " + attribute.first + "=\"");
+    _printEscaped(out, normalizeBids && attribute.first == "_bid" ? "*" : attribute.second);
+    out.append("\"");
+  }
+  if (!_classList.empty()) {
+    out.append(" class=\"");
+    for (size_t i = 0; i < _classList.size(); i++) {
+      if (i > 0) {
+        out.append(" ");
+      }
+      _printEscaped(out, _classList[i]);
+    }
+    out.append("\"");
+  }
+  out.append(">");
+  for (auto& child : _children) {
+    child->_printCanonical(out, normalizeBids);
+  }
+  out.append("</" + _tag + ">");
+}
+
+vector<shared_ptr<DomNode>> ParseHtml(const string& html) {
+  auto fragment = DomNode::CreateElement("#fragment");
+  vector<shared_ptr<DomNode>> openElements = {fragment};
+  size_t i = 0;
+  size_t size = html.size();
+  while (i < size) {
+    if (html.compare(i, 4, "<!--") == 0) {
+      size_t end = html.find("-->", i + 4);
+      if (end == string::npos) {
+        end = size;
+      }
+      openElements.back()->AppendChild(DomNode::CreateComment(html.substr(i + 4, end - i - 4)));
+      i = min(size, end + 3);
+    } else if (html.compare(i, 2, "</") == 0) {
+      size_t end = html.find('>', i);
+      if (end == string::npos) {
+        end = size;
+      }
+      string tag = _toLower(html.substr(i + 2, end - i - 2));
+      // Close the nearest matching open element. Stray end tags, such as
+      // those of void elements, are ignored.
+      for (size_t depth = openElements.size() - 1; depth > 0; depth--) {
+        if (openElements[depth]->GetTag() == tag) {
+          openElements.resize(depth);
+          break;
+        }
+      }
+      i = min(size, end + 1);
+    } else if (html[i] == '<' && i + 1 < size && isalpha(html[i + 1])) {
+      size_t p = i + 1;
+      while (p < size && !_isSpace(html[p]) && html[p] != '>' && html[p] != '/') {
+        p++;
+      }
+      auto element = DomNode::CreateElement(_toLower(html.substr(i + 1, p - i - 1)));
+      vector<string> seen;
+      while (p < size && html[p] != '>') {
+        if (_isSpace(html[p]) || html[p] == '/') {
+          p++;
+          continue;
+        }
+        size_t nameStart = p;
+        while (p < size && !_isSpace(html[p]) && html[p] != '=' && html[p] != '>' && html[p] != '/') {
+          p++;
+        }
+        string name = _toLower(html.substr(nameStart, p - nameStart));
+        string value = "";
+        while (p < size && _isSpace(html[p])) {
+          p++;
+        }
+        if (p < size && html[p] == '=') {
+          p++;
+          while (p < size && _isSpace(html[p])) {
+            p++;
+          }
+          if (p < size && (html[p] == '"' || html[p] == '\'')) {
+            char quote = html[p];
+            size_t valueEnd = html.find(quote, p + 1);
+            if (valueEnd == string::npos) {
+              valueEnd = size;
+            }
+            value = html.substr(p + 1, valueEnd - p - 1);
+            p = min(size, valueEnd + 1);
+          } else {
+            size_t valueStart = p;
+            while (p < size && !_isSpace(html[p]) && html[p] != '>') {
+              p++;
+            }
+            value = html.substr(valueStart, p - valueStart);
+          }
+        }
+        // The first occurrence of a duplicated attribute wins.
+        if (find(seen.begin(), seen.end(), name) == seen.end()) {
+          seen.push_back(name);
+          element->SetAttribute(name, _decodeEntities(value));
+        }
+      }
+      openElements.back()->AppendChild(element);
+      if (!_isVoidElement(element->GetTag())) {
+        openElements.push_back(element);
+      }
+      i = min(size, p + 1);
+    } else {
+      size_t end = html.find('<', i + 1);
+      if (end == string::npos) {
+        end = size;
+      }
+      string text = _decodeEntities(html.substr(i, end - i));
+      auto& parent = openElements.back();
+      auto& siblings = parent->GetChildNodes();
+      // The parser merges adjacent text.
+      if (!siblings.empty() && siblings.back()->GetNodeType() == kDomText) {
+        siblings.back()->SetNodeValue(siblings.back()->GetNodeValue() + text);
+      } else {
+        parent->AppendChild(DomNode::CreateText(text));
+      }
+      i = end;
+    }
+  }
+
+  vector<shared_ptr<DomNode>> nodes = fragment->GetChildNodes();
+  for (auto& node : nodes) {
+    node->Remove();
+  }
+  return nodes;
+}
+
+void MaterializeTextNodes(shared_ptr<DomNode> root) {
+  vector<shared_ptr<DomNode>> markers;
+  vector<shared_ptr<DomNode>> stack = {root};
+  while (!stack.empty()) {
+    auto node = stack.back();
+    stack.pop_back();
+    if (node->GetNodeType() == kDomComment && node->GetNodeValue() == "t") {
+      markers.push_back(node);
+    }
+    auto& children = node->GetChildNodes();
+    for (auto child = children.rbegin(); child != children.rend(); child++) {
+      stack.push_back(*child);
+    }
+  }
+  for (auto& marker : markers) {
+    auto next = marker->GetNextSibling();
+    if (next != nullptr && next->GetNodeType() == kDomText) {
+      marker->Remove();
+    } else {
+      marker->GetParent()->ReplaceChild(DomNode::CreateText(""), marker);
+    }
+  }
+}
+
+// Decodes a string that may have been sent as an index into [strings].
+static string _decode(const nlohmann::json& value, const vector<string>& strings) {
+  if (value.is_number()) {
+    return strings.at(value.get<size_t>());
+  }
+  return value.get<string>();
+}
+
+void ApplyElementUpdate(shared_ptr<DomNode> element, const nlohmann::json& update) {
+  ApplyElementUpdate(element, update, vector<string>());
+}
+
+void ApplyElementUpdate(shared_ptr<DomNode> element, const nlohmann::json& update,
+                        const vector<string>& strings) {
+  if (update.find("replace") != update.end()) {
+    auto content = DomNode::CreateElement("#template");
+    content->SetInnerHtml(update["replace"].get<string>());
+    MaterializeTextNodes(content);
+    element->GetParent()->ReplaceChild(content->ChildAt(0), element);
+    return;
+  }
+  if (update.find("nodeValue") != update.end()) {
+    element->SetNodeValue(_decode(update["nodeValue"], strings));
+    return;
+  }
+  if (update.find("update-elements") != update.end()) {
+    for (auto& childUpdate : update["update-elements"]) {
+      auto child = element->ChildAt(childUpdate["index"].get<int>());
+      if (child == nullptr) {
+        _fail("child " + childUpdate["index"].dump() + " not found", update);
+      }
+      ApplyElementUpdate(child, childUpdate, strings);
+    }
+  }
+
+  // An element shows either its text or its children. When the text goes
+  // away the children that replace it are indexed as if it never existed.
+  bool hasText = update.find("text") != update.end();
+  string text = hasText ? _decode(update["text"], strings) : "";
+  if (hasText && text == "") {
+    element->SetInnerText("");
+  }
+
+  // All children are looked up by index before any of them moves.
+  vector<shared_ptr<DomNode>> removes;
+  if (update.find("remove") != update.end()) {
+    for (auto& index : update["remove"]) {
+      removes.push_back(element->ChildAt(index.get<int>()));
+    }
+  }
+  vector<pair<shared_ptr<DomNode>, string>> keptAlive;
+  if (update.find("keepAlive") != update.end()) {
+    auto& entries = update["keepAlive"];
+    for (size_t i = 0; i + 1 < entries.size(); i += 2) {
+      keptAlive.push_back({element->ChildAt(entries[i].get<int>()), entries[i + 1].get<string>()});
+    }
+  }
+  vector<shared_ptr<DomNode>> moves;
+  if (update.find("move") != update.end()) {
+    for (auto& index : update["move"]) {
+      moves.push_back(element->ChildAt(index.get<int>()));
+    }
+  }
+  vector<const nlohmann::json*> insertions;
+  vector<shared_ptr<DomNode>> insertionPoints;
+  vector<size_t> movesBefore;
+  if (update.find("insert") != update.end()) {
+    for (auto& descriptor : update["insert"]) {
+      insertions.push_back(&descriptor);
+      insertionPoints.push_back(element->ChildAt(descriptor["index"].get<int>()));
+      movesBefore.push_back(descriptor.value("movesBefore", (size_t) 0));
+    }
+  }
+
+  // Setting the text replaces all children, so it must happen before new
+  // children are inserted, but after existing ones were looked up.
+  if (hasText && text != "") {
+    element->SetInnerText(text);
+  }
+
+  if (update.find("classes") != update.end()) {
+    auto& classes = update["classes"];
+    if (classes.size() > 0) {
+      element->ClearClasses();
+      for (auto& encoded : classes) {
+        string className = _decode(encoded, strings);
+        if (className != "__clear__") {
+          element->AddClass(className);
+        }
+      }
+    }
+  }
+
+  for (auto& removed : removes) {
+    if (removed == nullptr) {
+      _fail("removed child not found", update);
+    }
+    removed->Remove();
+  }
+  for (auto& entry : keptAlive) {
+    if (entry.first == nullptr) {
+      _fail("child kept alive not found", update);
+    }
+    entry.first->Remove();
+    element->GetKeptAlive()[entry.second] = entry.first;
+  }
+  if (update.find("evict") != update.end()) {
+    for (auto& key : update["evict"]) {
+      if (element->GetKeptAlive().erase(key.get<string>()) == 0) {
+        _fail("evicted child not kept alive", update);
+      }
+    }
+  }
+
+  size_t appliedMoves = 0;
+  auto applyMovesUpTo = [&](size_t count) {
+    for (; appliedMoves < count; appliedMoves++) {
+      element->InsertBefore(moves[2 * appliedMoves + 1], moves[2 * appliedMoves]);
+    }
+  };
+  for (size_t i = 0; i < insertions.size(); i++) {
+    applyMovesUpTo(movesBefore[i]);
+    auto& descriptor = *insertions[i];
+    if (descriptor.find("restore") != descriptor.end()) {
+      auto keptAlive = element->GetKeptAlive().find(descriptor["restore"].get<string>());
+      if (keptAlive == element->GetKeptAlive().end()) {
+        _fail("restored child not kept alive", update);
+      }
+      auto child = keptAlive->second;
+      element->GetKeptAlive().erase(keptAlive);
+      element->InsertBefore(child, insertionPoints[i]);
+      if (descriptor.find("update") != descriptor.end()) {
+        ApplyElementUpdate(child, descriptor["update"], strings);
+      }
+      continue;
+    }
+    auto content = DomNode::CreateElement("#template");
+    content->SetInnerHtml(descriptor["html"].get<string>());
+    MaterializeTextNodes(content);
+    element->InsertBefore(content->ChildAt(0), insertionPoints[i]);
+  }
+  applyMovesUpTo(moves.size() / 2);
+
+  if (update.find("bid") != update.end()) {
+    element->SetAttribute("_bid", update["bid"].get<string>());
+  }
+  if (update.find("attrs") != update.end()) {
+    auto& attrs = update["attrs"];
+    if (attrs.is_array()) {
+      // Names and values of a frame encoded with a string table.
+      for (size_t i = 0; i + 1 < attrs.size(); i += 2) {
+        element->SetAttribute(_decode(attrs[i], strings), _decode(attrs[i + 1], strings));
+      }
+    } else {
+      for (auto attr = attrs.begin(); attr != attrs.end(); attr++) {
+        element->SetAttribute(attr.key(), attr.value().get<string>());
+      }
+    }
+  }
+  if (update.find("removeAttrs") != update.end()) {
+    for (auto& name : update["removeAttrs"]) {
+      element->RemoveAttribute(_decode(name, strings));
+    }
+  }
+}
+
+void Dom::ApplyFrame(const string& frame) {
+  ApplyFrame(nlohmann::json::parse(frame));
+}
+
+void Dom::ApplyFrame(const nlohmann::json& frame) {
+  if (frame.is_null()) {
+    return;
+  }
+  if (frame.find("create") != frame.end()) {
+    _host->SetInnerHtml(frame["create"].get<string>());
+    MaterializeTextNodes(_host);
+    _strings.clear();
+    _pathAddressedEvents = frame.find("events") != frame.end() && frame["events"] == "path";
+  }
+  if (frame.find("hydrate") != frame.end()) {
+    // The host already shows the markup; only the barista IDs change.
+    MaterializeTextNodes(_host);
+    auto& bids = frame["hydrate"];
+    size_t next = 0;
+    vector<shared_ptr<DomNode>> stack = {_host};
+    while (!stack.empty()) {
+      auto node = stack.back();
+      stack.pop_back();
+      if (node->HasAttribute("_bid") && next < bids.size()) {
+        node->SetAttribute("_bid", bids[next++].get<string>());
+      }
+      auto& children = node->GetChildNodes();
+      for (auto child = children.rbegin(); child != children.rend(); child++) {
+        stack.push_back(*child);
+      }
+    }
+    _strings.clear();
+    _pathAddressedEvents = frame.find("events") != frame.end() && frame["events"] == "path";
+  }
+  if (frame.find("strings") != frame.end()) {
+    for (auto& value : frame["strings"]) {
+      _strings.push_back(value.get<string>());
+    }
+  }
+  if (frame.find("update") != frame.end()) {
+    ApplyElementUpdate(_host->ChildAt(0), frame["update"], _strings);
+  }
+}
+
+string Dom::GetEventTarget(shared_ptr<DomNode> node) {
+  if (_pathAddressedEvents) {
+    vector<int> path;
+    while (node != nullptr && node != _host && node->GetParent() != _host) {
+      auto& siblings = node->GetParent()->GetChildNodes();
+      path.push_back(find(siblings.begin(), siblings.end(), node) - siblings.begin());
+      node = node->GetParent();
+    }
+    if (node == nullptr || node == _host) {
+      return "";
+    }
+    string target = "/";
+    for (auto index = path.rbegin(); index != path.rend(); index++) {
+      target += (index == path.rbegin() ? "" : "/") + to_string(*index);
+    }
+    return target;
+  }
+  for (; node != nullptr && node != _host; node = node->GetParent()) {
+    if (node->HasAttribute("_bid")) {
+      return node->GetAttribute("_bid");
+    }
+  }
+  return "";
+}
+
+vector<string> Dom::GetBaristaIds() {
+  vector<string> bids;
+  vector<shared_ptr<DomNode>> stack = {_host};
+  while (!stack.empty()) {
+    auto node = stack.back();
+    stack.pop_back();
+    if (node->HasAttribute("_bid")) {
+      bids.push_back(node->GetAttribute("_bid"));
+    }
+    auto& children = node->GetChildNodes();
+    for (auto child = children.rbegin(); child != children.rend(); child++) {
+      stack.push_back(*child);
+    }
+  }
+  return bids;
+}
+
+}  // namespace barista
@@ -0,0 +1,155 @@
+#ifndef BARISTA2_DOM_H
+#define BARISTA2_DOM_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "lib/json/src/json.hpp"
+
+using namespace std;
+
+namespace barista {
+
+enum DomNodeType {
+  kDomElement,
+  kDomText,
+  kDomComment,
+};
+
+/// A node of [Dom]: just enough of the browser's DOM to apply frames the
+/// way sync.js does.
+class DomNode : public enable_shared_from_this<DomNode> {
+ public:
+  static shared_ptr<DomNode> CreateElement(string tag);
+  static shared_ptr<DomNode> CreateText(string value);
+  static shared_ptr<DomNode> CreateComment(string data);
+
+  DomNodeType GetNodeType() const { return _type; }
+  const string& GetTag() const { return _tag; }
+
+  /// Text of text nodes and comments.
+  const string& GetNodeValue() const { return _value; }
+  void SetNodeValue(string value) { _value = value; }
+
+  /// Attributes in the order they were first set, except "class", which is
+  /// kept in [GetClassList].
+  const vector<pair<string, string>>& GetAttributes() const { return _attributes; }
+  bool HasAttribute(const string& name) const;
+  string GetAttribute(const string& name) const;
+  void SetAttribute(const string& name, const string& value);
+  void RemoveAttribute(const string& name);
+
+  const vector<string>& GetClassList() const { return _classList; }
+  void AddClass(const string& name);
+  void ClearClasses() { _classList.clear(); }
+
+  shared_ptr<DomNode> GetParent() const { return _parent.lock(); }
+  const vector<shared_ptr<DomNode>>& GetChildNodes() const { return _children; }
+
+  /// Like `childNodes.item(index)`: `nullptr` when out of range.
+  shared_ptr<DomNode> ChildAt(int index) const;
+  shared_ptr<DomNode> GetNextSibling() const;
+
+  /// Inserts [child] before [reference], or appends it if [reference] is
+  /// `nullptr`. Detaches [child] from its current parent first.
+  void InsertBefore(shared_ptr<DomNode> child, shared_ptr<DomNode> reference);
+  void AppendChild(shared_ptr<DomNode> child) { InsertBefore(child, nullptr); }
+  void RemoveChild(shared_ptr<DomNode> child);
+  void ReplaceChild(shared_ptr<DomNode> newChild, shared_ptr<DomNode> oldChild);
+
+  /// Detaches this node from its parent.
+  void Remove();
+
+  /// Children taken out of this element but kept alive by the app, by key,
+  /// like `_bKeptAlive` in sync.js.
+  map<string, shared_ptr<DomNode>>& GetKeptAlive() { return _keptAlive; }
+
+  /// Like setting `innerText`: replaces all children with a single text
+  /// node, or with nothing if [text] is empty.
+  void SetInnerText(const string& text);
+
+  /// Like setting `innerHTML`: replaces all children with the parsed [html].
+  void SetInnerHtml(const string& html);
+
+  /// Serializes the subtree with attributes sorted by name, so that two
+  /// trees compare equal iff they are equivalent. When [normalizeBids] is
+  /// set, `_bid` values are replaced with "*", because a freshly created
+  /// tree numbers its elements differently.
+  string ToCanonicalString(bool normalizeBids) const;
+
+ private:
+  DomNode(DomNodeType type) : _type(type) { }
+
+  void _printCanonical(string& out, bool normalizeBids) const;
+
+  DomNodeType _type;
+  string _tag = "";
+  string _value = "";
+  vector<pair<string, string>> _attributes;
+  vector<string> _classList;
+  weak_ptr<DomNode> _parent;
+  vector<shared_ptr<DomNode>> _children;
+  map<string, shared_ptr<DomNode>> _keptAlive;
+};
+
+/// Parses HTML printed by `ElementUpdate::PrintHtml` the way the browser's
+/// fragment parser would, including void elements and character references.
+vector<shared_ptr<DomNode>> ParseHtml(const string& html);
+
+/// Replaces the `<!--t-->` markers that precede text nodes with real text
+/// nodes, like `materializeTextNodes` in sync.js.
+void MaterializeTextNodes(shared_ptr<DomNode> root);
+
+/// A document holding the app's host element. Applies frames produced by
+/// `Tree::RenderFrame` exactly as `syncFromNative` in sync.js does.
+class Dom {
+ public:
+  Dom() : _host(DomNode::CreateElement("div")) {
+    _host->SetAttribute("id", "host");
+  }
+
+  shared_ptr<DomNode> GetHost() { return _host; }
+
+  /// The app's root element, i.e. the host's first child.
+  shared_ptr<DomNode> GetRoot() { return _host->ChildAt(0); }
+
+  /// Applies a serialized frame.
+  void ApplyFrame(const string& frame);
+
+  /// Applies a parsed frame.
+  void ApplyFrame(const nlohmann::json& frame);
+
+  /// The `_bid` of every element that has one, in document order.
+  vector<string> GetBaristaIds();
+
+  /// What `handleEvent` in sync.js sends as the target of an event fired on
+  /// [node]: the path from the root element to it if the last "create"
+  /// frame asked for path-addressed events, or else the `_bid` of the
+  /// nearest element that has one. Returns "" if there is no such path or
+  /// element, e.g. for the host itself.
+  string GetEventTarget(shared_ptr<DomNode> node);
+
+  string ToCanonicalString(bool normalizeBids) { return _host->ToCanonicalString(normalizeBids); }
+
+  /// The client's copy of the frames' [StringTable].
+  const vector<string>& GetStrings() { return _strings; }
+
+ private:
+  shared_ptr<DomNode> _host;
+  vector<string> _strings;
+  bool _pathAddressedEvents = false;
+};
+
+/// Applies an element update the way `applyElementUpdate` in sync.js does.
+void ApplyElementUpdate(shared_ptr<DomNode> element, const nlohmann::json& update);
+
+/// Applies an update whose strings may be indices into [strings].
+void ApplyElementUpdate(shared_ptr<DomNode> element, const nlohmann::json& update,
+                        const vector<string>& strings);
+
+}  // namespace barista
+
+#endif //BARISTA2_DOM_H
@@ -0,0 +1,543 @@
+#include "element_template.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace barista {
+
+TemplateElement& TemplateElement::SetAttribute(string name, string value) {
+  _attributes.push_back({name, value});
+  return *this;
+}
+
+TemplateElement& TemplateElement::AddClassName(string className) {
+  _classNames.push_back(className);
+  return *this;
+}
+
+TemplateElement& TemplateElement::SetText(string text) {
+  assert(_children.empty());
+  _text = text;
+  return *this;
+}
+
+TemplateElement& TemplateElement::AddChild(TemplateElement child) {
+  assert(_text.empty());
+  _children.push_back(child);
+  return *this;
+}
+
+TemplateElement& TemplateElement::AttributeSlot(int slot, string name) {
+  _slots.push_back(SlotDeclaration(kAttributeSlot, slot, name));
+  return *this;
+}
+
+TemplateElement& TemplateElement::ClassSlot(int slot) {
+  _slots.push_back(SlotDeclaration(kClassSlot, slot, ""));
+  return *this;
+}
+
+TemplateElement& TemplateElement::TextSlot(int slot) {
+  _slots.push_back(SlotDeclaration(kTextSlot, slot, ""));
+  return *this;
+}
+
+TemplateElement& TemplateElement::ChildrenSlot(int slot) {
+  _slots.push_back(SlotDeclaration(kChildrenSlot, slot, ""));
+  return *this;
+}
+
+TemplateElement& TemplateElement::ListenerSlot(int slot, string type) {
+  _slots.push_back(SlotDeclaration(kListenerSlot, slot, type));
+  return *this;
+}
+
+shared_ptr<ElementTemplate> ElementTemplate::Compile(const TemplateElement& root) {
+  shared_ptr<ElementTemplate> compiled(new ElementTemplate());
+  vector<int> path;
+  compiled->_compile(root, path);
+  // Slots are numbered without gaps.
+  assert(compiled->_documentOrder.size() == compiled->_slots.size());
+  return compiled;
+}
+
+void ElementTemplate::_appendLiteral(const string& literal) {
+  if (!_segments.empty() && _segments.back().kind == kLiteralSegment) {
+    _segments.back().literal += literal;
+  } else {
+    _segments.push_back(Segment(kLiteralSegment, literal, -1));
+  }
+}
+
+void ElementTemplate::_compile(const TemplateElement& element, vector<int>& path) {
+  // Attribute holes are sorted by name along with the static attributes, so
+  // that the markup matches that of an equivalent [Element].
+  vector<tuple<string, string, int>> attributes;
+  for (auto& attribute : element._attributes) {
+    attributes.push_back(make_tuple(attribute.first, attribute.second, -1));
+  }
+
+  int classSlot = -1;
+  int textSlot = -1;
+  int childrenSlot = -1;
+  int listenerElement = -1;
+  for (auto& declaration : element._slots) {
+    assert(declaration._slot >= 0);
+    if (declaration._slot >= (int) _slots.size()) {
+      _slots.resize(declaration._slot + 1);
+    }
+    TemplateSlot& slot = _slots[declaration._slot];
+    // Each slot is declared once.
+    assert(find(_documentOrder.begin(), _documentOrder.end(), declaration._slot) == _documentOrder.end());
+    _documentOrder.push_back(declaration._slot);
+    slot._kind = declaration._kind;
+    slot._path = path;
+    slot._name = declaration._name;
+    switch (declaration._kind) {
+      case kAttributeSlot:
+        attributes.push_back(make_tuple(declaration._name, "", declaration._slot));
+        break;
+      case kClassSlot:
+        assert(classSlot == -1);
+        classSlot = declaration._slot;
+        slot._staticClassNames = element._classNames;
+        break;
+      case kTextSlot:
+        assert(textSlot == -1 && childrenSlot == -1 && element._text.empty() && element._children.empty());
+        textSlot = declaration._slot;
+        break;
+      case kChildrenSlot:
+        assert(textSlot == -1 && childrenSlot == -1 && element._text.empty() && element._children.empty());
+        childrenSlot = declaration._slot;
+        break;
+      case kListenerSlot:
+        if (listenerElement == -1) {
+          listenerElement = _listenerElementCount++;
+        }
+        slot._listenerElement = listenerElement;
+        break;
+    }
+  }
+  stable_sort(attributes.begin(), attributes.end(),
+              [](const tuple<string, string, int>& a, const tuple<string, string, int>& b) {
+                return get<0>(a) < get<0>(b);
+              });
+
+  // Same layout as [ElementUpdate::PrintHtml].
+  _appendLiteral("<" + element._tag);
+  if (path.empty()) {
+    _segments.push_back(Segment(kKeySegment, "", -1));
+  }
+  HtmlWriter literal;
+  for (auto& attribute : attributes) {
+    if (get<2>(attribute) == -1) {
+      literal.Clear();
+      literal.WriteAttributeValue(get<1>(attribute));
+      _appendLiteral(" " + get<0>(attribute) + "=\"" + literal.GetHtml() + "\"");
+    } else {
+      _segments.push_back(Segment(kSlotSegment, "", get<2>(attribute)));
+    }
+  }
+  if (classSlot != -1) {
+    _segments.push_back(Segment(kSlotSegment, "", classSlot));
+  } else if (!element._classNames.empty()) {
+    literal.Clear();
+    literal.Write(" class=\"");
+    for (auto& className : element._classNames) {
+      literal.Write(' ');
+      literal.WriteAttributeValue(className);
+    }
+    literal.Write('"');
+    _appendLiteral(literal.GetHtml());
+  }
+  if (listenerElement != -1) {
+    _segments.push_back(Segment(kBaristaIdSegment, "", listenerElement));
+  }
+  literal.Clear();
+  literal.Write('>');
+  literal.WriteText(element._text);
+  _appendLiteral(literal.GetHtml());
+
+  if (textSlot != -1) {
+    _segments.push_back(Segment(kSlotSegment, "", textSlot));
+  } else if (childrenSlot != -1) {
+    _segments.push_back(Segment(kSlotSegment, "", childrenSlot));
+  }
+  for (int i = 0; i < (int) element._children.size(); i++) {
+    path.push_back(i);
+    _compile(element._children[i], path);
+    path.pop_back();
+  }
+
+  _appendLiteral("</" + element._tag + ">");
+}
+
+shared_ptr<RenderNode> TemplateSlotChildren::Instantiate(shared_ptr<Tree> tree) {
+  return make_shared<RenderTemplateSlot>(tree);
+}
+
+// Stands in for children slots that no children were added to.
+static shared_ptr<TemplateSlotChildren> EmptySlotChildren() {
+  static shared_ptr<TemplateSlotChildren> empty = make_shared<TemplateSlotChildren>();
+  return empty;
+}
+
+TemplateNode::TemplateNode(shared_ptr<ElementTemplate> elementTemplate)
+    : Node(), _template(elementTemplate), _values(elementTemplate->GetSlots().size()) { }
+
+shared_ptr<RenderNode> TemplateNode::Instantiate(shared_ptr<Tree> tree) {
+  return make_shared<RenderTemplate>(tree);
+}
+
+TemplateNode::SlotValue& TemplateNode::_slot(int slot, TemplateSlotKind kind) {
+  assert(slot >= 0 && slot < (int) _values.size());
+  assert(_template->GetSlots()[slot].GetKind() == kind);
+  return _values[slot];
+}
+
+void TemplateNode::SetText(int slot, string text) {
+  _slot(slot, kTextSlot).value = text;
+}
+
+void TemplateNode::SetAttribute(int slot, string value) {
+  SlotValue& attribute = _slot(slot, kAttributeSlot);
+  attribute.isSet = true;
+  attribute.value = value;
+}
+
+void TemplateNode::AddClassName(int slot, string className) {
+  _slot(slot, kClassSlot).classNames.push_back(className);
+}
+
+void TemplateNode::AddChild(int slot, shared_ptr<Node> child) {
+  SlotValue& children = _slot(slot, kChildrenSlot);
+  if (children.children == nullptr) {
+    children.children = make_shared<TemplateSlotChildren>();
+  }
+  children.children->AddChild(child);
+}
+
+void TemplateNode::AddEventListener(int slot, EventListener listener) {
+  _slot(slot, kListenerSlot).listener = listener;
+}
+
+// Writes the class attribute of a class slot's element, if it has any
+// classes.
+static void PrintClassNames(const TemplateSlot& slot, const vector<string>& classNames, HtmlWriter& html) {
+  if (slot.GetStaticClassNames().empty() && classNames.empty()) {
+    return;
+  }
+  html.Write(" class=\"");
+  for (auto& className : slot.GetStaticClassNames()) {
+    html.Write(' ');
+    html.WriteAttributeValue(className);
+  }
+  for (auto& className : classNames) {
+    html.Write(' ');
+    html.WriteAttributeValue(className);
+  }
+  html.Write('"');
+}
+
+// Opens the updates of a template's elements as slots ask for them. Slots
+// come in document order, so the open elements form a path from the root
+// and each element is opened at most once.
+class TemplateUpdateCursor {
+ public:
+  TemplateUpdateCursor(ElementUpdate& rootUpdate) : _open({&rootUpdate}) { }
+
+  ElementUpdate& Open(const vector<int>& path) {
+    size_t common = 0;
+    while (common < _path.size() && common < path.size() && _path[common] == path[common]) {
+      common++;
+    }
+    while (_path.size() > common) {
+      _pop();
+    }
+    while (_path.size() < path.size()) {
+      int index = path[_path.size()];
+      _open.push_back(&_open.back()->UpdateChildElement(index));
+      _path.push_back(index);
+    }
+    return *_open.back();
+  }
+
+  /// Drops the updates that ended up empty.
+  void Close() {
+    while (!_path.empty()) {
+      _pop();
+    }
+  }
+
+ private:
+  void _pop() {
+    _open.pop_back();
+    _path.pop_back();
+    _open.back()->DiscardChildElementUpdateIfEmpty();
+  }
+
+  vector<ElementUpdate*> _open;
+  vector<int> _path;
+};
+
+void RenderTemplate::VisitChildren(RenderNodeVisitor visitor) {
+  for (auto& slotChildren : _slotChildren) {
+    if (slotChildren != nullptr) {
+      visitor(slotChildren);
+    }
+  }
+}
+
+void RenderTemplate::DispatchEvent(const Event& event) {
+  auto configuration = static_pointer_cast<TemplateNode>(GetConfiguration());
+  auto& slots = configuration->_template->GetSlots();
+  for (int element = 0; element < (int) _baristaIds.size(); element++) {
+    if (_baristaIds[element] != event.GetBaristaId()) {
+      continue;
+    }
+    for (int slot = 0; slot < (int) slots.size(); slot++) {
+      auto& value = configuration->_values[slot];
+      if (slots[slot].GetKind() == kListenerSlot && slots[slot].GetListenerElement() == element &&
+          slots[slot].GetName() == event.GetType() && value.listener != nullptr) {
+        value.listener(event);
+      }
+    }
+    return;
+  }
+  VisitChildren([event](shared_ptr<RenderNode> child) {
+    child->DispatchEvent(event);
+  });
+}
+
+// Whether [prefix] is a prefix of [path] from [depth] on.
+static bool _pathStartsWith(const vector<int>& path, size_t depth, const vector<int>& prefix) {
+  return path.size() - depth >= prefix.size() && equal(prefix.begin(), prefix.end(), path.begin() + depth);
+}
+
+bool RenderTemplate::DispatchEventAtPath(const Event& event, size_t depth) {
+  auto configuration = static_pointer_cast<TemplateNode>(GetConfiguration());
+  auto& slots = configuration->_template->GetSlots();
+  auto& path = event.GetPath();
+
+  // An element with a children slot has no other children, so a path that
+  // goes past it leads into the slot's children.
+  for (int slot = 0; slot < (int) slots.size(); slot++) {
+    auto& slotPath = slots[slot].GetPath();
+    if (slots[slot].GetKind() == kChildrenSlot && path.size() - depth > slotPath.size() &&
+        _pathStartsWith(path, depth, slotPath)) {
+      if (_slotChildren[slot]->DispatchEventAtPath(event, depth + slotPath.size())) {
+        return true;
+      }
+      break;
+    }
+  }
+
+  // Bubble to the deepest of the template's elements with listeners that
+  // contains the target.
+  int element = -1;
+  size_t elementDepth = 0;
+  for (auto& slot : slots) {
+    if (slot.GetKind() == kListenerSlot && (element == -1 || slot.GetPath().size() > elementDepth) &&
+        _pathStartsWith(path, depth, slot.GetPath())) {
+      element = slot.GetListenerElement();
+      elementDepth = slot.GetPath().size();
+    }
+  }
+  if (element == -1) {
+    return false;
+  }
+  for (int slot = 0; slot < (int) slots.size(); slot++) {
+    auto& value = configuration->_values[slot];
+    if (slots[slot].GetKind() == kListenerSlot && slots[slot].GetListenerElement() == element &&
+        slots[slot].GetName() == event.GetType() && value.listener != nullptr) {
+      value.listener(event);
+    }
+  }
+  return true;
+}
+
+bool RenderTemplate::CanUpdateUsing(shared_ptr<Node> newConfiguration) {
+  if (!RenderParent::CanUpdateUsing(newConfiguration)) {
+    return false;
+  }
+  auto oldConfiguration = static_pointer_cast<TemplateNode>(GetConfiguration());
+  return static_pointer_cast<TemplateNode>(newConfiguration)->_template == oldConfiguration->_template;
+}
+
+void RenderTemplate::Update(shared_ptr<Node> configPtr, ElementUpdate& update) {
+  assert(dynamic_cast<TemplateNode*>(configPtr.get()) != nullptr);
+  auto newConfiguration = static_pointer_cast<TemplateNode>(configPtr);
+  auto oldConfiguration = static_pointer_cast<TemplateNode>(GetConfiguration());
+
+  if (oldConfiguration == nullptr) {
+    _create(newConfiguration, update);
+  } else if (oldConfiguration != newConfiguration) {
+    _update(oldConfiguration, newConfiguration, update);
+  } else if (GetHasDescendantsNeedingUpdate()) {
+    // Only children slots have descendants.
+    auto& elementTemplate = *newConfiguration->_template;
+    TemplateUpdateCursor cursor(update);
+    for (int slot : elementTemplate._documentOrder) {
+      auto slotChildren = static_pointer_cast<RenderTemplateSlot>(_slotChildren[slot]);
+      if (slotChildren != nullptr && slotChildren->GetHasDescendantsNeedingUpdate()) {
+        auto& elementUpdate = cursor.Open(elementTemplate._slots[slot].GetPath());
+        slotChildren->Update(slotChildren->GetConfiguration(), elementUpdate);
+      }
+    }
+    cursor.Close();
+  }
+
+  RenderParent::Update(configPtr, update);
+}
+
+void RenderTemplate::_create(shared_ptr<TemplateNode> configuration, ElementUpdate& update) {
+  auto& elementTemplate = *configuration->_template;
+  // Path-addressed events find elements by their position instead.
+  bool usesBaristaIds = !GetTree()->UsesPathAddressedEvents();
+  if (usesBaristaIds) {
+    _baristaIds.resize(elementTemplate._listenerElementCount);
+    for (auto& bid : _baristaIds) {
+      bid = GetTree()->NextBaristaId();
+    }
+  }
+  _slotChildren.resize(elementTemplate._slots.size());
+  _writeTemplate(configuration, update, nullptr);
+}
+
+void RenderTemplate::WriteSnapshot(ElementUpdate& update, TreeSnapshot& snapshot) {
+  for (auto& bid : _baristaIds) {
+    snapshot.AddBaristaId(bid);
+  }
+  _writeTemplate(static_pointer_cast<TemplateNode>(GetConfiguration()), update, &snapshot);
+}
+
+void RenderTemplate::_writeTemplate(shared_ptr<TemplateNode> configuration, ElementUpdate& update,
+                                    TreeSnapshot* snapshot) {
+  auto& elementTemplate = *configuration->_template;
+  bool usesBaristaIds = !_baristaIds.empty();
+  // Children inserted into [update] are spliced in where its markup ends at
+  // the time.
+  HtmlWriter& html = update.AppendHtml();
+  for (auto& segment : elementTemplate._segments) {
+    switch (segment.kind) {
+      case ElementTemplate::kLiteralSegment:
+        html.Write(segment.literal);
+        break;
+      case ElementTemplate::kKeySegment:
+        if (configuration->GetKey() != "") {
+          html.Write(" _bkey=\"");
+          html.WriteAttributeValue(configuration->GetKey());
+          html.Write('"');
+        }
+        break;
+      case ElementTemplate::kBaristaIdSegment:
+        if (usesBaristaIds) {
+          html.Write(" _bid=\"");
+          html.Write(_baristaIds[segment.index]);
+          html.Write('"');
+        }
+        break;
+      case ElementTemplate::kSlotSegment: {
+        auto& slot = elementTemplate._slots[segment.index];
+        auto& value = configuration->_values[segment.index];
+        switch (slot.GetKind()) {
+          case kTextSlot:
+            html.WriteText(value.value);
+            break;
+          case kAttributeSlot:
+            if (value.isSet) {
+              html.Write(' ');
+              html.Write(slot.GetName());
+              html.Write("=\"");
+              html.WriteAttributeValue(value.value);
+              html.Write('"');
+            }
+            break;
+          case kClassSlot:
+            PrintClassNames(slot, value.classNames, html);
+            break;
+          case kChildrenSlot: {
+            if (snapshot != nullptr) {
+              _slotChildren[segment.index]->WriteSnapshot(update, *snapshot);
+              break;
+            }
+            auto children = value.children != nullptr ? value.children : EmptySlotChildren();
+            auto slotChildren = children->Instantiate(GetTree());
+            slotChildren->Update(children, update);
+            slotChildren->Attach(shared_from_this());
+            _slotChildren[segment.index] = slotChildren;
+            break;
+          }
+          case kListenerSlot:
+            break;
+        }
+        break;
+      }
+    }
+  }
+}
+
+void RenderTemplate::_update(shared_ptr<TemplateNode> oldConfiguration, shared_ptr<TemplateNode> newConfiguration,
+                             ElementUpdate& update) {
+  auto& elementTemplate = *newConfiguration->_template;
+  FrameStats& stats = GetTree()->GetCurrentFrameStats();
+  TemplateUpdateCursor cursor(update);
+  for (int index : elementTemplate._documentOrder) {
+    auto& slot = elementTemplate._slots[index];
+    auto& oldValue = oldConfiguration->_values[index];
+    auto& newValue = newConfiguration->_values[index];
+    switch (slot.GetKind()) {
+      case kTextSlot:
+        if (newValue.value != oldValue.value) {
+          cursor.Open(slot.GetPath()).SetText(newValue.value);
+          stats.RecordTextChange();
+        }
+        break;
+      case kAttributeSlot:
+        if (newValue.isSet && (!oldValue.isSet || newValue.value != oldValue.value)) {
+          cursor.Open(slot.GetPath()).SetAttribute(slot.GetName(), newValue.value);
+          stats.RecordAttributeChange();
+        } else if (!newValue.isSet && oldValue.isSet) {
+          cursor.Open(slot.GetPath()).RemoveAttribute(slot.GetName());
+          stats.RecordAttributeChange();
+        }
+        break;
+      case kClassSlot:
+        if (newValue.classNames != oldValue.classNames) {
+          auto& elementUpdate = cursor.Open(slot.GetPath());
+          if (slot.GetStaticClassNames().empty() && newValue.classNames.empty()) {
+            elementUpdate.AddClassName("__clear__");
+          }
+          for (auto& className : slot.GetStaticClassNames()) {
+            elementUpdate.AddClassName(className);
+          }
+          for (auto& className : newValue.classNames) {
+            elementUpdate.AddClassName(className);
+          }
+          stats.RecordClassListChange();
+        }
+        break;
+      case kChildrenSlot: {
+        auto children = newValue.children != nullptr ? newValue.children : EmptySlotChildren();
+        auto& slotChildren = _slotChildren[index];
+        if (children != slotChildren->GetConfiguration() ||
+            static_pointer_cast<RenderParent>(slotChildren)->GetHasDescendantsNeedingUpdate()) {
+          slotChildren->Update(children, cursor.Open(slot.GetPath()));
+        }
+        break;
+      }
+      case kListenerSlot:
+        // Listeners are looked up when events arrive.
+        break;
+    }
+  }
+  cursor.Close();
+}
+
+void RenderTemplateSlot::DispatchEvent(const Event& event) {
+  VisitChildren([event](shared_ptr<RenderNode> child) {
+    child->DispatchEvent(event);
+  });
+}
+
+}  // namespace barista
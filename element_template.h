@@ -0,0 +1,235 @@
+#ifndef BARISTA2_ELEMENT_TEMPLATE_H
+#define BARISTA2_ELEMENT_TEMPLATE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "api.h"
+#include "html.h"
+
+namespace barista {
+
+using namespace std;
+
+enum TemplateSlotKind {
+  kTextSlot,
+  kAttributeSlot,
+  kClassSlot,
+  kChildrenSlot,
+  kListenerSlot,
+};
+
+/// Declares the static structure of an [ElementTemplate]: tags, attributes,
+/// classes and text that are the same for every instance, plus numbered
+/// slots for the parts that vary.
+///
+/// Slots are numbered by the caller, usually with an enum, from 0 without
+/// gaps. An element has at most one class slot, and text (static or a
+/// slot) and children (static or a slot) are mutually exclusive.
+class TemplateElement {
+ public:
+  TemplateElement(string tag) : _tag(tag) { }
+
+  TemplateElement& SetAttribute(string name, string value);
+  TemplateElement& AddClassName(string className);
+  TemplateElement& SetText(string text);
+  TemplateElement& AddChild(TemplateElement child);
+
+  /// An attribute whose value is set per instance. It is absent unless set.
+  TemplateElement& AttributeSlot(int slot, string name);
+
+  /// Classes added per instance after the static ones.
+  TemplateElement& ClassSlot(int slot);
+
+  /// Text set per instance.
+  TemplateElement& TextSlot(int slot);
+
+  /// Ordinary nodes, e.g. [Element]s, added per instance as the children of
+  /// this element.
+  TemplateElement& ChildrenSlot(int slot);
+
+  /// A listener for [type] events on this element, set per instance.
+  TemplateElement& ListenerSlot(int slot, string type);
+
+ private:
+  class SlotDeclaration {
+   private:
+    SlotDeclaration(TemplateSlotKind kind, int slot, string name)
+        : _kind(kind), _slot(slot), _name(name) { }
+    TemplateSlotKind _kind;
+    int _slot;
+    // Attribute name or event type.
+    string _name;
+    friend class TemplateElement;
+    friend class ElementTemplate;
+  };
+
+  string _tag;
+  vector<pair<string, string>> _attributes;
+  vector<string> _classNames;
+  string _text = "";
+  vector<TemplateElement> _children;
+  vector<SlotDeclaration> _slots;
+
+  friend class ElementTemplate;
+};
+
+/// A slot of a compiled [ElementTemplate].
+class TemplateSlot {
+ public:
+  TemplateSlotKind GetKind() const { return _kind; }
+
+  /// Child indices leading from the template's root element to the element
+  /// that owns the slot.
+  const vector<int>& GetPath() const { return _path; }
+
+  /// Attribute name or event type.
+  const string& GetName() const { return _name; }
+
+  /// Static classes of the owning element, for class slots.
+  const vector<string>& GetStaticClassNames() const { return _staticClassNames; }
+
+  /// Which of the template's elements with listeners owns the slot, for
+  /// listener slots.
+  int GetListenerElement() const { return _listenerElement; }
+
+ private:
+  TemplateSlotKind _kind = kTextSlot;
+  vector<int> _path;
+  string _name = "";
+  vector<string> _staticClassNames;
+  int _listenerElement = -1;
+
+  friend class ElementTemplate;
+};
+
+/// Markup with holes, compiled once from a [TemplateElement] and shared by
+/// all instances.
+///
+/// The static markup between holes is serialized ahead of time, so creating
+/// an instance only concatenates it with the slot values, and updating one
+/// only compares slot values. Instances are [TemplateNode]s.
+class ElementTemplate {
+ public:
+  static shared_ptr<ElementTemplate> Compile(const TemplateElement& root);
+
+  const vector<TemplateSlot>& GetSlots() const { return _slots; }
+
+  /// Number of elements that have listener slots, and thus a barista ID.
+  int GetListenerElementCount() const { return _listenerElementCount; }
+
+ private:
+  ElementTemplate() { }
+
+  enum SegmentKind {
+    kLiteralSegment,
+    kKeySegment,
+    kSlotSegment,
+    kBaristaIdSegment,
+  };
+
+  // A piece of markup: either literal, or a hole filled in per instance.
+  class Segment {
+   public:
+    Segment(SegmentKind kind, string literal, int index)
+        : kind(kind), literal(literal), index(index) { }
+    SegmentKind kind;
+    string literal;
+    // Slot or listener element.
+    int index;
+  };
+
+  void _compile(const TemplateElement& element, vector<int>& path);
+  void _appendLiteral(const string& literal);
+
+  vector<Segment> _segments;
+
+  // Indexed by slot.
+  vector<TemplateSlot> _slots;
+
+  // Slots in the order their elements appear in the markup, so that updates
+  // visit each element once, parents before children.
+  vector<int> _documentOrder;
+  int _listenerElementCount = 0;
+
+  friend class RenderTemplate;
+};
+
+/// The children of a children slot.
+class TemplateSlotChildren : public MultiChildNode {
+ public:
+  TemplateSlotChildren() : MultiChildNode() { }
+  virtual shared_ptr<RenderNode> Instantiate(shared_ptr<Tree> tree);
+};
+
+/// An instance of an [ElementTemplate], with a value for each slot.
+class TemplateNode : public Node {
+ public:
+  TemplateNode(shared_ptr<ElementTemplate> elementTemplate);
+  virtual shared_ptr<RenderNode> Instantiate(shared_ptr<Tree> tree);
+
+  shared_ptr<ElementTemplate> GetTemplate() { return _template; }
+
+  void SetText(int slot, string text);
+  void SetAttribute(int slot, string value);
+  void AddClassName(int slot, string className);
+  void AddChild(int slot, shared_ptr<Node> child);
+  void AddEventListener(int slot, EventListener listener);
+
+ private:
+  class SlotValue {
+   public:
+    bool isSet = false;
+    string value = "";
+    vector<string> classNames;
+    shared_ptr<TemplateSlotChildren> children = nullptr;
+    EventListener listener = nullptr;
+  };
+
+  SlotValue& _slot(int slot, TemplateSlotKind kind);
+
+  shared_ptr<ElementTemplate> _template;
+  vector<SlotValue> _values;
+
+  friend class RenderTemplate;
+};
+
+class RenderTemplate : public RenderParent, public enable_shared_from_this<RenderTemplate> {
+ public:
+  RenderTemplate(shared_ptr<Tree> tree) : RenderParent(tree) { }
+  virtual void VisitChildren(RenderNodeVisitor visitor);
+  virtual void DispatchEvent(const Event& event);
+  virtual bool DispatchEventAtPath(const Event& event, size_t depth);
+  virtual bool CanUpdateUsing(shared_ptr<Node> newConfiguration);
+  virtual void Update(shared_ptr<Node> newConfiguration, ElementUpdate& update);
+  virtual void WriteSnapshot(ElementUpdate& update, TreeSnapshot& snapshot);
+
+ private:
+  void _create(shared_ptr<TemplateNode> configuration, ElementUpdate& update);
+
+  // Writes the template's markup. Children slots are created, unless
+  // [snapshot] is given, in which case their current children are written
+  // into it.
+  void _writeTemplate(shared_ptr<TemplateNode> configuration, ElementUpdate& update, TreeSnapshot* snapshot);
+  void _update(shared_ptr<TemplateNode> oldConfiguration, shared_ptr<TemplateNode> newConfiguration,
+               ElementUpdate& update);
+
+  // Barista IDs of the elements with listeners. Empty when events are
+  // addressed by path.
+  vector<string> _baristaIds;
+
+  // Render nodes of children slots, indexed by slot.
+  vector<shared_ptr<RenderNode>> _slotChildren;
+};
+
+/// Holds the children of a children slot, diffed like an element's.
+class RenderTemplateSlot : public RenderMultiChildParent {
+ public:
+  RenderTemplateSlot(shared_ptr<Tree> tree) : RenderMultiChildParent(tree) { }
+  virtual void DispatchEvent(const Event& event);
+};
+
+}  // namespace barista
+
+#endif //BARISTA2_ELEMENT_TEMPLATE_H
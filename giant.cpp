@@ -7,6 +7,7 @@ shared_ptr<Tree> tree;
 // This is intentionally static so that the string is not
 // destroyed after it is returned to the JS side.
 string lastDiff;
+string lastFrameStats;
 
 extern "C" {
 
@@ -15,6 +16,11 @@ const char* RenderFrame() {
   return lastDiff.c_str();
 }
 
+const char* GetLastFrameStats() {
+  lastFrameStats = tree->GetLastFrameStats().ToJson();
+  return lastFrameStats.c_str();
+}
+
 void DispatchEvent(char* type, char* baristaId, char* data) {
   auto event = Event(type, baristaId, data);
   tree->DispatchEvent(event);
@@ -4,6 +4,7 @@
 
 #include <string>
 #include <iostream>
+#include <unordered_map>
 
 #include "api.h"
 #include "html.h"
@@ -11,34 +12,31 @@
 namespace barista {
 
 shared_ptr<RenderNode> Element::Instantiate(shared_ptr<Tree> tree) {
+  auto recycled = tree->GetRenderNodePool().Acquire(_tagAtom);
+  if (recycled != nullptr) {
+    return recycled;
+  }
   return make_shared<RenderElement>(tree);
 }
 
+int Element::_internTag(const string& tag) {
+  // 0 is reserved for nodes without a tag.
+  static unordered_map<string, int> atoms;
+  auto atom = atoms.find(tag);
+  if (atom != atoms.end()) {
+    return atom->second;
+  }
+  int newAtom = (int) atoms.size() + 1;
+  atoms[tag] = newAtom;
+  return newAtom;
+}
+
 void Element::AddEventListener(string type, EventListener listener) {
   _eventListeners.push_back(EventListenerConfig(type, listener));
 }
 
 int64_t RenderElement::_bidCounter = 1;
 
-bool RenderElement::CanUpdateUsing(shared_ptr<Node> newConfiguration) {
-  assert(newConfiguration != nullptr);
-  assert(GetConfiguration() != nullptr);
-  // TODO: figure out why dynamic_pointer_cast doesn't work.
-  if (!dynamic_cast<Element*>(newConfiguration.get())) {
-    return false;
-  }
-
-  shared_ptr<Element> element = static_pointer_cast<Element>(newConfiguration);
-  if (GetConfiguration() != nullptr) {
-    assert(dynamic_cast<Element*>(GetConfiguration().get()));
-    shared_ptr<Element> config = static_pointer_cast<Element>(GetConfiguration());
-    if (config->GetTag() != element->GetTag()) {
-      return false;
-    }
-  }
-  return true;
-}
-
 void RenderElement::Update(shared_ptr<Node> configPtr, ElementUpdate& update) {
   // TODO: figure out why dynamic_pointer_cast doesn't work
   assert(dynamic_cast<Element*>(configPtr.get()) != nullptr);
@@ -50,16 +48,24 @@ void RenderElement::Update(shared_ptr<Node> configPtr, ElementUpdate& update) {
   shared_ptr<Element> oldConfiguration = static_pointer_cast<Element>(GetConfiguration());
 
   if (oldConfiguration != nullptr) {
+    FrameStats& stats = GetTree()->GetCurrentFrameStats();
     if (oldConfiguration->_text != newConfiguration->_text) {
       update.SetText(newConfiguration->_text);
+      stats.RecordTextChange();
     }
-    if (newConfiguration->_eventListeners.size() > 0) {
+    if (GetTree()->UsesPathAddressedEvents()) {
+      // Events find their element by its position instead.
+    } else if (newConfiguration->_eventListeners.size() > 0) {
       if (oldConfiguration->_bid != "") {
         newConfiguration->_bid = oldConfiguration->_bid;
       } else {
-        newConfiguration->_bid = to_string(NextBid());
+        newConfiguration->_bid = GetTree()->NextBaristaId();
         update.SetBaristaId(newConfiguration->_bid);
       }
+    } else if (oldConfiguration->_bid != "") {
+      // A stale ID would stop the client from looking further up the tree
+      // for a listener.
+      update.RemoveAttribute("_bid");
     }
     auto& newAttrs = newConfiguration->_attributes;
     auto& oldAttrs = oldConfiguration->_attributes;
@@ -71,6 +77,7 @@ void RenderElement::Update(shared_ptr<Node> configPtr, ElementUpdate& update) {
         auto oldValueIter = oldAttrs.find(name);
         if (oldValueIter == oldAttrs.end() || newValue != oldValueIter->second) {
           update.SetAttribute(attr->first, attr->second);
+          stats.RecordAttributeChange();
         }
       }
 
@@ -78,7 +85,8 @@ void RenderElement::Update(shared_ptr<Node> configPtr, ElementUpdate& update) {
       for (auto attr = oldAttrs.begin(); attr != oldAttrs.end(); attr++) {
         auto name = attr->first;
         if (newAttrs.find(name) == newAttrs.end()) {
-          update.SetAttribute(attr->first, "");
+          update.RemoveAttribute(attr->first);
+          stats.RecordAttributeChange();
         }
       }
     }
@@ -90,55 +98,66 @@ void RenderElement::Update(shared_ptr<Node> configPtr, ElementUpdate& update) {
         for (auto i = ibegin; i != iend; i++) {
           update.AddClassName(*i);
         }
+        stats.RecordClassListChange();
       }
     } else if (!oldConfiguration->_classNames.empty()) {
       update.AddClassName("__clear__");
+      stats.RecordClassListChange();
     }
 
     // TODO(yjbanov): implement style diffing
   } else {
-    update.SetTag(newConfiguration->GetTag());
-    auto key = newConfiguration->GetKey();
-    if (key != "") {
-      update.SetKey(key);
-    }
-    if (newConfiguration->_bid != "") {
-      update.SetBaristaId(newConfiguration->_bid);
+    if (newConfiguration->_eventListeners.size() > 0 && !GetTree()->UsesPathAddressedEvents()) {
+      newConfiguration->_bid = GetTree()->NextBaristaId();
     }
-    if (newConfiguration->_eventListeners.size() > 0) {
-      newConfiguration->_bid = to_string(NextBid());
-      update.SetBaristaId(newConfiguration->_bid);
-    }
-    update.SetText(newConfiguration->_text);
-    if (newConfiguration->_attributes.size() > 0) {
-      auto first = newConfiguration->_attributes.begin();
-      auto last = newConfiguration->_attributes.end();
-      for (auto attr = first; attr != last; attr++) {
-        update.SetAttribute(attr->first, attr->second);
-      }
+    _writeElement(newConfiguration, update);
+  }
+
+  RenderMultiChildParent::Update(configPtr, update);
+}
+
+void RenderElement::_writeElement(shared_ptr<Element> configuration, ElementUpdate& update) {
+  update.SetTag(configuration->GetTag());
+  auto key = configuration->GetKey();
+  if (key != "") {
+    update.SetKey(key);
+  }
+  if (configuration->_bid != "") {
+    update.SetBaristaId(configuration->_bid);
+  }
+  update.SetText(configuration->_text);
+  if (configuration->_attributes.size() > 0) {
+    auto first = configuration->_attributes.begin();
+    auto last = configuration->_attributes.end();
+    for (auto attr = first; attr != last; attr++) {
+      update.SetAttribute(attr->first, attr->second);
     }
+  }
 
-    if (!newConfiguration->_classNames.empty()) {
-      auto ibegin = newConfiguration->_classNames.begin();
-      auto iend = newConfiguration->_classNames.end();
-      for (auto i = ibegin; i != iend; i++) {
-        update.AddClassName(*i);
-      }
+  if (!configuration->_classNames.empty()) {
+    auto ibegin = configuration->_classNames.begin();
+    auto iend = configuration->_classNames.end();
+    for (auto i = ibegin; i != iend; i++) {
+      update.AddClassName(*i);
     }
   }
+}
 
-  RenderMultiChildParent::Update(configPtr, update);
+void RenderElement::WriteSnapshot(ElementUpdate& update, TreeSnapshot& snapshot) {
+  assert(dynamic_cast<Element*>(GetConfiguration().get()));
+  auto configuration = static_pointer_cast<Element>(GetConfiguration());
+  if (configuration->_bid != "") {
+    snapshot.AddBaristaId(configuration->_bid);
+  }
+  _writeElement(configuration, update);
+  RenderMultiChildParent::WriteSnapshot(update, snapshot);
 }
 
 void RenderElement::DispatchEvent(const Event& event) {
   assert(dynamic_cast<Element*>(GetConfiguration().get()));
   shared_ptr<Element> config = static_pointer_cast<Element>(GetConfiguration());
   if (config->_bid == event.GetBaristaId()) {
-    for (auto listener : config->_eventListeners) {
-      if (listener._type == event.GetType()) {
-        listener._callback(event);
-      }
-    }
+    _handleEvent(event);
   } else {
     VisitChildren([event](shared_ptr<RenderNode> child) {
       child->DispatchEvent(event);
@@ -146,14 +165,62 @@ void RenderElement::DispatchEvent(const Event& event) {
   }
 }
 
+bool RenderElement::DispatchEventAtPath(const Event& event, size_t depth) {
+  if (depth < event.GetPath().size() && RenderMultiChildParent::DispatchEventAtPath(event, depth)) {
+    return true;
+  }
+  // The target, or an ancestor of it, that the event bubbles up to.
+  return _handleEvent(event);
+}
+
+bool RenderElement::_handleEvent(const Event& event) {
+  assert(dynamic_cast<Element*>(GetConfiguration().get()));
+  shared_ptr<Element> config = static_pointer_cast<Element>(GetConfiguration());
+  for (auto listener : config->_eventListeners) {
+    if (listener._type == event.GetType()) {
+      listener._callback(event);
+    }
+  }
+  return !config->_eventListeners.empty();
+}
+
+void RenderElement::Recycle() {
+  assert(dynamic_cast<Element*>(GetConfiguration().get()));
+  int tagAtom = static_pointer_cast<Element>(GetConfiguration())->_tagAtom;
+  RenderMultiChildParent::Recycle();
+  ResetForReuse();
+  GetTree()->GetRenderNodePool().Release(tagAtom, shared_from_this());
+}
+
+shared_ptr<RenderNode> Text::Instantiate(shared_ptr<Tree> tree) {
+  return make_shared<RenderText>(tree);
+}
+
+void RenderText::Update(shared_ptr<Node> configPtr, ElementUpdate& update) {
+  assert(dynamic_cast<Text*>(configPtr.get()) != nullptr);
+  shared_ptr<Text> newConfiguration = static_pointer_cast<Text>(configPtr);
+  shared_ptr<Text> oldConfiguration = static_pointer_cast<Text>(GetConfiguration());
+
+  if (oldConfiguration == nullptr) {
+    update.SetNodeValue(newConfiguration->GetValue());
+  } else if (oldConfiguration->GetValue() != newConfiguration->GetValue()) {
+    update.SetNodeValue(newConfiguration->GetValue());
+    GetTree()->GetCurrentFrameStats().RecordTextChange();
+  }
+
+  RenderNode::Update(configPtr, update);
+}
+
+void RenderText::WriteSnapshot(ElementUpdate& update, TreeSnapshot& snapshot) {
+  update.SetNodeValue(static_pointer_cast<Text>(GetConfiguration())->GetValue());
+}
+
 shared_ptr<Element> El(string tag) {
   return make_shared<Element>(tag);
 }
 
-shared_ptr<Element> Tx(string value) {
-  auto span = make_shared<Element>("span");
-  span->SetText(value);
-  return span;
+shared_ptr<Text> Tx(string value) {
+  return make_shared<Text>(value);
 }
 
 } // namespace barista
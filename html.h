@@ -21,7 +21,7 @@ typedef function<void(const Event&)> EventListener;
 
 class Element : public MultiChildNode, public enable_shared_from_this<Element> {
  public:
-  Element(string tag) : MultiChildNode(), _tag(tag) {}
+  Element(string tag) : MultiChildNode(), _tag(tag), _tagAtom(_internTag(tag)) { SetKindTag(_tagAtom); }
   shared_ptr<RenderNode> Instantiate(shared_ptr<Tree> tree);
   string GetTag() { return _tag; }
   map<string, string>::iterator GetAttributes() { return _attributes.begin(); };
@@ -55,9 +55,15 @@ class Element : public MultiChildNode, public enable_shared_from_this<Element> {
     friend class RenderElement;
   };
 
+  // Returns a small number unique to [tag].
+  static int _internTag(const string& tag);
+
   // HTML tag, e.g. "div", "button".
   string _tag;
 
+  // [_tag] interned, so that kinds are compared without comparing strings.
+  int _tagAtom;
+
   // HTML attributes, e.g. "id".
   map<string, string> _attributes;
 
@@ -69,7 +75,8 @@ class Element : public MultiChildNode, public enable_shared_from_this<Element> {
 
   // Barista ID.
   //
-  // Used to uniquely identify this element when dispatching events.
+  // Used to uniquely identify this element when dispatching events. Not set
+  // when the tree uses path-addressed events.
   string _bid = "";
 
   // HTML event listeners, e.g. a click listener.
@@ -81,22 +88,63 @@ class Element : public MultiChildNode, public enable_shared_from_this<Element> {
 class RenderElement : public RenderMultiChildParent {
  public:
   RenderElement(shared_ptr<Tree> tree) : RenderMultiChildParent(tree) {}
-  virtual bool CanUpdateUsing(shared_ptr<Node> newConfiguration);
   virtual void Update(shared_ptr<Node> newConfiguration, ElementUpdate& update);
   virtual void DispatchEvent(const Event& event);
+  virtual bool DispatchEventAtPath(const Event& event, size_t depth);
+  virtual void WriteSnapshot(ElementUpdate& update, TreeSnapshot& snapshot);
+
+  /// Releases this node into the tree's [RenderNodePool] under its tag.
+  virtual void Recycle();
 
   static void DangerouslyResetBaristaIdCounterForTesting() { _bidCounter = 1; }
+
+  /// The barista ID counter. Saved and restored by session recording so that
+  /// replayed sessions assign the same IDs.
+  static int64_t GetNextBaristaId() { return _bidCounter; }
+  static void SetNextBaristaId(int64_t bid) { _bidCounter = bid; }
  private:
   // Monotonically increasing element ID counter.
   static int64_t _bidCounter;
   static int64_t NextBid() {
     return _bidCounter++;
   }
+
+  // Calls the listeners for [event], if this element has any.
+  bool _handleEvent(const Event& event);
+
+  // Writes [configuration] into [update] as a new element.
+  void _writeElement(shared_ptr<Element> configuration, ElementUpdate& update);
+
+  // Hands out IDs from the counter, see [Tree::NextBaristaId].
+  friend class Tree;
+};
+
+/// A DOM text node.
+///
+/// Much lighter than an [Element]: it has no attributes, classes, listeners
+/// or children, and changes to it are sent as a single text-only patch op.
+class Text : public Node {
+ public:
+  Text(string value) : Node(), _value(value) {}
+  shared_ptr<RenderNode> Instantiate(shared_ptr<Tree> tree);
+  const string& GetValue() { return _value; }
+
+ private:
+  string _value;
+};
+
+class RenderText : public RenderNode {
+ public:
+  RenderText(shared_ptr<Tree> tree) : RenderNode(tree) {}
+  virtual void Update(shared_ptr<Node> newConfiguration, ElementUpdate& update);
+  virtual void VisitChildren(RenderNodeVisitor visitor) { }
+  virtual void DispatchEvent(const Event& event) { }
+  virtual void WriteSnapshot(ElementUpdate& update, TreeSnapshot& snapshot);
 };
 
 // A little boilerplate-reducing DSL
 shared_ptr<Element> El(string tag);
-shared_ptr<Element> Tx(string value);
+shared_ptr<Text> Tx(string value);
 
 }
 
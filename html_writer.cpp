@@ -0,0 +1,185 @@
+#include "html_writer.h"
+
+#include <cassert>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// AVX2 code is compiled for its own functions only, and used if the CPU it
+// runs on supports it.
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define BARISTA_HAS_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace barista {
+
+// Flags of the characters that are escaped in text and attribute values.
+static const unsigned char kTextEscape = 1;
+static const unsigned char kAttributeEscape = 2;
+
+struct EscapeTable {
+  unsigned char flags[256] = {};
+
+  EscapeTable() {
+    for (unsigned char c : {'&', '<', '>'}) {
+      flags[c] = kTextEscape | kAttributeEscape;
+    }
+    flags[(unsigned char) '"'] = kAttributeEscape;
+  }
+};
+
+static const EscapeTable kEscapeTable;
+
+static size_t _findEscapeScalar(const char* data, size_t size, bool isAttribute) {
+  unsigned char mask = isAttribute ? kAttributeEscape : kTextEscape;
+  for (size_t i = 0; i < size; i++) {
+    if (kEscapeTable.flags[(unsigned char) data[i]] & mask) {
+      return i;
+    }
+  }
+  return size;
+}
+
+#if defined(__SSE2__)
+static size_t _findEscapeSse2(const char* data, size_t size, bool isAttribute) {
+  const __m128i ampersand = _mm_set1_epi8('&');
+  const __m128i lessThan = _mm_set1_epi8('<');
+  const __m128i greaterThan = _mm_set1_epi8('>');
+  // Text has no fourth character; matching '&' twice is harmless.
+  const __m128i quote = _mm_set1_epi8(isAttribute ? '"' : '&');
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i*) (data + i));
+    __m128i matches = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, ampersand), _mm_cmpeq_epi8(chunk, lessThan)),
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, greaterThan), _mm_cmpeq_epi8(chunk, quote)));
+    int mask = _mm_movemask_epi8(matches);
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i + _findEscapeScalar(data + i, size - i, isAttribute);
+}
+#endif
+
+#if defined(BARISTA_HAS_AVX2)
+__attribute__((target("avx2")))
+static size_t _findEscapeAvx2(const char* data, size_t size, bool isAttribute) {
+  const __m256i ampersand = _mm256_set1_epi8('&');
+  const __m256i lessThan = _mm256_set1_epi8('<');
+  const __m256i greaterThan = _mm256_set1_epi8('>');
+  const __m256i quote = _mm256_set1_epi8(isAttribute ? '"' : '&');
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    __m256i chunk = _mm256_loadu_si256((const __m256i*) (data + i));
+    __m256i matches = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, ampersand), _mm256_cmpeq_epi8(chunk, lessThan)),
+        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, greaterThan), _mm256_cmpeq_epi8(chunk, quote)));
+    unsigned mask = (unsigned) _mm256_movemask_epi8(matches);
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  // The rest is scanned here too, rather than by the SSE2 scanner, so that
+  // AVX and SSE instructions are not mixed.
+  if (i + 16 <= size) {
+    __m128i chunk = _mm_loadu_si128((const __m128i*) (data + i));
+    __m128i matches = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm256_castsi256_si128(ampersand)),
+                     _mm_cmpeq_epi8(chunk, _mm256_castsi256_si128(lessThan))),
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm256_castsi256_si128(greaterThan)),
+                     _mm_cmpeq_epi8(chunk, _mm256_castsi256_si128(quote))));
+    int mask = _mm_movemask_epi8(matches);
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+    i += 16;
+  }
+  return i + _findEscapeScalar(data + i, size - i, isAttribute);
+}
+#endif
+
+bool IsHtmlScannerSupported(HtmlScanner scanner) {
+  switch (scanner) {
+    case kScalarHtmlScanner:
+      return true;
+    case kSse2HtmlScanner:
+#if defined(__SSE2__)
+      return true;
+#else
+      return false;
+#endif
+    case kAvx2HtmlScanner:
+#if defined(BARISTA_HAS_AVX2)
+      return __builtin_cpu_supports("avx2");
+#else
+      return false;
+#endif
+  }
+  return false;
+}
+
+HtmlScanner GetBestHtmlScanner() {
+  if (IsHtmlScannerSupported(kAvx2HtmlScanner)) {
+    return kAvx2HtmlScanner;
+  }
+  if (IsHtmlScannerSupported(kSse2HtmlScanner)) {
+    return kSse2HtmlScanner;
+  }
+  return kScalarHtmlScanner;
+}
+
+static HtmlScanner& _currentScanner() {
+  static HtmlScanner scanner = GetBestHtmlScanner();
+  return scanner;
+}
+
+void UseHtmlScanner(HtmlScanner scanner) {
+  assert(IsHtmlScannerSupported(scanner));
+  _currentScanner() = scanner;
+}
+
+size_t FindHtmlEscape(const char* data, size_t size, bool isAttribute) {
+  // Most strings are short; setting up vector registers for them costs more
+  // than it saves.
+  if (size < 16) {
+    return _findEscapeScalar(data, size, isAttribute);
+  }
+  switch (_currentScanner()) {
+#if defined(BARISTA_HAS_AVX2)
+    case kAvx2HtmlScanner:
+      if (size >= 64) {
+        return _findEscapeAvx2(data, size, isAttribute);
+      }
+      return _findEscapeSse2(data, size, isAttribute);
+#endif
+#if defined(__SSE2__)
+    case kSse2HtmlScanner:
+      return _findEscapeSse2(data, size, isAttribute);
+#endif
+    default:
+      return _findEscapeScalar(data, size, isAttribute);
+  }
+}
+
+void HtmlWriter::_writeEscaped(const char* data, size_t size, bool isAttribute) {
+  while (size > 0) {
+    size_t escape = FindHtmlEscape(data, size, isAttribute);
+    _html.append(data, escape);
+    if (escape == size) {
+      return;
+    }
+    switch (data[escape]) {
+      case '&': _html.append("&amp;"); break;
+      case '<': _html.append("&lt;"); break;
+      case '>': _html.append("&gt;"); break;
+      case '"': _html.append("&quot;"); break;
+    }
+    data += escape + 1;
+    size -= escape + 1;
+  }
+}
+
+}  // namespace barista
@@ -0,0 +1,72 @@
+#ifndef BARISTA2_HTML_WRITER_H
+#define BARISTA2_HTML_WRITER_H
+
+#include <cstddef>
+#include <string>
+
+using namespace std;
+
+namespace barista {
+
+/// Ways of finding the characters that need escaping, see [HtmlWriter].
+enum HtmlScanner {
+  kScalarHtmlScanner,
+  // 16 bytes at a time. Available on all x86-64 CPUs.
+  kSse2HtmlScanner,
+  // 32 bytes at a time, on x86-64 CPUs that support AVX2.
+  kAvx2HtmlScanner,
+};
+
+/// The fastest scanner the CPU supports.
+HtmlScanner GetBestHtmlScanner();
+
+/// Whether the CPU, and the compiler that built this, support [scanner].
+bool IsHtmlScannerSupported(HtmlScanner scanner);
+
+/// Makes [HtmlWriter]s use [scanner], which must be supported, instead of
+/// the best one. For tests and benchmarks; not thread-safe.
+void UseHtmlScanner(HtmlScanner scanner);
+
+/// Returns the index of the first of the [size] characters at [data] that
+/// needs escaping in text ('&', '<' and '>') or, if [isAttribute], in a
+/// double-quoted attribute value (also '"'). Returns [size] if there is
+/// none.
+size_t FindHtmlEscape(const char* data, size_t size, bool isAttribute);
+
+/// Writes markup into a buffer that keeps its memory across [Clear]s, so
+/// that a writer reused for every frame stops allocating once it has seen
+/// the biggest one.
+///
+/// Text and attribute values are escaped. Since most contain nothing that
+/// needs escaping, they are scanned for such characters with SIMD
+/// instructions where available and copied in one go.
+class HtmlWriter {
+ public:
+  /// Writes [markup] as is.
+  void Write(const string& markup) { _html.append(markup); }
+  void Write(const char* markup, size_t size) { _html.append(markup, size); }
+  template<size_t N> void Write(const char (&markup)[N]) { _html.append(markup, N - 1); }
+  void Write(char c) { _html.push_back(c); }
+
+  /// Writes [text] as the contents of an element.
+  void WriteText(const string& text) { _writeEscaped(text.data(), text.size(), false); }
+
+  /// Writes [value] as the value of a double-quoted attribute.
+  void WriteAttributeValue(const string& value) { _writeEscaped(value.data(), value.size(), true); }
+
+  const string& GetHtml() const { return _html; }
+  size_t GetSize() const { return _html.size(); }
+  bool IsEmpty() const { return _html.empty(); }
+
+  /// Empties the buffer, keeping its memory.
+  void Clear() { _html.clear(); }
+
+ private:
+  void _writeEscaped(const char* data, size_t size, bool isAttribute);
+
+  string _html;
+};
+
+}  // namespace barista
+
+#endif //BARISTA2_HTML_WRITER_H
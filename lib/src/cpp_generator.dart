@@ -2,7 +2,12 @@ import 'package:meta/meta.dart';
 import 'generator.dart';
 
 class CodeEmitter {
-  CodeEmitter();
+  /// Whether element subtrees are emitted as [ElementTemplate]s, so that
+  /// `Build()` only evaluates bindings instead of rebuilding static
+  /// structure with `El()`.
+  final bool useTemplates;
+
+  CodeEmitter({this.useTemplates: false});
 
   Map<String, String> render(App app) {
     return {
@@ -22,6 +27,7 @@ shared_ptr<Tree> tree;
 // This is intentionally static so that the string is not
 // destroyed after it is returned to the JS side.
 string lastDiff;
+string lastFrameStats;
 
 extern "C" {
 
@@ -30,6 +36,11 @@ const char* RenderFrame() {
   return lastDiff.c_str();
 }
 
+const char* GetLastFrameStats() {
+  lastFrameStats = tree->GetLastFrameStats().ToJson();
+  return lastFrameStats.c_str();
+}
+
 void DispatchEvent(char* type, char* baristaId, char* data) {
   auto event = Event(type, baristaId, data);
   tree->DispatchEvent(event);
@@ -52,9 +63,15 @@ int main() {
   String _widgetCode(App app) {
     var code = new StringBuffer();
     code.writeln(header);
+    if (useTemplates) {
+      code.writeln('#include "element_template.h"');
+      code.writeln();
+    }
+    code.writeln('const bool kGiantAppUsesTemplates = ${useTemplates};');
+    code.writeln();
 
     for (Widget widget in app.widgets) {
-      code.writeln(new _WidgetCodeEmitter(widget)
+      code.writeln(new _WidgetCodeEmitter(widget, useTemplates: useTemplates)
           .render());
     }
 
@@ -132,9 +149,15 @@ class _TemplateNodeGenerator {
 
   StringBuffer buf;
   int localVariableCounter = 1;
+  int templateCounter = 1;
   bool forStatefulWidget;
+  bool useTemplates;
 
-  _TemplateNodeGenerator({@required this.template, @required this.forStatefulWidget});
+  _TemplateNodeGenerator({
+    @required this.template,
+    @required this.forStatefulWidget,
+    @required this.useTemplates,
+  });
 
   void write(String s) {
     buf.write('    $s');
@@ -147,6 +170,7 @@ class _TemplateNodeGenerator {
   String render() {
     buf = new StringBuffer();
     localVariableCounter = 1;
+    templateCounter = 1;
     var childVariableName = _renderChild(template, parent: null);
     buf.writeln('return ${childVariableName};');
     return buf.toString();
@@ -154,20 +178,36 @@ class _TemplateNodeGenerator {
 
   String nextVariableName() => 'child${localVariableCounter++}';
 
-  String _renderChild(TemplateNode node, {@required String parent}) {
+  String nextTemplateName() => 'template${templateCounter++}';
+
+  /// Renders [node] and adds it to [parent], or to children slot [slot] of
+  /// [parent] if [parent] is a template instance.
+  String _renderChild(TemplateNode node, {@required String parent, int slot}) {
     if (node is ElementNode) {
-      return _renderElementNode(node, parent);
+      return useTemplates
+          ? _renderElementTemplate(node, parent, slot)
+          : _renderElementNode(node, parent);
     } else if (node is WidgetNode) {
-      return _renderWidgetNode(node, parent);
+      return _renderWidgetNode(node, parent, slot);
     } else if (node is ContentNode) {
-      return _renderContentNode(parent);
+      return _renderContentNode(parent, slot);
     } else if (node is ToggleButtonNode) {
-      return _renderToggleButtonNode(node, parent);
+      return useTemplates
+          ? _renderToggleButtonTemplate(node, parent, slot)
+          : _renderToggleButtonNode(node, parent);
     } else {
       throw 'oops';
     }
   }
 
+  void _writeAddChild(String parent, int slot, String child) {
+    if (slot == null) {
+      writeln('${parent}->AddChild(${child});');
+    } else {
+      writeln('${parent}->AddChild(${slot}, ${child});');
+    }
+  }
+
   String _renderToggleButtonNode(ToggleButtonNode node, String parent) {
     var variableName = nextVariableName();
     writeln('auto ${variableName} = El("button");');
@@ -183,6 +223,58 @@ class _TemplateNodeGenerator {
     return variableName;
   }
 
+  String _renderToggleButtonTemplate(ToggleButtonNode node, String parent, int slot) {
+    var templateName = nextTemplateName();
+    writeln('static shared_ptr<ElementTemplate> ${templateName} = ElementTemplate::Compile(');
+    writeln('    TemplateElement("button").SetText("${node.text}").ListenerSlot(0, "click"));');
+    var variableName = nextVariableName();
+    writeln('auto ${variableName} = make_shared<TemplateNode>(${templateName});');
+    writeln('${variableName}->SetKey("${node.key}");');
+    writeln('''
+      ${variableName}->AddEventListener(0, [&](const Event& _) {
+        ${node.controls.variable.name} = !${node.controls.variable.name};
+        ScheduleUpdate();
+      });
+    '''.trim());
+    _writeAddChild(parent, slot, variableName);
+    return variableName;
+  }
+
+  /// Emits [node] and its unconditional element descendants as one template
+  /// instance. Only the bindings are evaluated per build; everything else is
+  /// compiled into the template once.
+  String _renderElementTemplate(ElementNode node, String parent, int slot) {
+    if (node.conditional != null) {
+      var expression = toCppExpression(node.conditional, forStatefulWidget: forStatefulWidget);
+      writeln('if (${expression}) {');
+    }
+    var descriptor = new _TemplateDescriptor(node);
+    var templateName = nextTemplateName();
+    writeln('static shared_ptr<ElementTemplate> ${templateName} = ElementTemplate::Compile(');
+    writeln('    ${descriptor.declaration});');
+    var variableName = nextVariableName();
+    writeln('auto ${variableName} = make_shared<TemplateNode>(${templateName});');
+    writeln('${variableName}->SetKey("${node.key}");');
+    descriptor.attributeSlots.forEach((int attributeSlot, Attribute attr) {
+      var expression = toCppExpression(attr.binding, forStatefulWidget: forStatefulWidget);
+      writeln('${variableName}->SetAttribute(${attributeSlot}, ${expression});');
+    });
+    if (parent != null) {
+      _writeAddChild(parent, slot, variableName);
+    }
+
+    descriptor.childrenSlots.forEach((int childrenSlot, List<TemplateNode> children) {
+      for (var child in children) {
+        _renderChild(child, parent: variableName, slot: childrenSlot);
+      }
+    });
+
+    if (node.conditional != null) {
+      writeln('}');
+    }
+    return variableName;
+  }
+
   String _renderElementNode(ElementNode node, String parent) {
     if (node.conditional != null) {
       var expression = toCppExpression(node.conditional, forStatefulWidget: forStatefulWidget);
@@ -216,7 +308,7 @@ class _TemplateNodeGenerator {
     return variableName;
   }
 
-  String _renderWidgetNode(WidgetNode node, String parent) {
+  String _renderWidgetNode(WidgetNode node, String parent, int slot) {
     if (node.conditional != null) {
       var expression = toCppExpression(node.conditional, forStatefulWidget: forStatefulWidget);
       writeln('if (${expression}) {');
@@ -233,7 +325,7 @@ class _TemplateNodeGenerator {
       writeln('${variableName}->AddChild(Tx("${node.text}"));');
     }
     if (parent != null) {
-      writeln('${parent}->AddChild(${variableName});');
+      _writeAddChild(parent, slot, variableName);
     }
 
     for (var child in node.children) {
@@ -251,7 +343,7 @@ class _TemplateNodeGenerator {
 
   bool _debugIsContentNodeRendered = false;
 
-  String _renderContentNode(String parent) {
+  String _renderContentNode(String parent, int slot) {
     if (parent == null) {
       throw 'Content node must have a parent';
     }
@@ -260,15 +352,68 @@ class _TemplateNodeGenerator {
     }
     _debugIsContentNodeRendered = true;
     if (forStatefulWidget) {
-      writeln('${parent}->AddChild(config->GetContent());');
+      _writeAddChild(parent, slot, 'config->GetContent()');
     } else {
-      writeln('${parent}->AddChild(content);');
+      _writeAddChild(parent, slot, 'content');
     }
 
     return null;
   }
 }
 
+/// The static structure of an element subtree, as a C++ `TemplateElement`
+/// expression, and the slots its bindings are evaluated into.
+///
+/// Unconditional element children become part of the template. An element
+/// with any other child gets a children slot holding all of its children.
+class _TemplateDescriptor {
+  String declaration;
+
+  /// Attribute bindings, by slot.
+  final Map<int, Attribute> attributeSlots = <int, Attribute>{};
+
+  /// Children of children slots, by slot.
+  final Map<int, List<TemplateNode>> childrenSlots = <int, List<TemplateNode>>{};
+
+  int _slotCount = 0;
+
+  _TemplateDescriptor(ElementNode root) {
+    declaration = _declare(root);
+  }
+
+  static bool _isStatic(TemplateNode node) => node is ElementNode && node.conditional == null;
+
+  String _declare(ElementNode node) {
+    var buf = new StringBuffer('TemplateElement("${node.tag}")');
+    for (Attribute attr in node.attrs) {
+      if (attr.binding is Literal) {
+        var value = toCppExpression(attr.binding, forStatefulWidget: false);
+        buf.write('.SetAttribute("${attr.name}", ${value})');
+      } else {
+        var slot = _slotCount++;
+        attributeSlots[slot] = attr;
+        buf.write('.AttributeSlot(${slot}, "${attr.name}")');
+      }
+    }
+    for (String clazz in node.classes) {
+      buf.write('.AddClassName("${clazz}")');
+    }
+    if (node.text != null) {
+      buf.write('.SetText("${node.text}")');
+    }
+    if (node.children.every(_isStatic)) {
+      for (ElementNode child in node.children) {
+        buf.write('.AddChild(${_declare(child)})');
+      }
+    } else {
+      var slot = _slotCount++;
+      childrenSlots[slot] = node.children;
+      buf.write('.ChildrenSlot(${slot})');
+    }
+    return buf.toString();
+  }
+}
+
 String capitalize(String s) {
   return s[0].toUpperCase() + s.substring(1);
 }
@@ -294,8 +439,9 @@ String toCppExpression(Binding b, {@required bool forStatefulWidget}) {
 
 class _WidgetCodeEmitter {
   final Widget widget;
+  final bool useTemplates;
 
-  _WidgetCodeEmitter(this.widget);
+  _WidgetCodeEmitter(this.widget, {@required this.useTemplates});
 
   ComponentMetadata get metadata => widget.metadata;
 
@@ -317,8 +463,11 @@ class _WidgetCodeEmitter {
       attrs: [],
       conditional: null,
     );
-    buf.writeln('    ' + new _TemplateNodeGenerator(template: wrappedTemplate, forStatefulWidget: widget.isStateful)
-        .render());
+    buf.writeln('    ' + new _TemplateNodeGenerator(
+        template: wrappedTemplate,
+        forStatefulWidget: widget.isStateful,
+        useTemplates: useTemplates,
+    ).render());
     return buf.toString();
   }
 
@@ -355,6 +504,25 @@ class _WidgetCodeEmitter {
     return buf.toString();
   }
 
+  /// The state only reads its inputs from the widget, so it need not be
+  /// rebuilt when its parent passes the same ones again.
+  String _generateShouldRebuild() {
+    var inputs = metadata.inputs.map((i) => i.name).toList();
+    if (widget.hasContent) {
+      inputs.add('content');
+    }
+    var changed = inputs.isEmpty
+        ? 'false'
+        : inputs.map((name) => 'config->${name} != old->${name}').join(' ||\n        ');
+    return '''
+  virtual bool ShouldRebuild(shared_ptr<StatefulWidget> oldConfig) {
+    auto config = static_pointer_cast<${metadata.name}>(GetConfig());
+    auto old = static_pointer_cast<${metadata.name}>(oldConfig);
+    return ${changed};
+  }
+''';
+  }
+
   String _renderStatefulComponent() {
     return '''
 class ${metadata.name} : public StatefulWidget {
@@ -373,6 +541,7 @@ class ${metadata.name}State : public State {
 ${_renderTemplate()}
   }
 
+${_generateShouldRebuild()}
 ${_generateStateFields()}
 };
 
@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "dom.h"
+#include "server.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace barista;
+
+// Drives a daemon (see daemon.cpp) with clicks on random elements from
+// several connections at once and reports throughput and event latency,
+// i.e. the time from sending an event to receiving the first frame that
+// reflects it.
+//
+// Each connection keeps up to --pipeline events in flight and applies the
+// frames it receives to a [Dom], from which it picks its next targets.
+//
+// Usage: load_gen <socket path> [--connections N] [--events N] [--pipeline N]
+
+class LoadResults {
+ public:
+  void Add(const vector<double>& latencies, int64_t frames, int64_t bytes) {
+    lock_guard<mutex> lock(_mutex);
+    _latencies.insert(_latencies.end(), latencies.begin(), latencies.end());
+    _frames += frames;
+    _bytes += bytes;
+  }
+
+  void Print(double seconds) {
+    sort(_latencies.begin(), _latencies.end());
+    double sum = 0;
+    for (double latency : _latencies) {
+      sum += latency;
+    }
+    cout << _latencies.size() << " events, " << _frames << " frames in " << seconds << "s" << endl;
+    cout << "  throughput: " << _latencies.size() / seconds << " events/s, " << _frames / seconds
+         << " frames/s" << endl;
+    cout << "  frames    : " << (_frames > 0 ? _bytes / _frames : 0) << " bytes on average" << endl;
+    if (_latencies.empty()) {
+      return;
+    }
+    cout << "  latency   : mean " << sum / _latencies.size() << "ms, p50 " << _percentile(0.5)
+         << "ms, p90 " << _percentile(0.9) << "ms, p99 " << _percentile(0.99) << "ms, max "
+         << _latencies.back() << "ms" << endl;
+  }
+
+ private:
+  double _percentile(double fraction) {
+    return _latencies[(size_t) ((_latencies.size() - 1) * fraction)];
+  }
+
+  mutex _mutex;
+  vector<double> _latencies;
+  int64_t _frames = 0;
+  int64_t _bytes = 0;
+};
+
+int Connect(const string& socketPath) {
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (sockaddr*) &address, sizeof(address)) != 0) {
+    return -1;
+  }
+  return fd;
+}
+
+// Picks an element with a barista ID or, when events are addressed by
+// path and no element has one, any element.
+string PickTarget(Dom& dom, mt19937& random) {
+  auto bids = dom.GetBaristaIds();
+  if (!bids.empty()) {
+    return bids[random() % bids.size()];
+  }
+  vector<shared_ptr<DomNode>> elements;
+  vector<shared_ptr<DomNode>> stack = {dom.GetRoot()};
+  while (!stack.empty()) {
+    auto node = stack.back();
+    stack.pop_back();
+    if (node->GetNodeType() == kDomElement) {
+      elements.push_back(node);
+      for (auto& child : node->GetChildNodes()) {
+        stack.push_back(child);
+      }
+    }
+  }
+  return dom.GetEventTarget(elements[random() % elements.size()]);
+}
+
+// Applies the next frame to [dom]. Returns `false` at the end of the stream.
+bool ReceiveFrame(int fd, Dom& dom, int64_t& eventsDispatched, int64_t& bytes) {
+  string message;
+  string frame;
+  if (!ReadMessage(fd, message) || !DecodeFrameMessage(message, eventsDispatched, frame)) {
+    return false;
+  }
+  bytes += frame.size();
+  dom.ApplyFrame(frame);
+  return true;
+}
+
+void RunConnection(const string& socketPath, int connection, int events, int pipeline, LoadResults& results) {
+  int fd = Connect(socketPath);
+  if (fd < 0) {
+    cerr << "Cannot connect to " << socketPath << ": " << strerror(errno) << endl;
+    return;
+  }
+  mt19937 random(connection);
+  Dom dom;
+  vector<steady_clock::time_point> sentAt;
+  vector<double> latencies;
+  int64_t frames = 0;
+  int64_t bytes = 0;
+  int64_t acknowledged = 0;
+  if (!ReceiveFrame(fd, dom, acknowledged, bytes)) {
+    cerr << "Connection " << connection << " closed before the first frame" << endl;
+    close(fd);
+    return;
+  }
+  frames++;
+  while (acknowledged < events) {
+    while ((int64_t) sentAt.size() < events && (int64_t) sentAt.size() - acknowledged < pipeline) {
+      WriteMessage(fd, EncodeEventMessage("click", PickTarget(dom, random), "{}"));
+      sentAt.push_back(steady_clock::now());
+    }
+    int64_t eventsDispatched = 0;
+    if (!ReceiveFrame(fd, dom, eventsDispatched, bytes)) {
+      cerr << "Connection " << connection << " closed early" << endl;
+      break;
+    }
+    frames++;
+    auto now = steady_clock::now();
+    for (; acknowledged < eventsDispatched; acknowledged++) {
+      duration<double> latency = now - sentAt[acknowledged];
+      latencies.push_back(latency.count() * 1000);
+    }
+  }
+  shutdown(fd, SHUT_WR);
+  close(fd);
+  results.Add(latencies, frames, bytes);
+}
+
+int main(int argc, char** argv) {
+  int connections = 4;
+  int events = 1000;
+  int pipeline = 8;
+  for (int i = 2; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--connections") == 0) {
+      connections = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "--events") == 0) {
+      events = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "--pipeline") == 0) {
+      pipeline = atoi(argv[i + 1]);
+    } else {
+      argc = 0;
+    }
+  }
+  if (argc < 2 || argc % 2 != 0 || connections < 1 || events < 0 || pipeline < 1) {
+    cerr << "Usage: load_gen <socket path> [--connections N] [--events N] [--pipeline N]" << endl;
+    return 2;
+  }
+
+  LoadResults results;
+  auto start = steady_clock::now();
+  vector<thread> threads;
+  for (int connection = 1; connection <= connections; connection++) {
+    threads.push_back(thread(RunConnection, string(argv[1]), connection, events, pipeline, ref(results)));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  duration<double> elapsed = steady_clock::now() - start;
+  results.Print(elapsed.count());
+  return 0;
+}
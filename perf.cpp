@@ -0,0 +1,131 @@
+#include "perf.h"
+#include "lib/json/src/json.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+namespace barista {
+
+namespace {
+
+const char* _phaseNames[kPhaseCount] = {
+    "idle",
+    "build",
+    "diff",
+    "serialize",
+};
+
+bool _allocationHookInstalled = false;
+
+// Plain arrays rather than [AllocationCounter] so that updating them from
+// inside `operator new` never runs a constructor.
+thread_local int64_t _allocationCounts[kPhaseCount];
+thread_local int64_t _allocationBytes[kPhaseCount];
+thread_local FramePhase _currentPhase = kPhaseIdle;
+
+}  // namespace
+
+AllocationCounter PhaseAllocations::GetTotal() const {
+  AllocationCounter total;
+  for (int i = 0; i < kPhaseCount; i++) {
+    total = total + _phases[i];
+  }
+  return total;
+}
+
+string PhaseAllocations::ToString() const {
+  stringstream buf;
+  for (int i = kPhaseBuild; i < kPhaseCount; i++) {
+    if (i > kPhaseBuild) {
+      buf << ", ";
+    }
+    buf << _phaseNames[i] << ": " << _phases[i].GetCount() << " allocs/"
+        << _phases[i].GetBytes() << " bytes";
+  }
+  return buf.str();
+}
+
+PhaseAllocations PhaseAllocations::operator-(const PhaseAllocations& other) const {
+  PhaseAllocations delta;
+  for (int i = 0; i < kPhaseCount; i++) {
+    delta._phases[i] = _phases[i] - other._phases[i];
+  }
+  return delta;
+}
+
+string FrameStats::ToJson() const {
+  nlohmann::json js;
+  js["nodesVisited"] = _nodesVisited;
+  js["statelessBuilds"] = _statelessBuilds;
+  js["statefulBuilds"] = _statefulBuilds;
+  js["statesCreated"] = _statesCreated;
+  js["elementsInserted"] = _elementsInserted;
+  js["elementsMoved"] = _elementsMoved;
+  js["elementsRemoved"] = _elementsRemoved;
+  js["elementsKeptAlive"] = _elementsKeptAlive;
+  js["elementsRestored"] = _elementsRestored;
+  js["keptAliveEvicted"] = _keptAliveEvicted;
+  js["attributesChanged"] = _attributesChanged;
+  js["classListsChanged"] = _classListsChanged;
+  js["textsChanged"] = _textsChanged;
+  js["listDiffs"] = _listDiffs;
+  js["lisInputTotal"] = _lisInputTotal;
+  js["lisInputMax"] = _lisInputMax;
+  js["bytesEmitted"] = _bytesEmitted;
+  js["urgentUpdates"] = _updatesRendered[kUrgentUpdate];
+  js["backgroundUpdates"] = _updatesRendered[kBackgroundUpdate];
+  js["backgroundUpdatesDeferred"] = _backgroundUpdatesDeferred;
+  return js.dump();
+}
+
+void UpdateLatencyStats::Record(int64_t micros, int64_t framesDeferred) {
+  _count++;
+  _totalMicros += micros;
+  _maxMicros = max(_maxMicros, micros);
+  _maxFramesDeferred = max(_maxFramesDeferred, framesDeferred);
+}
+
+string UpdateLatencyStats::ToJson() const {
+  nlohmann::json js;
+  js["count"] = _count;
+  js["meanMicros"] = GetMeanMicros();
+  js["maxMicros"] = _maxMicros;
+  js["maxFramesDeferred"] = _maxFramesDeferred;
+  return js.dump();
+}
+
+void RecordAllocation(size_t size) {
+  _allocationCounts[_currentPhase]++;
+  _allocationBytes[_currentPhase] += size;
+}
+
+bool MarkAllocationHookInstalled() {
+  _allocationHookInstalled = true;
+  return true;
+}
+
+bool IsAllocationHookInstalled() {
+  return _allocationHookInstalled;
+}
+
+PhaseAllocations GetThreadAllocations() {
+  PhaseAllocations allocations;
+  for (int i = 0; i < kPhaseCount; i++) {
+    allocations._phases[i] = AllocationCounter(_allocationCounts[i], _allocationBytes[i]);
+  }
+  return allocations;
+}
+
+FramePhase GetCurrentPhase() {
+  return _currentPhase;
+}
+
+PhaseScope::PhaseScope(FramePhase phase) : _previous(_currentPhase) {
+  _currentPhase = phase;
+}
+
+PhaseScope::~PhaseScope() {
+  _currentPhase = _previous;
+}
+
+}  // namespace barista
@@ -0,0 +1,242 @@
+#ifndef BARISTA2_PERF_H
+#define BARISTA2_PERF_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+namespace barista {
+
+/// Phases of a frame that heap allocations are attributed to.
+enum FramePhase {
+  // Outside of a frame, e.g. event dispatch.
+  kPhaseIdle = 0,
+  // Inside `StatelessWidget::Build`, `StatefulWidget::CreateState` and
+  // `State::Build`.
+  kPhaseBuild,
+  // Reconciliation of render nodes and production of the patch tree.
+  kPhaseDiff,
+  // Serialization of the patch tree into JSON/HTML.
+  kPhaseSerialize,
+  kPhaseCount,
+};
+
+/// Lanes of [State::ScheduleUpdate], by how soon the update must show up in
+/// a frame.
+enum UpdatePriority {
+  // Feedback to input the user is waiting on, e.g. a keystroke echoed in a
+  // text field. Rendered by the next frame.
+  kUrgentUpdate = 0,
+  // Work the user is not waiting on, e.g. refreshing a large table.
+  // Rendered by a frame that has budget left for it (see
+  // [Tree::SetBackgroundBudget]), which may be a later one.
+  kBackgroundUpdate,
+  kUpdatePriorityCount,
+};
+
+/// Number and total size of heap allocations.
+class AllocationCounter {
+ public:
+  AllocationCounter() { }
+  AllocationCounter(int64_t count, int64_t bytes) : _count(count), _bytes(bytes) { }
+
+  int64_t GetCount() const { return _count; }
+  int64_t GetBytes() const { return _bytes; }
+
+  AllocationCounter operator-(const AllocationCounter& other) const {
+    return AllocationCounter(_count - other._count, _bytes - other._bytes);
+  }
+
+  AllocationCounter operator+(const AllocationCounter& other) const {
+    return AllocationCounter(_count + other._count, _bytes + other._bytes);
+  }
+
+ private:
+  int64_t _count = 0;
+  int64_t _bytes = 0;
+};
+
+/// Allocations broken down by [FramePhase].
+class PhaseAllocations {
+ public:
+  AllocationCounter Get(FramePhase phase) const { return _phases[phase]; }
+  AllocationCounter GetTotal() const;
+  string ToString() const;
+
+  PhaseAllocations operator-(const PhaseAllocations& other) const;
+
+ private:
+  AllocationCounter _phases[kPhaseCount];
+
+  friend PhaseAllocations GetThreadAllocations();
+};
+
+/// Counters describing the work done by a single frame.
+///
+/// Cheap enough to collect on every frame in production, so dashboards can
+/// catch accidental full rebuilds without a profiler.
+class FrameStats {
+ public:
+  int64_t GetNodesVisited() const { return _nodesVisited; }
+  int64_t GetStatelessBuilds() const { return _statelessBuilds; }
+  int64_t GetStatefulBuilds() const { return _statefulBuilds; }
+  int64_t GetStatesCreated() const { return _statesCreated; }
+  int64_t GetElementsInserted() const { return _elementsInserted; }
+  int64_t GetElementsMoved() const { return _elementsMoved; }
+  int64_t GetElementsRemoved() const { return _elementsRemoved; }
+  int64_t GetElementsKeptAlive() const { return _elementsKeptAlive; }
+  int64_t GetElementsRestored() const { return _elementsRestored; }
+  int64_t GetKeptAliveEvicted() const { return _keptAliveEvicted; }
+  int64_t GetAttributesChanged() const { return _attributesChanged; }
+  int64_t GetClassListsChanged() const { return _classListsChanged; }
+  int64_t GetTextsChanged() const { return _textsChanged; }
+  int64_t GetListDiffs() const { return _listDiffs; }
+  int64_t GetLisInputTotal() const { return _lisInputTotal; }
+  int64_t GetLisInputMax() const { return _lisInputMax; }
+  int64_t GetBytesEmitted() const { return _bytesEmitted; }
+  int64_t GetUpdatesRendered(UpdatePriority priority) const { return _updatesRendered[priority]; }
+  int64_t GetBackgroundUpdatesDeferred() const { return _backgroundUpdatesDeferred; }
+
+  void RecordNodeVisit() { _nodesVisited++; }
+  void RecordStatelessBuild() { _statelessBuilds++; }
+  void RecordStatefulBuild() { _statefulBuilds++; }
+  void RecordStateCreated() { _statesCreated++; }
+  void RecordInsert() { _elementsInserted++; }
+  void RecordMove() { _elementsMoved++; }
+  void RecordRemove() { _elementsRemoved++; }
+  void RecordKeepAlive() { _elementsKeptAlive++; }
+  void RecordRestore() { _elementsRestored++; }
+  void RecordKeepAliveEviction() { _keptAliveEvicted++; }
+  void RecordAttributeChange() { _attributesChanged++; }
+  void RecordClassListChange() { _classListsChanged++; }
+  void RecordTextChange() { _textsChanged++; }
+  void RecordListDiff(int64_t lisInputSize) {
+    _listDiffs++;
+    _lisInputTotal += lisInputSize;
+    if (lisInputSize > _lisInputMax) {
+      _lisInputMax = lisInputSize;
+    }
+  }
+  void RecordBytesEmitted(int64_t bytes) { _bytesEmitted += bytes; }
+  void RecordUpdateRendered(UpdatePriority priority) { _updatesRendered[priority]++; }
+  void RecordBackgroundUpdatesDeferred(int64_t count) { _backgroundUpdatesDeferred += count; }
+
+  /// Renders the counters as a flat JSON object.
+  string ToJson() const;
+
+ private:
+  // Render nodes whose `Update` was called.
+  int64_t _nodesVisited = 0;
+
+  // `Build` calls, by widget kind.
+  int64_t _statelessBuilds = 0;
+  int64_t _statefulBuilds = 0;
+
+  // `CreateState` calls.
+  int64_t _statesCreated = 0;
+
+  // Child list patch operations.
+  int64_t _elementsInserted = 0;
+  int64_t _elementsMoved = 0;
+  int64_t _elementsRemoved = 0;
+
+  // Children taken out of the DOM but kept for later by a [KeepAlive], put
+  // back, and dropped for good.
+  int64_t _elementsKeptAlive = 0;
+  int64_t _elementsRestored = 0;
+  int64_t _keptAliveEvicted = 0;
+
+  // Changes to elements that already existed in the DOM.
+  int64_t _attributesChanged = 0;
+  int64_t _classListsChanged = 0;
+  int64_t _textsChanged = 0;
+
+  // Child lists that were diffed, and the sizes of the sequences fed into
+  // the longest increasing subsequence computation.
+  int64_t _listDiffs = 0;
+  int64_t _lisInputTotal = 0;
+  int64_t _lisInputMax = 0;
+
+  // Size of the serialized frame.
+  int64_t _bytesEmitted = 0;
+
+  // Scheduled updates this frame rendered, by lane, and background updates
+  // it left for later frames.
+  int64_t _updatesRendered[kUpdatePriorityCount] = {};
+  int64_t _backgroundUpdatesDeferred = 0;
+};
+
+/// Latencies of the updates scheduled in one [UpdatePriority] lane, from
+/// the first [State::ScheduleUpdate] until the end of the frame that
+/// rendered the update.
+class UpdateLatencyStats {
+ public:
+  /// Records an update that took [micros] and waited [framesDeferred] frames
+  /// past the first one it could have been rendered in.
+  void Record(int64_t micros, int64_t framesDeferred);
+
+  int64_t GetCount() const { return _count; }
+  int64_t GetTotalMicros() const { return _totalMicros; }
+  int64_t GetMaxMicros() const { return _maxMicros; }
+  double GetMeanMicros() const { return _count > 0 ? (double) _totalMicros / _count : 0; }
+  int64_t GetMaxFramesDeferred() const { return _maxFramesDeferred; }
+
+  void Clear() { *this = UpdateLatencyStats(); }
+
+  /// Renders the counters as a flat JSON object.
+  string ToJson() const;
+
+ private:
+  int64_t _count = 0;
+  int64_t _totalMicros = 0;
+  int64_t _maxMicros = 0;
+  int64_t _maxFramesDeferred = 0;
+};
+
+/// Called by the allocation hook (see alloc_hook.cpp) on every `operator new`.
+///
+/// Must not allocate.
+void RecordAllocation(size_t size);
+
+/// Called once by the allocation hook when it is linked into the binary.
+bool MarkAllocationHookInstalled();
+
+/// Whether allocations are being counted, i.e. whether the binary was linked
+/// with the allocation hook. Production targets are not.
+bool IsAllocationHookInstalled();
+
+/// Cumulative allocations made by the current thread since it started.
+PhaseAllocations GetThreadAllocations();
+
+FramePhase GetCurrentPhase();
+
+/// Attributes allocations made by the current thread to [phase] for the
+/// lifetime of this object, then restores the previous phase.
+class PhaseScope {
+ public:
+  PhaseScope(FramePhase phase);
+  ~PhaseScope();
+
+ private:
+  FramePhase _previous;
+
+  PhaseScope(const PhaseScope&) = delete;
+  PhaseScope& operator=(const PhaseScope&) = delete;
+};
+
+/// Measures allocations made by the current thread between construction and
+/// [GetAllocations].
+class AllocationScope {
+ public:
+  AllocationScope() : _start(GetThreadAllocations()) { }
+  PhaseAllocations GetAllocations() const { return GetThreadAllocations() - _start; }
+
+ private:
+  PhaseAllocations _start;
+};
+
+}  // namespace barista
+
+#endif //BARISTA2_PERF_H
@@ -0,0 +1,337 @@
+#include "record.h"
+#include "api.h"
+#include "common.h"
+#include "html.h"
+#include "trace.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace barista {
+
+namespace {
+
+const string _magic = "BRS2";
+const string _magicWithoutEncoding = "BRS1";
+
+// Bits of the encoding field of a session log.
+const uint64_t _encodingStringTable = 1;
+const uint64_t _encodingPathAddressedEvents = 2;
+const string _snapshotMagic = "BTS1";
+
+const char* _base64Alphabet =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+void _writeVarint(string& out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back((char) (value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((char) value);
+}
+
+void _writeString(string& out, const string& value) {
+  _writeVarint(out, value.size());
+  out.append(value);
+}
+
+void _writeFixed64(string& out, uint64_t value) {
+  for (int i = 0; i < 8; i++) {
+    out.push_back((char) (value >> (8 * i)));
+  }
+}
+
+class _Reader {
+ public:
+  _Reader(const string& bytes) : _bytes(bytes) { }
+
+  bool IsAtEnd() { return _offset == _bytes.size(); }
+
+  bool ReadVarint(uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (IsAtEnd()) {
+        return false;
+      }
+      uint8_t byte = (uint8_t) _bytes[_offset++];
+      value |= (uint64_t) (byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool ReadString(string& value) {
+    uint64_t size;
+    if (!ReadVarint(size) || size > _bytes.size() - _offset) {
+      return false;
+    }
+    value = _bytes.substr(_offset, size);
+    _offset += size;
+    return true;
+  }
+
+  bool ReadFixed64(uint64_t& value) {
+    if (_bytes.size() - _offset < 8) {
+      return false;
+    }
+    value = 0;
+    for (int i = 0; i < 8; i++) {
+      value |= (uint64_t) (uint8_t) _bytes[_offset++] << (8 * i);
+    }
+    return true;
+  }
+
+  bool ReadMagic(const string& magic) {
+    if (_bytes.compare(0, magic.size(), magic) != 0) {
+      return false;
+    }
+    _offset += magic.size();
+    return true;
+  }
+
+  bool ReadBytes(size_t size, string& value) {
+    if (size > _bytes.size() - _offset) {
+      return false;
+    }
+    value = _bytes.substr(_offset, size);
+    _offset += size;
+    return true;
+  }
+
+ private:
+  const string& _bytes;
+  size_t _offset = 0;
+};
+
+}  // namespace
+
+string SessionLog::Serialize() const {
+  string out = _magic;
+  _writeVarint(out, _seed);
+  _writeVarint(out, (uint64_t) _firstBaristaId);
+  _writeVarint(out, (_usesStringTable ? _encodingStringTable : 0) |
+                    (_usesPathAddressedEvents ? _encodingPathAddressedEvents : 0));
+  int64_t previousTime = 0;
+  for (auto& entry : _entries) {
+    out.push_back((char) entry.GetKind());
+    // Times never decrease, so deltas keep them short.
+    _writeVarint(out, (uint64_t) (entry.GetTimeMicros() - previousTime));
+    previousTime = entry.GetTimeMicros();
+    if (entry.GetKind() == kSessionEvent) {
+      _writeString(out, entry.GetType());
+      _writeString(out, entry.GetBaristaId());
+      _writeString(out, entry.GetData());
+    } else {
+      _writeVarint(out, (uint64_t) entry.GetIndent());
+      _writeVarint(out, (uint64_t) entry.GetDurationMicros());
+      _writeVarint(out, (uint64_t) entry.GetOutputBytes());
+      _writeFixed64(out, entry.GetOutputHash());
+    }
+  }
+  return out;
+}
+
+bool SessionLog::Parse(const string& bytes, SessionLog& log) {
+  _Reader reader(bytes);
+  uint64_t seed, firstBaristaId, encoding = 0;
+  bool hasEncoding = reader.ReadMagic(_magic);
+  if (!hasEncoding && !reader.ReadMagic(_magicWithoutEncoding)) {
+    return false;
+  }
+  if (!reader.ReadVarint(seed) || !reader.ReadVarint(firstBaristaId) ||
+      (hasEncoding && !reader.ReadVarint(encoding))) {
+    return false;
+  }
+  log = SessionLog((uint32_t) seed, (int64_t) firstBaristaId);
+  log.SetEncoding((encoding & _encodingStringTable) != 0, (encoding & _encodingPathAddressedEvents) != 0);
+
+  int64_t time = 0;
+  while (!reader.IsAtEnd()) {
+    // The kind is written as a single byte, which is also a valid varint.
+    uint64_t kindValue, delta;
+    if (!reader.ReadVarint(kindValue) || !reader.ReadVarint(delta)) {
+      return false;
+    }
+    time += (int64_t) delta;
+    if (kindValue == kSessionEvent) {
+      string type, baristaId, data;
+      if (!reader.ReadString(type) || !reader.ReadString(baristaId) || !reader.ReadString(data)) {
+        return false;
+      }
+      log.Append(SessionEntry(time, type, baristaId, data));
+    } else if (kindValue == kSessionFrame) {
+      uint64_t indent, duration, outputBytes, hash;
+      if (!reader.ReadVarint(indent) || !reader.ReadVarint(duration) ||
+          !reader.ReadVarint(outputBytes) || !reader.ReadFixed64(hash)) {
+        return false;
+      }
+      log.Append(SessionEntry(time, (int) indent, (int64_t) duration, (int64_t) outputBytes, hash));
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+string TreeSnapshot::Serialize() const {
+  string out = _snapshotMagic;
+  _writeFixed64(out, _frame.size());
+  out.append(_frame);
+  _writeVarint(out, (uint64_t) _nextBaristaId);
+  _writeVarint(out, _baristaIds.size());
+  for (auto& bid : _baristaIds) {
+    // IDs are numbers, see [RenderElement::NextBid].
+    _writeVarint(out, strtoull(bid.c_str(), nullptr, 10));
+  }
+  _writeVarint(out, _states.size());
+  for (auto& state : _states) {
+    _writeString(out, state.typeName);
+    out.push_back(state.isSaved ? 1 : 0);
+    if (state.isSaved) {
+      _writeString(out, state.data);
+    }
+  }
+  return out;
+}
+
+bool TreeSnapshot::Parse(const string& bytes, TreeSnapshot& snapshot) {
+  _Reader reader(bytes);
+  uint64_t frameSize, nextBaristaId, bidCount, stateCount;
+  snapshot = TreeSnapshot();
+  if (!reader.ReadMagic(_snapshotMagic) || !reader.ReadFixed64(frameSize) ||
+      !reader.ReadBytes(frameSize, snapshot._frame) || !reader.ReadVarint(nextBaristaId) ||
+      !reader.ReadVarint(bidCount)) {
+    return false;
+  }
+  snapshot._nextBaristaId = (int64_t) nextBaristaId;
+  for (uint64_t i = 0; i < bidCount; i++) {
+    uint64_t bid;
+    if (!reader.ReadVarint(bid)) {
+      return false;
+    }
+    snapshot._baristaIds.push_back(to_string(bid));
+  }
+  if (!reader.ReadVarint(stateCount)) {
+    return false;
+  }
+  for (uint64_t i = 0; i < stateCount; i++) {
+    string typeName, data;
+    uint64_t isSaved;
+    if (!reader.ReadString(typeName) || !reader.ReadVarint(isSaved) || (isSaved && !reader.ReadString(data))) {
+      return false;
+    }
+    snapshot.AddState(typeName, isSaved != 0, data);
+  }
+  return reader.IsAtEnd();
+}
+
+void SessionLog::RestoreInitialConditions() const {
+  srand(_seed);
+  RenderElement::SetNextBaristaId(_firstBaristaId);
+}
+
+SessionRecorder::SessionRecorder(uint32_t seed)
+    : _log(seed, RenderElement::GetNextBaristaId()),
+      _startMicros(TraceRecorder::NowMicros()) {
+  srand(seed);
+}
+
+void SessionRecorder::RecordEvent(const string& type, const string& baristaId, const string& data) {
+  _log.Append(SessionEntry(TraceRecorder::NowMicros() - _startMicros, type, baristaId, data));
+}
+
+void SessionRecorder::RecordFrame(int indent, int64_t durationMicros, const string& output) {
+  _log.Append(SessionEntry(
+      TraceRecorder::NowMicros() - _startMicros,
+      indent,
+      durationMicros,
+      (int64_t) output.size(),
+      HashFrameOutput(output)
+  ));
+}
+
+ReplayedFrame::ReplayedFrame(const SessionEntry& recorded, int64_t durationMicros, const string& output)
+    : _recorded(recorded),
+      _durationMicros(durationMicros),
+      _outputBytes((int64_t) output.size()),
+      _outputHash(HashFrameOutput(output)) { }
+
+vector<ReplayedFrame> ReplaySession(const SessionLog& log, shared_ptr<Node> app) {
+  log.RestoreInitialConditions();
+  auto tree = make_shared<Tree>(app);
+  if (log.UsesStringTable()) {
+    tree->UseStringTable();
+  }
+  if (log.UsesPathAddressedEvents()) {
+    tree->UsePathAddressedEvents();
+  }
+  vector<ReplayedFrame> frames;
+  for (auto& entry : log.GetEntries()) {
+    if (entry.GetKind() == kSessionEvent) {
+      tree->DispatchEvent(Event(entry.GetType(), entry.GetBaristaId(), entry.GetData()));
+    } else {
+      int64_t start = TraceRecorder::NowMicros();
+      string output = tree->RenderFrame(entry.GetIndent());
+      frames.push_back(ReplayedFrame(entry, TraceRecorder::NowMicros() - start, output));
+    }
+  }
+  return frames;
+}
+
+uint64_t HashFrameOutput(const string& output) {
+  uint64_t hash = kFnv1aOffsetBasis;
+  for (char c : output) {
+    hash = Fnv1aUpdate(hash, c);
+  }
+  return hash;
+}
+
+string EncodeBase64(const string& bytes) {
+  string text;
+  text.reserve((bytes.size() + 2) / 3 * 4);
+  size_t i = 0;
+  for (; i + 2 < bytes.size(); i += 3) {
+    uint32_t chunk = (uint8_t) bytes[i] << 16 | (uint8_t) bytes[i + 1] << 8 | (uint8_t) bytes[i + 2];
+    text.push_back(_base64Alphabet[(chunk >> 18) & 63]);
+    text.push_back(_base64Alphabet[(chunk >> 12) & 63]);
+    text.push_back(_base64Alphabet[(chunk >> 6) & 63]);
+    text.push_back(_base64Alphabet[chunk & 63]);
+  }
+  if (i < bytes.size()) {
+    uint32_t chunk = (uint8_t) bytes[i] << 16;
+    if (i + 1 < bytes.size()) {
+      chunk |= (uint8_t) bytes[i + 1] << 8;
+    }
+    text.push_back(_base64Alphabet[(chunk >> 18) & 63]);
+    text.push_back(_base64Alphabet[(chunk >> 12) & 63]);
+    text.push_back(i + 1 < bytes.size() ? _base64Alphabet[(chunk >> 6) & 63] : '=');
+    text.push_back('=');
+  }
+  return text;
+}
+
+bool DecodeBase64(const string& text, string& bytes) {
+  bytes.clear();
+  uint32_t chunk = 0;
+  int bits = 0;
+  for (char c : text) {
+    if (c == '=' || c == '\n' || c == '\r') {
+      continue;
+    }
+    const char* position = strchr(_base64Alphabet, c);
+    if (c == '\0' || position == nullptr) {
+      return false;
+    }
+    chunk = chunk << 6 | (uint32_t) (position - _base64Alphabet);
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      bytes.push_back((char) (chunk >> bits));
+    }
+  }
+  return true;
+}
+
+}  // namespace barista
@@ -0,0 +1,233 @@
+#ifndef BARISTA2_RECORD_H
+#define BARISTA2_RECORD_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace barista {
+
+class Node;
+
+enum SessionEntryKind {
+  kSessionEvent = 1,
+  kSessionFrame = 2,
+};
+
+/// An event dispatched into, or a frame rendered by, a recorded [Tree].
+class SessionEntry {
+ public:
+  /// An event.
+  SessionEntry(int64_t timeMicros, string type, string baristaId, string data)
+      : _kind(kSessionEvent), _timeMicros(timeMicros), _type(type), _baristaId(baristaId),
+        _data(data) { }
+
+  /// A frame.
+  SessionEntry(int64_t timeMicros, int indent, int64_t durationMicros, int64_t outputBytes,
+               uint64_t outputHash)
+      : _kind(kSessionFrame), _timeMicros(timeMicros), _indent(indent),
+        _durationMicros(durationMicros), _outputBytes(outputBytes), _outputHash(outputHash) { }
+
+  SessionEntryKind GetKind() const { return _kind; }
+
+  /// Time since the start of the recording.
+  int64_t GetTimeMicros() const { return _timeMicros; }
+
+  const string& GetType() const { return _type; }
+  const string& GetBaristaId() const { return _baristaId; }
+  const string& GetData() const { return _data; }
+
+  int GetIndent() const { return _indent; }
+  int64_t GetDurationMicros() const { return _durationMicros; }
+  int64_t GetOutputBytes() const { return _outputBytes; }
+  uint64_t GetOutputHash() const { return _outputHash; }
+
+ private:
+  SessionEntryKind _kind;
+  int64_t _timeMicros;
+
+  // Events
+  string _type = "";
+  string _baristaId = "";
+  string _data = "";
+
+  // Frames
+  int _indent = 0;
+  int64_t _durationMicros = 0;
+  int64_t _outputBytes = 0;
+  uint64_t _outputHash = 0;
+};
+
+/// A recorded session: the initial conditions of the app, followed by the
+/// events and frames in the order they happened.
+///
+/// Serialized as the "BRS2" magic followed by varint-encoded fields. Strings
+/// are length-prefixed, frame output is stored as a length and an FNV-1a hash.
+/// "BRS1" logs, which predate encoding options, are still parsed.
+class SessionLog {
+ public:
+  SessionLog() { }
+  SessionLog(uint32_t seed, int64_t firstBaristaId)
+      : _seed(seed), _firstBaristaId(firstBaristaId) { }
+
+  /// Seed passed to `srand` when the session started.
+  uint32_t GetSeed() const { return _seed; }
+
+  /// Barista ID that the first element created by the session received.
+  int64_t GetFirstBaristaId() const { return _firstBaristaId; }
+
+  /// Whether the recorded tree encoded frames using a [StringTable].
+  bool UsesStringTable() const { return _usesStringTable; }
+
+  /// Whether the recorded tree addressed events by path.
+  bool UsesPathAddressedEvents() const { return _usesPathAddressedEvents; }
+
+  /// Records how the tree encoded its frames, which the replay must match
+  /// to produce the same output.
+  void SetEncoding(bool usesStringTable, bool usesPathAddressedEvents) {
+    _usesStringTable = usesStringTable;
+    _usesPathAddressedEvents = usesPathAddressedEvents;
+  }
+
+  const vector<SessionEntry>& GetEntries() const { return _entries; }
+  void Append(SessionEntry entry) { _entries.push_back(entry); }
+
+  string Serialize() const;
+
+  /// Parses the output of [Serialize] into [log]. Returns `false` if [bytes]
+  /// is not a valid session log.
+  static bool Parse(const string& bytes, SessionLog& log);
+
+  /// Reseeds `rand` and the barista ID counter the way they were when the
+  /// session started. Call before creating the [Tree] that replays it.
+  void RestoreInitialConditions() const;
+
+ private:
+  uint32_t _seed = 0;
+  int64_t _firstBaristaId = 1;
+  bool _usesStringTable = false;
+  bool _usesPathAddressedEvents = false;
+  vector<SessionEntry> _entries;
+};
+
+/// Records events and frames of a [Tree] into a [SessionLog].
+///
+/// See `Tree::StartRecording`.
+class SessionRecorder {
+ public:
+  /// Seeds `rand` with [seed] and captures the barista ID counter.
+  SessionRecorder(uint32_t seed);
+
+  /// See [SessionLog::SetEncoding].
+  void RecordEncoding(bool usesStringTable, bool usesPathAddressedEvents) {
+    _log.SetEncoding(usesStringTable, usesPathAddressedEvents);
+  }
+
+  void RecordEvent(const string& type, const string& baristaId, const string& data);
+  void RecordFrame(int indent, int64_t durationMicros, const string& output);
+
+  const SessionLog& GetLog() const { return _log; }
+
+ private:
+  SessionLog _log;
+  int64_t _startMicros;
+};
+
+/// A [Tree] as of [Tree::TakeSnapshot], from which a new tree can show its
+/// first frame without building anything (see [Tree::RestoreSnapshot]).
+///
+/// Holds the "create" frame that shows the tree, and the barista IDs of
+/// its elements and the data its states saved (see [State::SaveState]), in
+/// the order a fresh build of the same tree assigns and creates them.
+///
+/// Serialized as the "BTS1" magic, the frame's length as a little-endian
+/// 64-bit integer and the frame itself, so that the frame can be served
+/// straight out of a memory-mapped snapshot, followed by varint-encoded
+/// fields.
+class TreeSnapshot {
+ public:
+  /// A state's saved data, along with its type, which a restored state must
+  /// match.
+  class SavedState {
+   public:
+    SavedState(string typeName, bool isSaved, string data)
+        : typeName(typeName), isSaved(isSaved), data(data) { }
+    string typeName;
+    // States that save nothing are listed all the same, so that the others
+    // line up with the states of the restored tree.
+    bool isSaved;
+    string data;
+  };
+
+  const string& GetFrame() const { return _frame; }
+  void SetFrame(string frame) { _frame = frame; }
+
+  /// The barista ID counter when the snapshot was taken.
+  int64_t GetNextBaristaId() const { return _nextBaristaId; }
+  void SetNextBaristaId(int64_t bid) { _nextBaristaId = bid; }
+
+  const vector<string>& GetBaristaIds() const { return _baristaIds; }
+  void AddBaristaId(const string& bid) { _baristaIds.push_back(bid); }
+
+  const vector<SavedState>& GetStates() const { return _states; }
+  void AddState(string typeName, bool isSaved, string data) { _states.push_back(SavedState(typeName, isSaved, data)); }
+
+  string Serialize() const;
+
+  /// Parses the output of [Serialize] into [snapshot]. Returns `false` if
+  /// [bytes] is not a valid snapshot.
+  static bool Parse(const string& bytes, TreeSnapshot& snapshot);
+
+ private:
+  string _frame;
+  int64_t _nextBaristaId = 1;
+  vector<string> _baristaIds;
+  vector<SavedState> _states;
+};
+
+/// Timing and output of a frame re-rendered by [ReplaySession].
+class ReplayedFrame {
+ public:
+  ReplayedFrame(const SessionEntry& recorded, int64_t durationMicros, const string& output);
+
+  /// The frame as it was recorded.
+  const SessionEntry& GetRecorded() const { return _recorded; }
+
+  int64_t GetDurationMicros() const { return _durationMicros; }
+  int64_t GetOutputBytes() const { return _outputBytes; }
+  uint64_t GetOutputHash() const { return _outputHash; }
+
+  /// Whether the replay produced exactly the recorded output.
+  bool Matches() const {
+    return _outputBytes == _recorded.GetOutputBytes() && _outputHash == _recorded.GetOutputHash();
+  }
+
+ private:
+  SessionEntry _recorded;
+  int64_t _durationMicros;
+  int64_t _outputBytes;
+  uint64_t _outputHash;
+};
+
+/// Re-drives a fresh [Tree] rooted at [app] with the events in [log],
+/// rendering a frame wherever one was recorded. The tree encodes frames the
+/// way the recorded one did.
+///
+/// [app] must be the widget the session was recorded with, constructed
+/// without consuming `rand`.
+vector<ReplayedFrame> ReplaySession(const SessionLog& log, shared_ptr<Node> app);
+
+/// 64-bit FNV-1a hash of a frame's output.
+uint64_t HashFrameOutput(const string& output);
+
+/// Base64, for passing session logs through string-only channels such as
+/// emscripten's `cwrap`.
+string EncodeBase64(const string& bytes);
+bool DecodeBase64(const string& text, string& bytes);
+
+}  // namespace barista
+
+#endif //BARISTA2_RECORD_H
@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "api.h"
+#include "record.h"
+#include "sample_widgets.h"
+#include "todo_widgets.h"
+
+using namespace std;
+using namespace barista;
+
+// Replays a session recorded with `Tree::StartRecording` and reports
+// per-frame timings and whether each frame's output matches the recording.
+//
+// Usage: replay <sample|todo> <session file>
+//
+// The session file is either the raw log or its base64 encoding, as
+// returned by `GetSessionRecording()`. Exits with 1 if any frame diverges.
+
+shared_ptr<Node> CreateApp(const string& name) {
+  if (name == "sample") {
+    return make_shared<SampleApp>();
+  }
+  if (name == "todo") {
+    return make_shared<TodoApp>();
+  }
+  return nullptr;
+}
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    cerr << "Usage: replay <sample|todo> <session file>" << endl;
+    return 2;
+  }
+
+  auto app = CreateApp(argv[1]);
+  if (app == nullptr) {
+    cerr << "Unknown app: " << argv[1] << endl;
+    return 2;
+  }
+
+  ifstream file(argv[2], ios::binary);
+  stringstream contents;
+  contents << file.rdbuf();
+  string bytes = contents.str();
+  if (bytes.compare(0, 3, "BRS") != 0) {
+    string decoded;
+    if (DecodeBase64(bytes, decoded)) {
+      bytes = decoded;
+    }
+  }
+
+  SessionLog log;
+  if (!SessionLog::Parse(bytes, log)) {
+    cerr << "Not a session recording: " << argv[2] << endl;
+    return 2;
+  }
+
+  auto frames = ReplaySession(log, app);
+  int mismatches = 0;
+  vector<double> durations;
+  for (size_t i = 0; i < frames.size(); i++) {
+    auto& frame = frames[i];
+    auto& recorded = frame.GetRecorded();
+    durations.push_back(frame.GetDurationMicros() / 1000.0);
+    if (!frame.Matches()) {
+      mismatches++;
+    }
+    cout << "Frame #" << i << " at " << recorded.GetTimeMicros() / 1000.0 << "ms: recorded "
+         << recorded.GetDurationMicros() / 1000.0 << "ms, replayed "
+         << frame.GetDurationMicros() / 1000.0 << "ms; " << frame.GetOutputBytes() << " chars; "
+         << (frame.Matches() ? "output matches" : "OUTPUT DIFFERS") << endl;
+  }
+
+  if (!durations.empty()) {
+    sort(durations.begin(), durations.end());
+    double total = 0;
+    for (double duration : durations) {
+      total += duration;
+    }
+    cout << frames.size() << " frames, " << log.GetEntries().size() - frames.size() << " events; "
+         << "total " << total << "ms, p50 " << durations[durations.size() / 2] << "ms, max "
+         << durations.back() << "ms" << endl;
+  }
+
+  if (mismatches > 0) {
+    cout << mismatches << " frames diverged from the recording" << endl;
+    return 1;
+  }
+  return 0;
+}
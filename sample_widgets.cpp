@@ -0,0 +1 @@
+#include "sample_widgets.h"
@@ -0,0 +1,264 @@
+#include "server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+namespace barista {
+
+// Trees share process-wide state, such as the barista ID counter and the
+// interned tags, so sessions take turns rendering.
+static mutex& _renderMutex() {
+  static mutex* renderMutex = new mutex();
+  return *renderMutex;
+}
+
+static bool _writeAll(int fd, const char* bytes, size_t size) {
+  while (size > 0) {
+    ssize_t written = write(fd, bytes, size);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return false;
+    }
+    bytes += written;
+    size -= written;
+  }
+  return true;
+}
+
+static bool _readAll(int fd, char* bytes, size_t size) {
+  while (size > 0) {
+    ssize_t read = ::read(fd, bytes, size);
+    if (read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (read <= 0) {
+      return false;
+    }
+    bytes += read;
+    size -= read;
+  }
+  return true;
+}
+
+bool WriteMessage(int fd, const string& payload) {
+  char header[4];
+  for (int i = 0; i < 4; i++) {
+    header[i] = (char) (payload.size() >> (8 * i));
+  }
+  return _writeAll(fd, header, 4) && _writeAll(fd, payload.data(), payload.size());
+}
+
+bool ReadMessage(int fd, string& payload) {
+  unsigned char header[4];
+  if (!_readAll(fd, (char*) header, 4)) {
+    return false;
+  }
+  size_t size = 0;
+  for (int i = 0; i < 4; i++) {
+    size |= (size_t) header[i] << (8 * i);
+  }
+  if (size > kMaxMessageSize) {
+    return false;
+  }
+  payload.resize(size);
+  return size == 0 || _readAll(fd, &payload[0], size);
+}
+
+string EncodeEventMessage(const string& type, const string& target, const string& data) {
+  return type + "\n" + target + "\n" + data;
+}
+
+bool DecodeEventMessage(const string& message, string& type, string& target, string& data) {
+  size_t typeEnd = message.find('\n');
+  if (typeEnd == string::npos) {
+    return false;
+  }
+  size_t targetEnd = message.find('\n', typeEnd + 1);
+  if (targetEnd == string::npos) {
+    return false;
+  }
+  type = message.substr(0, typeEnd);
+  target = message.substr(typeEnd + 1, targetEnd - typeEnd - 1);
+  data = message.substr(targetEnd + 1);
+  return true;
+}
+
+string EncodeFrameMessage(int64_t eventsDispatched, const string& frame) {
+  return to_string(eventsDispatched) + "\n" + frame;
+}
+
+bool DecodeFrameMessage(const string& message, int64_t& eventsDispatched, string& frame) {
+  size_t countEnd = message.find('\n');
+  if (countEnd == string::npos || countEnd == 0) {
+    return false;
+  }
+  eventsDispatched = atoll(message.substr(0, countEnd).c_str());
+  frame = message.substr(countEnd + 1);
+  return true;
+}
+
+ThreadPool::ThreadPool(int threadCount) {
+  for (int i = 0; i < threadCount; i++) {
+    _threads.push_back(thread(&ThreadPool::_work, this));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    lock_guard<mutex> lock(_mutex);
+    _isStopping = true;
+  }
+  _tasksAdded.notify_all();
+  for (auto& thread : _threads) {
+    thread.join();
+  }
+}
+
+void ThreadPool::RunAll(const vector<function<void()>>& tasks) {
+  lock_guard<mutex> batch(_batchMutex);
+  unique_lock<mutex> lock(_mutex);
+  _tasks = &tasks;
+  _nextTask = 0;
+  _pendingTasks = tasks.size();
+  _tasksAdded.notify_all();
+  while (_runNext(lock)) { }
+  _tasksDone.wait(lock, [this] { return _pendingTasks == 0; });
+  _tasks = nullptr;
+}
+
+bool ThreadPool::_runNext(unique_lock<mutex>& lock) {
+  if (_tasks == nullptr || _nextTask == _tasks->size()) {
+    return false;
+  }
+  auto& task = (*_tasks)[_nextTask++];
+  lock.unlock();
+  task();
+  lock.lock();
+  if (--_pendingTasks == 0) {
+    _tasksDone.notify_all();
+  }
+  return true;
+}
+
+void ThreadPool::_work() {
+  unique_lock<mutex> lock(_mutex);
+  while (true) {
+    _tasksAdded.wait(lock, [this] { return _isStopping || (_tasks != nullptr && _nextTask < _tasks->size()); });
+    if (_isStopping) {
+      return;
+    }
+    _runNext(lock);
+  }
+}
+
+void RendererSession::Run() {
+  thread reader(&RendererSession::_read, this);
+  thread writer(&RendererSession::_write, this);
+  _render();
+  while (true) {
+    deque<Event> events;
+    // Background updates left by the last frame are rendered by the next one
+    // even if no events come in.
+    bool hasBackgroundUpdates = _tree->HasBackgroundUpdates();
+    {
+      unique_lock<mutex> lock(_mutex);
+      if (!hasBackgroundUpdates) {
+        _eventsReceived.wait(lock, [this] { return !_events.empty() || _inputClosed; });
+        if (_events.empty()) {
+          break;
+        }
+      }
+      events.swap(_events);
+    }
+    {
+      lock_guard<mutex> render(_renderMutex());
+      for (auto& event : events) {
+        _tree->DispatchEvent(event);
+      }
+    }
+    _eventCount += events.size();
+    _render();
+  }
+  {
+    lock_guard<mutex> lock(_mutex);
+    _outputClosed = true;
+  }
+  _framesRendered.notify_one();
+  writer.join();
+  reader.join();
+}
+
+void RendererSession::_render() {
+  string frame;
+  {
+    lock_guard<mutex> render(_renderMutex());
+    frame = EncodeFrameMessage(_eventCount, _tree->RenderFrame());
+  }
+  _frameCount++;
+  {
+    lock_guard<mutex> lock(_mutex);
+    _queuedBytes += frame.size();
+    _maxQueuedBytes = max(_maxQueuedBytes, _queuedBytes);
+    _frames.push_back(move(frame));
+  }
+  _framesRendered.notify_one();
+}
+
+void RendererSession::_read() {
+  string message;
+  string type;
+  string target;
+  string data;
+  while (ReadMessage(_inputFd, message)) {
+    if (!DecodeEventMessage(message, type, target, data)) {
+      cerr << "Dropping malformed event message" << endl;
+      continue;
+    }
+    // Parsed here, off the rendering thread.
+    try {
+      Event event(type, target, data);
+      lock_guard<mutex> lock(_mutex);
+      _events.push_back(move(event));
+    } catch (const nlohmann::json::parse_error& error) {
+      cerr << "Dropping event with malformed data: " << error.what() << endl;
+      continue;
+    }
+    _eventsReceived.notify_one();
+  }
+  {
+    lock_guard<mutex> lock(_mutex);
+    _inputClosed = true;
+  }
+  _eventsReceived.notify_one();
+}
+
+void RendererSession::_write() {
+  bool clientGone = false;
+  while (true) {
+    string frame;
+    {
+      unique_lock<mutex> lock(_mutex);
+      _framesRendered.wait(lock, [this] { return !_frames.empty() || _outputClosed; });
+      if (_frames.empty()) {
+        return;
+      }
+      frame = move(_frames.front());
+      _frames.pop_front();
+      _queuedBytes -= frame.size();
+    }
+    // Frames are still taken off the queue once the client is gone, so that
+    // they do not pile up until it closes its input.
+    if (!clientGone && !WriteMessage(_outputFd, frame)) {
+      clientGone = true;
+    }
+  }
+}
+
+}  // namespace barista
@@ -0,0 +1,130 @@
+#ifndef BARISTA2_SERVER_H
+#define BARISTA2_SERVER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "api.h"
+
+using namespace std;
+
+namespace barista {
+
+/// Writes [payload] to [fd], preceded by its length as a 4-byte
+/// little-endian integer. Returns `false` if [fd] can no longer be written.
+bool WriteMessage(int fd, const string& payload);
+
+/// Messages longer than this are not read, so that a client cannot make the
+/// daemon allocate arbitrary amounts of memory.
+const size_t kMaxMessageSize = 64 << 20;
+
+/// Reads a message written by [WriteMessage] into [payload]. Returns
+/// `false` at the end of the stream, or if the message is longer than
+/// [kMaxMessageSize], after which the stream cannot be read any further.
+bool ReadMessage(int fd, string& payload);
+
+/// An event sent by a client: its type and target (see [Event]) on a line
+/// each, followed by its JSON data.
+string EncodeEventMessage(const string& type, const string& target, const string& data);
+bool DecodeEventMessage(const string& message, string& type, string& target, string& data);
+
+/// A frame sent to a client: the number of events dispatched before it was
+/// rendered on a line, followed by the frame as returned by
+/// [Tree::RenderFrame].
+string EncodeFrameMessage(int64_t eventsDispatched, const string& frame);
+bool DecodeFrameMessage(const string& message, int64_t& eventsDispatched, string& frame);
+
+/// Runs tasks on a fixed set of threads, as well as on the thread that hands
+/// them over.
+class ThreadPool : public TaskRunner {
+ public:
+  /// Starts [threadCount] threads, which wait for tasks until the pool is
+  /// destroyed.
+  ThreadPool(int threadCount);
+  virtual ~ThreadPool();
+
+  /// Runs [tasks], which must not call [RunAll] themselves. Batches handed
+  /// over from several threads run one after another.
+  virtual void RunAll(const vector<function<void()>>& tasks);
+
+  int GetThreadCount() { return (int) _threads.size(); }
+
+ private:
+  void _work();
+
+  // Runs the next task of the current batch, unlocking [lock] meanwhile.
+  // Returns `false` if there is none.
+  bool _runNext(unique_lock<mutex>& lock);
+
+  vector<thread> _threads;
+  mutex _batchMutex;
+  mutex _mutex;
+  condition_variable _tasksAdded;
+  condition_variable _tasksDone;
+
+  // Guarded by _mutex.
+  const vector<function<void()>>* _tasks = nullptr;
+  size_t _nextTask = 0;
+  size_t _pendingTasks = 0;
+  bool _isStopping = false;
+};
+
+/// Hosts a [Tree] for a single client, reading event messages from
+/// [inputFd] and writing frame messages to [outputFd].
+///
+/// The first frame is sent right away. After that, events that arrive
+/// while a frame is being rendered are dispatched together and answered
+/// with one frame, which may be "null". While the tree has background
+/// updates (see [UpdatePriority]), frames are rendered back to back, picking
+/// up whatever events arrived in between. Reading and writing happen on
+/// their own threads, so a client that is slow to read its frames delays
+/// neither event intake nor rendering; frames queue up instead.
+class RendererSession {
+ public:
+  RendererSession(shared_ptr<Tree> tree, int inputFd, int outputFd)
+      : _tree(tree), _inputFd(inputFd), _outputFd(outputFd) { }
+
+  /// Serves the client until it closes its end of [inputFd] and all frames
+  /// are written.
+  void Run();
+
+  int64_t GetEventCount() { return _eventCount; }
+  int64_t GetFrameCount() { return _frameCount; }
+
+  /// Most bytes of frames that were waiting for the client at once.
+  size_t GetMaxQueuedBytes() { return _maxQueuedBytes; }
+
+ private:
+  void _read();
+  void _write();
+  void _render();
+
+  shared_ptr<Tree> _tree;
+  int _inputFd;
+  int _outputFd;
+
+  mutex _mutex;
+  condition_variable _eventsReceived;
+  condition_variable _framesRendered;
+
+  // Guarded by _mutex.
+  deque<Event> _events;
+  bool _inputClosed = false;
+  deque<string> _frames;
+  size_t _queuedBytes = 0;
+  bool _outputClosed = false;
+
+  int64_t _eventCount = 0;
+  int64_t _frameCount = 0;
+  size_t _maxQueuedBytes = 0;
+};
+
+}  // namespace barista
+
+#endif //BARISTA2_SERVER_H
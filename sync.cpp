@@ -7,6 +7,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cctype>
 #include <map>
 #include <memory>
 #include <string>
@@ -18,7 +19,260 @@ using namespace std;
 
 namespace barista {
 
-bool ElementUpdate::Render(nlohmann::json& js) {
+uint64_t HashMarkup(const string& html, vector<string>* baristaIds) {
+  static const string kBaristaIdAttribute = " _bid=\"";
+  uint64_t hash = kFnv1aOffsetBasis;
+  bool inTag = false;
+  bool inValue = false;
+  size_t i = 0;
+  while (i < html.size()) {
+    char c = html[i];
+    if (!inTag) {
+      // Comments, such as text node markers, are not tags.
+      inTag = c == '<' && i + 1 < html.size() && isalpha(html[i + 1]);
+    } else if (inValue) {
+      inValue = c != '"';
+    } else if (c == ' ' && html.compare(i, kBaristaIdAttribute.size(), kBaristaIdAttribute) == 0) {
+      size_t valueStart = i + kBaristaIdAttribute.size();
+      size_t valueEnd = html.find('"', valueStart);
+      if (valueEnd == string::npos) {
+        valueEnd = html.size();
+      }
+      if (baristaIds != nullptr) {
+        baristaIds->push_back(html.substr(valueStart, valueEnd - valueStart));
+      }
+      // The attribute still counts, only its value does not.
+      for (char attributeChar : kBaristaIdAttribute) {
+        hash = Fnv1aUpdate(hash, attributeChar);
+      }
+      i = valueEnd + 1;
+      continue;
+    } else {
+      inValue = c == '"';
+      inTag = c != '>';
+    }
+    hash = Fnv1aUpdate(hash, c);
+    i++;
+  }
+  return hash;
+}
+
+nlohmann::json StringTable::Encode(const string& value) {
+  auto existing = _indices.find(value);
+  if (existing != _indices.end()) {
+    return existing->second;
+  }
+  if (value.size() > kMaxStringLength || _indices.size() >= kMaxSize) {
+    return value;
+  }
+  int index = (int) _indices.size();
+  _indices[value] = index;
+  _newStrings.push_back(value);
+  return index;
+}
+
+vector<string> StringTable::TakeNewStrings() {
+  vector<string> newStrings;
+  newStrings.swap(_newStrings);
+  return newStrings;
+}
+
+vector<size_t> ParallelSerializer::Split(const vector<size_t>& sizes) const {
+  vector<size_t> starts;
+  size_t taskNodes = _minTaskNodes;
+  for (size_t i = 0; i < sizes.size(); i++) {
+    if (taskNodes >= _minTaskNodes) {
+      starts.push_back(i);
+      taskNodes = 0;
+    }
+    taskNodes += sizes[i];
+  }
+  return starts;
+}
+
+void ParallelSerializer::Run(size_t taskCount, function<void(size_t task, HtmlWriter& html)> task) {
+  while (_writers.size() < taskCount) {
+    _writers.emplace_back(new HtmlWriter());
+  }
+  vector<function<void()>> tasks;
+  for (size_t i = 0; i < taskCount; i++) {
+    HtmlWriter* html = _writers[i].get();
+    tasks.push_back([&task, i, html] {
+      html->Clear();
+      task(i, *html);
+    });
+  }
+  if (taskCount == 1) {
+    tasks[0]();
+  } else if (taskCount > 1) {
+    _runner->RunAll(tasks);
+  }
+}
+
+void StringTable::Clear() {
+  _indices.clear();
+  _newStrings.clear();
+}
+
+ElementUpdate& ElementUpdatePool::Acquire(int index) {
+  if (_used == GetCapacity()) {
+    _chunks.push_back(unique_ptr<ElementUpdate[]>(new ElementUpdate[kChunkSize]));
+  }
+  ElementUpdate& update = _chunks[_used / kChunkSize][_used % kChunkSize];
+  _used++;
+  update._reset(this, index);
+  return update;
+}
+
+void ElementUpdatePool::Release(ElementUpdate& update) {
+  if (_used > 0 && &_chunks[(_used - 1) / kChunkSize][(_used - 1) % kChunkSize] == &update) {
+    _used--;
+  }
+}
+
+void ElementUpdate::_reset(ElementUpdatePool* pool, int index) {
+  _pool = pool;
+  _index = index;
+  _movesBefore = 0;
+  _isReplacement = false;
+  _isRestore = false;
+  _restoreKey.clear();
+  _hasHtml = false;
+  _html.Clear();
+  _htmlOffset = 0;
+  _nodeCount = 0;
+  _tag.clear();
+  _key.clear();
+  _bid.clear();
+  _updateText = false;
+  _text.clear();
+  _isTextNode = false;
+  _nodeValue.clear();
+  _removes.clear();
+  _keptAlive.clear();
+  _evictions.clear();
+  _moves.clear();
+  _childElementInsertions.clear();
+  _childElementUpdates.clear();
+  _attributes.clear();
+  _removedAttributes.clear();
+  _classNames.clear();
+}
+
+ElementUpdate& ElementUpdate::InsertChildElement(int insertionIndex) {
+  ElementUpdate& insertion = _pool->Acquire(insertionIndex);
+  insertion._movesBefore = (int) _moves.size();
+  insertion._htmlOffset = _html.GetSize();
+  _childElementInsertions.push_back(&insertion);
+  return insertion;
+}
+
+ElementUpdate& ElementUpdate::RestoreChildElement(int insertionIndex, string key) {
+  ElementUpdate& restore = InsertChildElement(insertionIndex);
+  restore._isRestore = true;
+  restore._restoreKey = key;
+  return restore;
+}
+
+ElementUpdate& ElementUpdate::UpdateChildElement(int index) {
+  ElementUpdate& update = _pool->Acquire(index);
+  _childElementUpdates.push_back(&update);
+  return update;
+}
+
+void ElementUpdate::DiscardChildElementUpdateIfEmpty() {
+  // An empty update has no children of its own, but this element may have
+  // acquired nodes after it, in which case the pool keeps it.
+  if (!_childElementUpdates.empty() && _childElementUpdates.back()->IsEmpty()) {
+    _pool->Release(*_childElementUpdates.back());
+    _childElementUpdates.pop_back();
+  }
+}
+
+static nlohmann::json EncodeString(StringTable* strings, const string& value) {
+  if (strings == nullptr) {
+    return value;
+  }
+  return strings->Encode(value);
+}
+
+size_t ElementUpdate::CountNodes() {
+  _nodeCount = 1;
+  for (ElementUpdate* insertion : _childElementInsertions) {
+    _nodeCount += insertion->CountNodes();
+  }
+  for (ElementUpdate* update : _childElementUpdates) {
+    _nodeCount += update->CountNodes();
+  }
+  return _nodeCount;
+}
+
+nlohmann::json ElementUpdate::_renderInsertion(ElementUpdate& insertion, StringTable* strings, HtmlWriter& html,
+                                               ParallelSerializer* parallel) {
+  auto jsInsertion = nlohmann::json::object();
+  jsInsertion["index"] = insertion._index;
+  if (insertion._movesBefore > 0) {
+    jsInsertion["movesBefore"] = insertion._movesBefore;
+  }
+  if (insertion._isRestore) {
+    // The child is already built; only its changes are sent.
+    jsInsertion["restore"] = insertion._restoreKey;
+    auto jsRestoreUpdate = nlohmann::json::object();
+    if (insertion.Render(jsRestoreUpdate, strings, html, parallel)) {
+      jsInsertion["update"] = jsRestoreUpdate;
+    }
+  } else {
+    html.Clear();
+    insertion.PrintHtml(html);
+    jsInsertion["html"] = html.GetHtml();
+  }
+  return jsInsertion;
+}
+
+void ElementUpdate::_renderChildrenInParallel(ParallelSerializer& parallel, vector<nlohmann::json>& insertions,
+                                              vector<nlohmann::json>& updates) {
+  size_t insertionCount = _childElementInsertions.size();
+  vector<size_t> sizes;
+  for (ElementUpdate* insertion : _childElementInsertions) {
+    sizes.push_back(insertion->_nodeCount);
+  }
+  for (ElementUpdate* update : _childElementUpdates) {
+    sizes.push_back(update->_nodeCount);
+  }
+  insertions.resize(insertionCount);
+  updates.resize(_childElementUpdates.size());
+  auto starts = parallel.Split(sizes);
+  parallel.Run(starts.size(), [&](size_t task, HtmlWriter& html) {
+    size_t end = task + 1 < starts.size() ? starts[task + 1] : sizes.size();
+    for (size_t i = starts[task]; i < end; i++) {
+      if (i < insertionCount) {
+        insertions[i] = _renderInsertion(*_childElementInsertions[i], nullptr, html, nullptr);
+      } else {
+        auto& childUpdate = updates[i - insertionCount];
+        childUpdate = nlohmann::json::object();
+        if (!_childElementUpdates[i - insertionCount]->Render(childUpdate, nullptr, html, nullptr)) {
+          childUpdate = nullptr;
+        }
+      }
+    }
+  });
+}
+
+bool ElementUpdate::Render(nlohmann::json& js, StringTable* strings, HtmlWriter& html, ParallelSerializer* parallel) {
+  if (_isReplacement) {
+    html.Clear();
+    PrintHtml(html);
+    js["replace"] = html.GetHtml();
+    js["index"] = _index;
+    return true;
+  }
+
+  if (_isTextNode) {
+    js["nodeValue"] = EncodeString(strings, _nodeValue);
+    js["index"] = _index;
+    return true;
+  }
+
   bool wroteData = false;
 
   if (_tag != "") {
@@ -32,7 +286,7 @@ bool ElementUpdate::Render(nlohmann::json& js) {
   }
 
   if (_updateText) {
-    js["text"] = _text;
+    js["text"] = EncodeString(strings, _text);
     wroteData = true;
   }
 
@@ -45,6 +299,22 @@ bool ElementUpdate::Render(nlohmann::json& js) {
     wroteData = true;
   }
 
+  if (!_keptAlive.empty()) {
+    // Indices and keys are flattened into one list, like moves.
+    auto jsKeptAlive = nlohmann::json::array();
+    for (auto& keptAlive : _keptAlive) {
+      jsKeptAlive.push_back(get<0>(keptAlive));
+      jsKeptAlive.push_back(get<1>(keptAlive));
+    }
+    js["keepAlive"] = jsKeptAlive;
+    wroteData = true;
+  }
+
+  if (!_evictions.empty()) {
+    js["evict"] = _evictions;
+    wroteData = true;
+  }
+
   if (!_moves.empty()) {
     auto jsMoves = nlohmann::json::array();
     for (Move move : _moves) {
@@ -55,15 +325,33 @@ bool ElementUpdate::Render(nlohmann::json& js) {
     wroteData = true;
   }
 
+  // Children are rendered in parallel where the patch is wide, i.e. where
+  // no child holds most of the nodes; otherwise that child is split.
+  vector<nlohmann::json> renderedInsertions;
+  vector<nlohmann::json> renderedUpdates;
+  bool isParallel = false;
+  if (parallel != nullptr && _nodeCount > 2 * parallel->GetMinTaskNodes()) {
+    size_t largestChild = 0;
+    for (ElementUpdate* insertion : _childElementInsertions) {
+      largestChild = max(largestChild, insertion->_nodeCount);
+    }
+    for (ElementUpdate* update : _childElementUpdates) {
+      largestChild = max(largestChild, update->_nodeCount);
+    }
+    isParallel = largestChild * 2 <= _nodeCount;
+  }
+  if (isParallel) {
+    _renderChildrenInParallel(*parallel, renderedInsertions, renderedUpdates);
+  }
+
   if (!_childElementInsertions.empty()) {
     auto jsInsertions = nlohmann::json::array();
-    for (ElementUpdate& insertion : _childElementInsertions) {
-      auto jsInsertion = nlohmann::json::object();
-      jsInsertion["index"] = insertion._index;
-      stringstream buf;
-      insertion.PrintHtml(buf);
-      jsInsertion["html"] = buf.str();
-      jsInsertions.push_back(jsInsertion);
+    for (size_t i = 0; i < _childElementInsertions.size(); i++) {
+      if (isParallel) {
+        jsInsertions.push_back(move(renderedInsertions[i]));
+      } else {
+        jsInsertions.push_back(_renderInsertion(*_childElementInsertions[i], strings, html, parallel));
+      }
     }
     js["insert"] = jsInsertions;
     wroteData = true;
@@ -71,9 +359,15 @@ bool ElementUpdate::Render(nlohmann::json& js) {
 
   if (!_childElementUpdates.empty()) {
     auto jsUpdates = nlohmann::json::array();
-    for (ElementUpdate& update : _childElementUpdates) {
+    for (size_t i = 0; i < _childElementUpdates.size(); i++) {
+      if (isParallel) {
+        if (!renderedUpdates[i].is_null()) {
+          jsUpdates.push_back(move(renderedUpdates[i]));
+        }
+        continue;
+      }
       auto childUpdate = nlohmann::json::object();
-      if (update.Render(childUpdate)) {
+      if (_childElementUpdates[i]->Render(childUpdate, strings, html, parallel)) {
         jsUpdates.push_back(childUpdate);
       }
     }
@@ -85,18 +379,38 @@ bool ElementUpdate::Render(nlohmann::json& js) {
   }
 
   if (!_attributes.empty()) {
-    auto jsAttrUpdates = nlohmann::json::object();
-    for (tuple<string, string> attrUpdate : _attributes) {
-      jsAttrUpdates[get<0>(attrUpdate)] = get<1>(attrUpdate);
+    if (strings != nullptr) {
+      // Object keys cannot be indices, so names and values are flattened
+      // into one list.
+      auto jsAttrUpdates = nlohmann::json::array();
+      for (tuple<string, string> attrUpdate : _attributes) {
+        jsAttrUpdates.push_back(strings->Encode(get<0>(attrUpdate)));
+        jsAttrUpdates.push_back(strings->Encode(get<1>(attrUpdate)));
+      }
+      js["attrs"] = jsAttrUpdates;
+    } else {
+      auto jsAttrUpdates = nlohmann::json::object();
+      for (tuple<string, string> attrUpdate : _attributes) {
+        jsAttrUpdates[get<0>(attrUpdate)] = get<1>(attrUpdate);
+      }
+      js["attrs"] = jsAttrUpdates;
     }
-    js["attrs"] = jsAttrUpdates;
+    wroteData = true;
+  }
+
+  if (!_removedAttributes.empty()) {
+    auto jsRemovedAttrs = nlohmann::json::array();
+    for (string name : _removedAttributes) {
+      jsRemovedAttrs.push_back(EncodeString(strings, name));
+    }
+    js["removeAttrs"] = jsRemovedAttrs;
     wroteData = true;
   }
 
   if (!_classNames.empty()) {
     auto jsClassNames = nlohmann::json::array();
     for (string className : _classNames) {
-      jsClassNames.push_back(className);
+      jsClassNames.push_back(EncodeString(strings, className));
     }
     js["classes"] = jsClassNames;
     wroteData = true;
@@ -109,48 +423,182 @@ bool ElementUpdate::Render(nlohmann::json& js) {
   return wroteData;
 }
 
-void ElementUpdate::PrintHtml(stringstream &buf) {
+void ElementUpdate::PrintHtml(HtmlWriter& html) {
+  // Children are only kept alive by parents that are already in the DOM.
+  assert(!_isRestore);
+
+  if (_hasHtml) {
+    auto& markup = _html.GetHtml();
+    size_t printed = 0;
+    for (ElementUpdate* insertion : _childElementInsertions) {
+      html.Write(markup.data() + printed, insertion->_htmlOffset - printed);
+      printed = insertion->_htmlOffset;
+      insertion->PrintHtml(html);
+    }
+    html.Write(markup.data() + printed, markup.size() - printed);
+    return;
+  }
+
+  if (_isTextNode) {
+    // Adjacent and empty text nodes do not survive HTML parsing, so each one
+    // is preceded by a marker comment that sync.js replaces with a real text
+    // node.
+    html.Write("<!--t-->");
+    html.WriteText(_nodeValue);
+    return;
+  }
+
+  _printOpenTag(html);
+  for (ElementUpdate* childElement : _childElementInsertions) {
+    childElement->PrintHtml(html);
+  }
+  _printCloseTag(html);
+}
+
+void ElementUpdate::_printOpenTag(HtmlWriter& html) {
   if (_index != -1) {  // we don't print host tag.
-    buf << "<" << _tag;
+    html.Write('<');
+    html.Write(_tag);
 
     if (_key != "") {
-      buf << " _bkey=\"" << _key << "\"";
+      html.Write(" _bkey=\"");
+      html.WriteAttributeValue(_key);
+      html.Write('"');
     }
 
-    if (!_attributes.empty()) {
-      auto first = _attributes.begin();
-      auto last = _attributes.end();
-      for (auto attr = first; attr != last; attr++) {
-        buf << " " << get<0>(*attr) << "=\"" << get<1>(*attr) << "\"";
-      }
+    for (auto& attribute : _attributes) {
+      html.Write(' ');
+      html.Write(get<0>(attribute));
+      html.Write("=\"");
+      html.WriteAttributeValue(get<1>(attribute));
+      html.Write('"');
     }
 
     if (!_classNames.empty()) {
-      buf << " class=\"";
-      for (auto className = _classNames.begin(); className != _classNames.end(); className++) {
-        buf << " " << *className;
+      html.Write(" class=\"");
+      for (auto& className : _classNames) {
+        html.Write(' ');
+        html.WriteAttributeValue(className);
       }
-      buf << "\"";
+      html.Write('"');
     }
 
     if (_bid != "") {
-      buf << " _bid=\"" << _bid << "\"";
+      html.Write(" _bid=\"");
+      html.Write(_bid);
+      html.Write('"');
     }
 
-    buf << ">";
+    html.Write('>');
   }
 
   if (_text != "") {
-    buf << _text;
+    html.WriteText(_text);
   }
+}
 
-  for(auto childElement = _childElementInsertions.begin(); childElement != _childElementInsertions.end(); childElement++) {
-    childElement->PrintHtml(buf);
+void ElementUpdate::_printCloseTag(HtmlWriter& html) {
+  if (_index != -1) {
+    html.Write("</");
+    html.Write(_tag);
+    html.Write('>');
   }
+}
 
-  if (_index != -1) {
-    buf << "</" << _tag << ">";
+void ElementUpdate::_planHtml(size_t minTaskNodes, HtmlWriter& literals, vector<HtmlPart>& parts) {
+  assert(!_isRestore);
+  if (_nodeCount <= minTaskNodes || _childElementInsertions.empty()) {
+    parts.push_back({this, 0, 0});
+    return;
+  }
+
+  // Adds what was written into [literals] since [offset] to the last part
+  // if it is literal too.
+  auto addLiteral = [&literals, &parts](size_t offset) {
+    size_t size = literals.GetSize() - offset;
+    if (size == 0) {
+      return;
+    }
+    if (!parts.empty() && parts.back().subtree == nullptr) {
+      parts.back().size += size;
+    } else {
+      parts.push_back({nullptr, offset, size});
+    }
+  };
+  size_t offset = literals.GetSize();
+  if (_hasHtml) {
+    auto& markup = _html.GetHtml();
+    size_t printed = 0;
+    for (ElementUpdate* insertion : _childElementInsertions) {
+      literals.Write(markup.data() + printed, insertion->_htmlOffset - printed);
+      addLiteral(offset);
+      printed = insertion->_htmlOffset;
+      insertion->_planHtml(minTaskNodes, literals, parts);
+      offset = literals.GetSize();
+    }
+    literals.Write(markup.data() + printed, markup.size() - printed);
+    addLiteral(offset);
+    return;
+  }
+
+  _printOpenTag(literals);
+  addLiteral(offset);
+  for (ElementUpdate* childElement : _childElementInsertions) {
+    childElement->_planHtml(minTaskNodes, literals, parts);
+  }
+  offset = literals.GetSize();
+  _printCloseTag(literals);
+  addLiteral(offset);
+}
+
+string TreeUpdate::_renderCreateInParallel() {
+  _rootUpdate->CountNodes();
+  _html.Clear();
+  _htmlParts.clear();
+  _rootUpdate->_planHtml(_parallel->GetMinTaskNodes(), _html, _htmlParts);
+
+  vector<size_t> sizes;
+  for (auto& part : _htmlParts) {
+    sizes.push_back(part.subtree != nullptr ? part.subtree->_nodeCount : 0);
+  }
+  auto starts = _parallel->Split(sizes);
+  _jsonParts.resize(starts.size());
+  _parallel->Run(starts.size(), [&](size_t task, HtmlWriter& html) {
+    size_t end = task + 1 < starts.size() ? starts[task + 1] : _htmlParts.size();
+    for (size_t i = starts[task]; i < end; i++) {
+      auto& part = _htmlParts[i];
+      if (part.subtree != nullptr) {
+        part.subtree->PrintHtml(html);
+      } else {
+        html.Write(_html.GetHtml().data() + part.offset, part.size);
+      }
+    }
+    // JSON escapes markup character by character, and parts end between
+    // tags, so the parts can be encoded separately.
+    _jsonParts[task] = nlohmann::json(html.GetHtml()).dump();
+  });
+
+  // The same as dumping {"create": markup, "events": ...}.
+  size_t size = 32;
+  for (auto& part : _jsonParts) {
+    size += part.size();
+  }
+  string frame;
+  frame.reserve(size);
+  frame.append("{\"create\":\"");
+  for (auto& part : _jsonParts) {
+    // Without the quotes.
+    frame.append(part, 1, part.size() - 2);
+  }
+  frame.append("\"");
+  if (_pathAddressedEvents) {
+    frame.append(",\"events\":\"path\"");
+  }
+  frame.append("}");
+  if (_strings != nullptr) {
+    _strings->Clear();
   }
+  return frame;
 }
 
 }  // namespace barista
@@ -6,13 +6,18 @@
 #define BARISTA2_SYNC_H_H
 
 #include "common.h"
+#include "html_writer.h"
 #include "lib/json/src/json.hpp"
 
+#include <cstdint>
+#include <functional>
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
 #include <tuple>
 #include <sstream>
+#include <unordered_map>
 
 using namespace std;
 
@@ -31,14 +36,122 @@ private:
   int _moveFromIndex;
 };
 
+/// Hashes markup printed by [ElementUpdate::PrintHtml], leaving out the
+/// values of `_bid` attributes, so that trees of the same app that show the
+/// same thing hash alike even though they number their elements
+/// differently. The values left out are appended to [baristaIds], if given,
+/// in document order.
+uint64_t HashMarkup(const string& html, vector<string>* baristaIds = nullptr);
+
+/// Strings the client has already been sent, kept across frames so that
+/// repeated class names, attributes and text go over the wire once and are
+/// referred to by index afterwards.
+///
+/// Each frame lists the strings it adds under "strings"; the client numbers
+/// them in that order after the ones it already has. A "create" frame
+/// starts a new table.
+class StringTable {
+ public:
+  /// Longer strings, typically user content, are sent as is.
+  static const size_t kMaxStringLength = 64;
+
+  /// Once the table is full, new strings are sent as is.
+  static const size_t kMaxSize = 4096;
+
+  /// Returns the index of [value] in the table, adding it if necessary, or
+  /// [value] itself if it is not interned.
+  nlohmann::json Encode(const string& value);
+
+  /// Strings added since the last call, in index order.
+  vector<string> TakeNewStrings();
+
+  void Clear();
+
+  size_t GetSize() const { return _indices.size(); }
+
+ private:
+  unordered_map<string, int> _indices;
+  vector<string> _newStrings;
+};
+
+/// Runs independent tasks, possibly at the same time, for
+/// [TreeUpdate::SetParallelSerialization].
+class TaskRunner {
+ public:
+  virtual ~TaskRunner() { }
+
+  /// Runs [tasks] and returns once all of them are done.
+  virtual void RunAll(const vector<function<void()>>& tasks) = 0;
+};
+
+class ElementUpdate;
+
+/// Splits the serialization of a [TreeUpdate] into tasks of at least
+/// [minTaskNodes] patch nodes each and runs them on a [TaskRunner].
+class ParallelSerializer {
+ public:
+  ParallelSerializer(TaskRunner* runner, size_t minTaskNodes) : _runner(runner), _minTaskNodes(minTaskNodes) { }
+
+  size_t GetMinTaskNodes() const { return _minTaskNodes; }
+
+  /// Groups consecutive items, [sizes] being their numbers of patch nodes,
+  /// into tasks of at least [GetMinTaskNodes] nodes, except maybe the last,
+  /// and returns the index of the first item of each task.
+  vector<size_t> Split(const vector<size_t>& sizes) const;
+
+  /// Runs [task] for each of [taskCount] tasks, giving each task its own
+  /// scratch buffer, kept across frames.
+  void Run(size_t taskCount, function<void(size_t task, HtmlWriter& html)> task);
+
+ private:
+  TaskRunner* _runner;
+  size_t _minTaskNodes;
+  vector<unique_ptr<HtmlWriter>> _writers;
+};
+
+/// A piece of the markup of a "create" frame that can be printed on its own:
+/// either the markup of [subtree], or, if it is `nullptr`, [size] bytes of
+/// literal markup at [offset].
+class HtmlPart {
+ public:
+  ElementUpdate* subtree;
+  size_t offset;
+  size_t size;
+};
+
+class ElementUpdatePool;
+
+/// A node of a [TreeUpdate].
+///
+/// Nodes are owned by the update's [ElementUpdatePool] and never move, so
+/// references returned by [InsertChildElement] and [UpdateChildElement]
+/// stay valid until the update is reset.
 class ElementUpdate {
 public:
   /// Appends the JSON representation of this update into [buffer].
-  bool Render(nlohmann::json& js);
+  bool Render(nlohmann::json& js) { return Render(js, nullptr); }
+
+  /// Like [Render], but encodes strings using [strings] when it is not
+  /// `nullptr`.
+  bool Render(nlohmann::json& js, StringTable* strings) {
+    HtmlWriter html;
+    return Render(js, strings, html);
+  }
+
+  /// Like [Render], but prints the markup of insertions using [html], which
+  /// is only used as a scratch buffer, and renders the children of nodes
+  /// with enough descendants using [parallel] when it is not `nullptr`.
+  ///
+  /// [CountNodes] must have been called if [parallel] is given.
+  bool Render(nlohmann::json& js, StringTable* strings, HtmlWriter& html, ParallelSerializer* parallel = nullptr);
+
+  /// Counts the nodes of this update and of each of its descendants, for
+  /// [ParallelSerializer]. Returns the count of this update.
+  size_t CountNodes();
 
   /// Assumes that this element update is exlusively made of insertions and
-  /// renders it as a plain HTML into the given [buffer].
-  void PrintHtml(stringstream &buffer);
+  /// renders it as a plain HTML into the given [html] writer.
+  void PrintHtml(HtmlWriter& html);
 
   void RemoveChild(int index) { _removes.push_back(index); }
 
@@ -46,22 +159,66 @@ public:
     _moves.push_back({insertionIndex, moveFrom});
   }
 
-  ElementUpdate& InsertChildElement(int insertionIndex) {
-    _childElementInsertions.push_back(ElementUpdate(insertionIndex));
-    return _childElementInsertions.back();
+  ElementUpdate& InsertChildElement(int insertionIndex);
+
+  /// Takes the child at [index] out of the DOM like [RemoveChild], but has
+  /// the client keep it under [key] so it can be put back with
+  /// [RestoreChildElement].
+  void KeepChildAlive(int index, string key) { _keptAlive.push_back({index, key}); }
+
+  /// Puts the child kept alive under [key] back at [insertionIndex]. The
+  /// returned update holds the changes the child went through since then.
+  ElementUpdate& RestoreChildElement(int insertionIndex, string key);
+
+  /// Has the client drop the child kept alive under [key].
+  void EvictKeptAliveChild(string key) { _evictions.push_back(key); }
+
+  ElementUpdate& UpdateChildElement(int index);
+
+  /// Drops the update last returned by [UpdateChildElement] if nothing was
+  /// written into it.
+  ///
+  /// Call once the child is updated. Most children of a dirty parent do not
+  /// change, and this keeps them from holding on to a patch node, so the
+  /// slot is reused by the next child.
+  void DiscardChildElementUpdateIfEmpty();
+
+  /// Whether this update carries no changes.
+  bool IsEmpty() const {
+    return !_isReplacement && !_hasHtml && _tag.empty() && _bid.empty() && !_updateText && !_isTextNode && _removes.empty() &&
+        _keptAlive.empty() && _evictions.empty() && _moves.empty() && _childElementInsertions.empty() && _childElementUpdates.empty() &&
+        _attributes.empty() && _removedAttributes.empty() && _classNames.empty();
   }
 
-  ElementUpdate& UpdateChildElement(int index) {
-    _childElementUpdates.push_back(ElementUpdate(index));
-    return _childElementUpdates.back();
+  /// Returns the writer of this update's literal markup.
+  ///
+  /// An update with markup is printed as that markup rather than as an
+  /// element made of its tag, attributes and children. Children inserted
+  /// into it are spliced in where the markup ended when they were inserted.
+  HtmlWriter& AppendHtml() {
+    _hasHtml = true;
+    return _html;
   }
 
+  /// Marks this update as replacing the DOM node at its index with a new
+  /// node, which is then written into this update as if it were inserted.
+  void Replace() { _isReplacement = true; }
+
   void SetTag(string tag) { _tag = tag; }
   void SetKey(string key) { _key = key; }
   void SetText(string text) { _text = text; _updateText = true; }
+
+  /// Marks this update as targeting a DOM text node and sets its value.
+  void SetNodeValue(string value) {
+    _nodeValue = value;
+    _isTextNode = true;
+  }
   void SetAttribute(string name, string value) {
     _attributes.push_back({name, value});
   }
+  void RemoveAttribute(string name) {
+    _removedAttributes.push_back(name);
+  }
   void SetBaristaId(string bid) {
     _bid = bid;
   }
@@ -70,11 +227,51 @@ public:
   }
 
 private:
-  ElementUpdate(int index) : _index(index) { };
+  ElementUpdate() { };
+
+  /// Clears this node for reuse, keeping the capacity of its vectors.
+  void _reset(ElementUpdatePool* pool, int index);
+
+  nlohmann::json _renderInsertion(ElementUpdate& insertion, StringTable* strings, HtmlWriter& html,
+                                  ParallelSerializer* parallel);
+
+  // Renders the insertions and updates of children into [insertions] and
+  // [updates] using [parallel].
+  void _renderChildrenInParallel(ParallelSerializer& parallel, vector<nlohmann::json>& insertions,
+                                 vector<nlohmann::json>& updates);
+
+  // The parts of [PrintHtml] around the children.
+  void _printOpenTag(HtmlWriter& html);
+  void _printCloseTag(HtmlWriter& html);
+
+  // Lists the markup of this update as a sequence of subtrees that can be
+  // printed independently, with the markup between them written into
+  // [literals]. Subtrees of more than [minTaskNodes] nodes are split.
+  void _planHtml(size_t minTaskNodes, HtmlWriter& literals, vector<HtmlPart>& parts);
+
+  ElementUpdatePool* _pool = nullptr;
 
   // insert-before index if this is being inserted.
   // child index if this is being updated.
-  int _index;
+  int _index = 0;
+
+  // Number of moves of the parent's children that precede this insertion in
+  // the target order. A moved child and an inserted child can share the same
+  // insertion index, so the client must interleave moves and insertions
+  // rather than apply all moves first.
+  int _movesBefore = 0;
+
+  bool _isReplacement = false;
+
+  // Set on insertions that put back a child kept alive under this key.
+  bool _isRestore = false;
+  string _restoreKey = "";
+
+  // Literal markup, see [AppendHtml], and the length it had when this
+  // update was inserted into its parent's markup.
+  bool _hasHtml = false;
+  HtmlWriter _html;
+  size_t _htmlOffset = 0;
 
   string _tag = "";
   string _key = "";
@@ -83,57 +280,189 @@ private:
   bool _updateText = false;
   string _text = "";
 
+  // Text nodes carry nothing but their value.
+  bool _isTextNode = false;
+  string _nodeValue = "";
+
   vector<int> _removes;
+  vector<tuple<int, string>> _keptAlive;
+  vector<string> _evictions;
   vector<Move> _moves;
 
-  vector<ElementUpdate> _childElementInsertions;
-  vector<ElementUpdate> _childElementUpdates;
+  vector<ElementUpdate*> _childElementInsertions;
+  vector<ElementUpdate*> _childElementUpdates;
   vector<tuple<string, string>> _attributes;
+  vector<string> _removedAttributes;
   vector<string> _classNames;
 
+  // Set by [CountNodes].
+  size_t _nodeCount = 0;
+
   PRIVATE_COPY_AND_ASSIGN(ElementUpdate);
 
-  friend class allocator<ElementUpdate>;
+  friend class ElementUpdatePool;
   friend class TreeUpdate;
 };
 
+/// Storage for the nodes of a [TreeUpdate], allocated in fixed-size chunks
+/// so that nodes never move. [Reset] recycles all nodes, along with the
+/// memory their vectors and strings already hold.
+class ElementUpdatePool {
+ public:
+  ElementUpdatePool() { }
+
+  /// Returns a cleared node.
+  ElementUpdate& Acquire(int index);
+
+  /// Gives back [update] if it is the node acquired last. Any other node
+  /// stays in use until [Reset], since later nodes may still refer to it.
+  void Release(ElementUpdate& update);
+
+  void Reset() { _used = 0; }
+
+  /// Number of nodes in use.
+  size_t GetSize() const { return _used; }
+
+  /// Number of nodes allocated, including recycled ones.
+  size_t GetCapacity() const { return _chunks.size() * kChunkSize; }
+
+ private:
+  static const size_t kChunkSize = 256;
+
+  vector<unique_ptr<ElementUpdate[]>> _chunks;
+  size_t _used = 0;
+
+  PRIVATE_COPY_AND_ASSIGN(ElementUpdatePool);
+};
+
 class TreeUpdate {
  public:
-  TreeUpdate() :
-    _rootUpdate(ElementUpdate(0)) { };
+  TreeUpdate() : _pool(new ElementUpdatePool()) {
+    _rootUpdate = &_pool->Acquire(0);
+  };
+
+  TreeUpdate(TreeUpdate&& other) = default;
+  TreeUpdate& operator=(TreeUpdate&& other) = default;
 
   ElementUpdate& CreateRootElement() {
     _createMode = true;
-    return _rootUpdate;
+    return *_rootUpdate;
   }
 
   ElementUpdate& UpdateRootElement() {
     _createMode = false;
-    return _rootUpdate;
+    return *_rootUpdate;
+  }
+
+  /// Clears this update so it can be reused for another frame. Nodes and
+  /// their memory are recycled rather than freed.
+  void Reset() {
+    _createMode = false;
+    _pool->Reset();
+    _rootUpdate = &_pool->Acquire(0);
+  }
+
+  /// The pool the nodes of this update are allocated from.
+  const ElementUpdatePool& GetPool() const { return *_pool; }
+
+  /// The markup a "create" frame for this update carries.
+  string PrintHtml() {
+    _html.Clear();
+    _rootUpdate->PrintHtml(_html);
+    return _html.GetHtml();
   }
 
   string Render() {
     return Render(0);
   }
 
+  /// Makes [Render] encode strings using [strings], which must outlive this
+  /// update.
+  void SetStringTable(StringTable* strings) { _strings = strings; }
+
+  /// Makes [Render] serialize subtrees of the patch, and for "create" frames
+  /// also encode their markup as JSON, in tasks of at least [minTaskNodes]
+  /// nodes run by [runner], which must outlive this update. The frames are
+  /// the same, byte for byte, as when serialized on one thread, which
+  /// happens again if [runner] is `nullptr`.
+  ///
+  /// Updates encoded with a string table are serialized on one thread,
+  /// since their strings are numbered in document order.
+  void SetParallelSerialization(TaskRunner* runner, size_t minTaskNodes) {
+    _parallel.reset(runner != nullptr ? new ParallelSerializer(runner, minTaskNodes) : nullptr);
+  }
+
+  /// Makes "create" frames tell the client to address events by path (see
+  /// [Tree::UsePathAddressedEvents]).
+  void SetPathAddressedEvents(bool pathAddressedEvents) { _pathAddressedEvents = pathAddressedEvents; }
+
+  /// Renders this "create" update as a "hydrate" frame, for a client that
+  /// already shows its markup, only with other barista IDs. The frame lists
+  /// [baristaIds], the IDs in the update's markup in document order, which
+  /// the client gives to the elements that have one.
+  string RenderHydration(const vector<string>& baristaIds, int indent) {
+    nlohmann::json js;
+    js["hydrate"] = baristaIds;
+    if (_pathAddressedEvents) {
+      js["events"] = "path";
+    }
+    if (_strings != nullptr) {
+      _strings->Clear();
+    }
+    return indent > 0 ? js.dump(indent) : js.dump();
+  }
+
   string Render(int indent) {
     nlohmann::json js;
+    if (_createMode && _parallel != nullptr && indent <= 0) {
+      return _renderCreateInParallel();
+    }
     if (_createMode) {
-      stringstream html;
-      _rootUpdate.PrintHtml(html);
-      js["create"] = html.str();
+      _html.Clear();
+      _rootUpdate->PrintHtml(_html);
+      js["create"] = _html.GetHtml();
+      if (_pathAddressedEvents) {
+        js["events"] = "path";
+      }
+      if (_strings != nullptr) {
+        _strings->Clear();
+      }
     } else {
       nlohmann::json jsRootUpdate;
-      if (_rootUpdate.Render(jsRootUpdate)) {
+      ParallelSerializer* parallel = _strings == nullptr ? _parallel.get() : nullptr;
+      if (parallel != nullptr) {
+        _rootUpdate->CountNodes();
+      }
+      if (_rootUpdate->Render(jsRootUpdate, _strings, _html, parallel)) {
         js["update"] = jsRootUpdate;
       }
+      if (_strings != nullptr) {
+        auto newStrings = _strings->TakeNewStrings();
+        if (!newStrings.empty()) {
+          js["strings"] = newStrings;
+        }
+      }
     }
     return indent > 0 ? js.dump(indent) : js.dump();
   }
 
  private:
   bool _createMode = false;
-  ElementUpdate _rootUpdate;
+  unique_ptr<ElementUpdatePool> _pool;
+  ElementUpdate* _rootUpdate;
+  StringTable* _strings = nullptr;
+  bool _pathAddressedEvents = false;
+  // Kept across frames, see [HtmlWriter].
+  HtmlWriter _html;
+
+  // Renders a "create" frame using [_parallel].
+  string _renderCreateInParallel();
+
+  unique_ptr<ParallelSerializer> _parallel;
+  vector<HtmlPart> _htmlParts;
+  vector<string> _jsonParts;
+
+  PRIVATE_COPY_AND_ASSIGN(TreeUpdate);
 };
 
 } // namespace barista
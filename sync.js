@@ -5,7 +5,48 @@ function printStats() {
     console.log(document.querySelectorAll('*[widget]').length, 'widgets');
 }
 
+// Replaces the `<!--t-->` markers that precede text nodes in server HTML
+// with real text nodes. Without them adjacent text nodes would be merged and
+// empty ones dropped by the HTML parser, shifting child indices.
+function materializeTextNodes(root) {
+    let walker = document.createTreeWalker(root, NodeFilter.SHOW_COMMENT);
+    let markers = [];
+    while (walker.nextNode()) {
+        if (walker.currentNode.data == 't') {
+            markers.push(walker.currentNode);
+        }
+    }
+    for (let i = 0; i < markers.length; i++) {
+        let marker = markers[i];
+        let next = marker.nextSibling;
+        if (next != null && next.nodeType == Node.TEXT_NODE) {
+            marker.remove();
+        } else {
+            marker.parentNode.replaceChild(document.createTextNode(''), marker);
+        }
+    }
+}
+
+// Strings sent by previous frames, see `StringTable` in sync.h. Frames
+// encoded with it refer to these strings by index.
+let stringTable = [];
+
+function decodeString(value) {
+    return typeof value == 'number' ? stringTable[value] : value;
+}
+
 function applyElementUpdate(element, update) {
+    if (update.hasOwnProperty("replace")) {
+        let template = document.createElement("template");
+        template.innerHTML = update["replace"];
+        materializeTextNodes(template.content);
+        element.parentNode.replaceChild(template.content.firstChild, element);
+        return;
+    }
+    if (update.hasOwnProperty("nodeValue")) {
+        element.nodeValue = decodeString(update["nodeValue"]);
+        return;
+    }
     if (update.hasOwnProperty("update-elements")) {
         let childUpdates = update["update-elements"];
         for (let i = 0; i < childUpdates.length; i++) {
@@ -24,6 +65,13 @@ function applyElementUpdate(element, update) {
             applyElementUpdate(child, childUpdate);
         }
     }
+    // An element shows either its text or its children. When the text goes
+    // away the children that replace it are indexed as if it never existed.
+    let hasText = update.hasOwnProperty("text");
+    let text = hasText ? decodeString(update["text"]) : "";
+    if (hasText && text == "") {
+        element.innerText = "";
+    }
     let removes = null;
     if (update.hasOwnProperty("remove")) {
         removes = [];
@@ -32,6 +80,14 @@ function applyElementUpdate(element, update) {
             removes.push(element.childNodes.item(removeIndices[i]));
         }
     }
+    let keptAlive = null;
+    if (update.hasOwnProperty("keepAlive")) {
+        keptAlive = [];
+        let entries = update["keepAlive"];
+        for (let i = 0; i + 1 < entries.length; i += 2) {
+            keptAlive.push([element.childNodes.item(entries[i]), entries[i + 1]]);
+        }
+    }
     let moves = null;
     if (update.hasOwnProperty("move")) {
         moves = [];
@@ -42,25 +98,33 @@ function applyElementUpdate(element, update) {
     }
     let insertions = null;
     let insertionPoints = null;
+    let movesBefore = null;
     if (update.hasOwnProperty("insert")) {
         insertions = [];
         insertionPoints = [];
+        movesBefore = [];
         let descriptors = update["insert"];
         for (let i = 0; i < descriptors.length; i++) {
-            let html = descriptors[i]["html"];
             let insertionIndex = descriptors[i]["index"];
-            insertions.push(html);
+            insertions.push(descriptors[i]);
             insertionPoints.push(element.childNodes.item(insertionIndex));
+            movesBefore.push(descriptors[i]["movesBefore"] || 0);
         }
     }
 
+    // Setting the text replaces all children, so it must happen before new
+    // children are inserted, but after existing ones were looked up.
+    if (hasText && text != "") {
+        element.innerText = text;
+    }
+
     if (update.hasOwnProperty("classes")) {
         // TODO(yjbanov): properly diff the class list.
         let classes = update['classes'];
         if (classes.length > 0) {
             element.className = "";
             for (let i = 0; i < classes.length; i++) {
-                let className = classes[i];
+                let className = decodeString(classes[i]);
                 if (className != '__clear__') {
                     element.classList.add(className);
                 }
@@ -74,37 +138,89 @@ function applyElementUpdate(element, update) {
         }
     }
 
-    if (moves != null) {
-        for (let i = 0; i < moves.length; i += 2) {
-            element.insertBefore(moves[i + 1], moves[i]);
+    // Children kept alive are taken out of the document but stay with their
+    // parent, until they are put back or evicted.
+    if (keptAlive != null) {
+        if (!element._bKeptAlive) {
+            element._bKeptAlive = new Map();
+        }
+        for (let i = 0; i < keptAlive.length; i++) {
+            keptAlive[i][0].remove();
+            element._bKeptAlive.set(keptAlive[i][1], keptAlive[i][0]);
+        }
+    }
+    if (update.hasOwnProperty("evict")) {
+        let keys = update["evict"];
+        for (let i = 0; i < keys.length; i++) {
+            element._bKeptAlive.delete(keys[i]);
+        }
+    }
+
+    // Moves and insertions are applied in target order, because a moved and
+    // an inserted child may share an insertion point.
+    let appliedMoves = 0;
+    function applyMovesUpTo(count) {
+        for (; appliedMoves < count; appliedMoves++) {
+            element.insertBefore(moves[2 * appliedMoves + 1], moves[2 * appliedMoves]);
         }
     }
 
     if (insertions != null) {
         for (let i = 0; i < insertions.length; i++) {
+            applyMovesUpTo(movesBefore[i]);
+            let descriptor = insertions[i];
+            if (descriptor.hasOwnProperty("restore")) {
+                let key = descriptor["restore"];
+                let child = element._bKeptAlive.get(key);
+                element._bKeptAlive.delete(key);
+                element.insertBefore(child, insertionPoints[i]);
+                if (descriptor.hasOwnProperty("update")) {
+                    applyElementUpdate(child, descriptor["update"]);
+                }
+                continue;
+            }
             let template = document.createElement("template");
-            template.innerHTML = insertions[i];
+            template.innerHTML = descriptor["html"];
+            materializeTextNodes(template.content);
             element.insertBefore(template.content.firstChild, insertionPoints[i]);
         }
     }
 
+    if (moves != null) {
+        applyMovesUpTo(moves.length / 2);
+    }
+
     if (update.hasOwnProperty("bid")) {
         element.setAttribute("_bid", update["bid"]);
     }
-    if (update.hasOwnProperty("text")) {
-        element.innerText = update["text"];
-    }
     if (update.hasOwnProperty("attrs")) {
         let attrs = update["attrs"];
-        for (let name in attrs) {
-            if (attrs.hasOwnProperty(name)) {
-                if (name == "value") {
-                    element.value = attrs[name];
+        if (Array.isArray(attrs)) {
+            // Names and values of a frame encoded with a string table.
+            for (let i = 0; i + 1 < attrs.length; i += 2) {
+                setAttribute(element, decodeString(attrs[i]), decodeString(attrs[i + 1]));
+            }
+        } else {
+            for (let name in attrs) {
+                if (attrs.hasOwnProperty(name)) {
+                    setAttribute(element, name, attrs[name]);
                 }
-                element.setAttribute(name, attrs[name]);
             }
         }
     }
+    if (update.hasOwnProperty("removeAttrs")) {
+        let names = update["removeAttrs"];
+        for (let i = 0; i < names.length; i++) {
+            element.removeAttribute(decodeString(names[i]));
+        }
+    }
+}
+
+function setAttribute(element, name, value) {
+    if (name == "value") {
+        element.value = value;
+    }
+    element.setAttribute(name, value);
 }
 
 
@@ -122,6 +238,7 @@ function enteredMain() {
 function allReady() {
     console.timeStamp('In main');
     let renderFrame = Module.cwrap('RenderFrame', 'string', []);
+    let getLastFrameStats = Module.cwrap('GetLastFrameStats', 'string', []);
     let dispatchEvent = Module.cwrap('DispatchEvent', 'void', ['string', 'string', 'string']);
     let host = document.querySelector('#host');
 
@@ -138,6 +255,7 @@ function allReady() {
         let renderEnd = performance.now();
         printPerf('renderFrame', renderStart, renderEnd);
         console.log('>>> diff size: ', json.length);
+        console.log('>>> frame stats: ', getLastFrameStats());
 
         let jsonParseStart = performance.now();
         let diff = JSON.parse(json);
@@ -151,11 +269,33 @@ function allReady() {
         if (diff.hasOwnProperty("create")) {
             let createStart = performance.now();
             host.innerHTML = diff["create"];
+            materializeTextNodes(host);
+            stringTable = [];
+            pathAddressedEvents = diff["events"] == "path";
             let createEnd = performance.now();
             printPerf('create', createStart, createEnd);
-        } else if (diff.hasOwnProperty("update")) {
+        }
+        if (diff.hasOwnProperty("hydrate")) {
+            // The host already shows the markup, e.g. rendered on the
+            // server; only the barista IDs change.
+            let hydrateStart = performance.now();
+            materializeTextNodes(host);
+            let elements = host.querySelectorAll('[_bid]');
+            let bids = diff["hydrate"];
+            for (let i = 0; i < elements.length && i < bids.length; i++) {
+                elements[i].setAttribute('_bid', bids[i]);
+            }
+            stringTable = [];
+            pathAddressedEvents = diff["events"] == "path";
+            let hydrateEnd = performance.now();
+            printPerf('hydrate', hydrateStart, hydrateEnd);
+        }
+        if (diff.hasOwnProperty("strings")) {
+            Array.prototype.push.apply(stringTable, diff["strings"]);
+        }
+        if (diff.hasOwnProperty("update")) {
             let updateStart = performance.now();
-            applyElementUpdate(host.firstElementChild, diff["update"]);
+            applyElementUpdate(host.firstChild, diff["update"]);
             let updateEnd = performance.now();
             printPerf('update', updateStart, updateEnd);
         }
@@ -170,10 +310,43 @@ function allReady() {
         if (event.target && event.target.value) {
             data['value'] = event.target.value;
         }
+        if (type == 'scroll') {
+            data['scrollTop'] = Math.round(event.target.scrollTop);
+        }
         return JSON.stringify(data);
     }
 
+    // Whether events are sent with the path from the root element to their
+    // target rather than the _bid of the nearest element with listeners.
+    let pathAddressedEvents = false;
+
+    // Returns the child indices leading from the root element to [node],
+    // written as "/0/3/1", or null if [node] is not inside the root element,
+    // e.g. the host itself.
+    function pathTo(node) {
+        let path = [];
+        while (node && node != host && node.parentNode != host) {
+            path.push(Array.prototype.indexOf.call(node.parentNode.childNodes, node));
+            node = node.parentNode;
+        }
+        if (!node || node == host) {
+            return null;
+        }
+        return "/" + path.reverse().join("/");
+    }
+
     function handleEvent(type, event) {
+        if (pathAddressedEvents) {
+            // The native side finds the listener from the path.
+            let path = pathTo(event.target);
+            if (path) {
+                dispatchEvent(type, path, serializeEvent(type, event));
+                syncFromNative();
+            } else {
+                console.log(">>> caught event outside of the root element:", event.target);
+            }
+            return;
+        }
         // Look for the nearest parent with a _bid, then dispatch to it.
         let bid = null;
         let parent = event.target;
@@ -189,11 +362,13 @@ function allReady() {
         }
     }
 
-    let eventTypes = ["click", "keyup"];
+    let eventTypes = ["click", "keyup", "scroll"];
     eventTypes.forEach((type) => {
+        // Scroll events do not bubble, so they are only seen by the host
+        // during the capture phase.
         host.addEventListener(type, function(event) {
             handleEvent(type, event);
-        });
+        }, type == 'scroll');
     });
     syncFromNative();
 }
@@ -20,6 +20,7 @@ void Expect(T actual, T expected) {
 template void Expect<unsigned long>(unsigned long, unsigned long);
 template void Expect<unsigned int>(unsigned int, unsigned int);
 template void Expect<int>(int, int);
+template void Expect<int64_t>(int64_t, int64_t);
 template void Expect<bool>(bool, bool);
 template void Expect<string>(string, string);
 
@@ -71,6 +72,33 @@ void ExpectTreeUpdate(shared_ptr<Tree> tree, TreeUpdate& expected) {
   Expect(diff, expected.Render(2));
 }
 
+void ExpectAllocationsAtMost(string label, AllocationCounter actual, int64_t maxCount) {
+  if (!IsAllocationHookInstalled()) {
+    cout << "SKIPPED: " << label << " (allocation hook not installed)" << endl;
+    return;
+  }
+  if (actual.GetCount() > maxCount) {
+    cout << "Test failed:\n  Allocation budget exceeded for " << label
+         << "\n  Budget: " << maxCount
+         << "\n  Was: " << actual.GetCount() << " (" << actual.GetBytes() << " bytes)" << endl;
+    exit(1);
+  } else {
+    cout << "PASSED: " << label << " " << actual.GetCount() << " <= " << maxCount << endl;
+  }
+}
+
+void ExpectFrameAllocationsAtMost(
+    shared_ptr<Tree> tree,
+    int64_t maxBuild,
+    int64_t maxDiff,
+    int64_t maxSerialize
+) {
+  auto& allocations = tree->GetLastFrameAllocations();
+  ExpectAllocationsAtMost("build", allocations.Get(kPhaseBuild), maxBuild);
+  ExpectAllocationsAtMost("diff", allocations.Get(kPhaseDiff), maxDiff);
+  ExpectAllocationsAtMost("serialize", allocations.Get(kPhaseSerialize), maxSerialize);
+}
+
 class ChildDiffState : public State {
  public:
   virtual shared_ptr<Node> Build() {
@@ -12,6 +12,20 @@ template<typename E> void ExpectVector(vector<E> actual, vector<E> expected);
 
 void ExpectTreeUpdate(shared_ptr<Tree> tree, TreeUpdate& expected);
 
+/// Fails the test if [actual] made more than [maxCount] allocations.
+///
+/// Passes trivially when the allocation hook is not linked in.
+void ExpectAllocationsAtMost(string label, AllocationCounter actual, int64_t maxCount);
+
+/// Fails the test if any phase of the last frame of [tree] made more
+/// allocations than its budget.
+void ExpectFrameAllocationsAtMost(
+    shared_ptr<Tree> tree,
+    int64_t maxBuild,
+    int64_t maxDiff,
+    int64_t maxSerialize
+);
+
 void ExpectChildDiff(
     vector<tuple<string, string>> before,
     vector<tuple<string, string>> after,
@@ -1,12 +1,18 @@
 #include <iostream>
+#include <random>
 #include <sstream>
 #include <vector>
 
 #include "api.h"
+#include "dom.h"
+#include "element_template.h"
 #include "html.h"
+#include "html_writer.h"
+#include "record.h"
 #include "sync.h"
 #include "style.h"
 #include "test.h"
+#include "virtual_list.h"
 #include "lib/json/src/json.hpp"
 
 using namespace std;
@@ -101,6 +107,275 @@ class CreateFirstChildDiffTest : public StatefulWidget {
   }
 };
 
+class KeyedListTestState : public State {
+ public:
+  virtual shared_ptr<Node> Build() {
+    auto list = El("div");
+    for (int i = 0; i < count; i++) {
+      list->El("span")->SetKey(to_string(i));
+    }
+    return list;
+  }
+
+  int count = 10;
+};
+
+class KeyedListTest : public StatefulWidget {
+ public:
+  shared_ptr<KeyedListTestState> state = nullptr;
+
+  virtual shared_ptr<State> CreateState() {
+    return state = make_shared<KeyedListTestState>();
+  }
+};
+
+class CounterCellState : public State {
+ public:
+  virtual shared_ptr<Node> Build() {
+    auto cell = El("td");
+    cell->SetText(to_string(count));
+    return cell;
+  }
+
+  int count = 0;
+};
+
+class CounterCell : public StatefulWidget {
+ public:
+  shared_ptr<CounterCellState> state = nullptr;
+
+  virtual shared_ptr<State> CreateState() {
+    return state = make_shared<CounterCellState>();
+  }
+};
+
+// Shows a label passed in by the parent next to a click count of its own.
+class LabelCell : public StatefulWidget {
+ public:
+  LabelCell(string label) : _label(label) { }
+
+  string GetLabel() { return _label; }
+
+  virtual shared_ptr<State> CreateState();
+
+ private:
+  string _label;
+};
+
+class LabelCellState : public State {
+ public:
+  int clicks = 0;
+  int builds = 0;
+  vector<string> previousLabels;
+
+  virtual shared_ptr<Node> Build() {
+    builds++;
+    auto cell = El("td");
+    cell->SetText(static_pointer_cast<LabelCell>(GetConfig())->GetLabel() + ": " + to_string(clicks));
+    return cell;
+  }
+
+  virtual void DidUpdateWidget(shared_ptr<StatefulWidget> oldConfig) {
+    previousLabels.push_back(static_pointer_cast<LabelCell>(oldConfig)->GetLabel());
+  }
+
+  virtual bool ShouldRebuild(shared_ptr<StatefulWidget> oldConfig) {
+    return static_pointer_cast<LabelCell>(oldConfig)->GetLabel() !=
+        static_pointer_cast<LabelCell>(GetConfig())->GetLabel();
+  }
+};
+
+shared_ptr<State> LabelCell::CreateState() {
+  return make_shared<LabelCellState>();
+}
+
+// Builds a node of a different kind for each [mode].
+class KindSwitchTest : public StatelessWidget {
+ public:
+  KindSwitchTest(int mode) : _mode(mode) { }
+
+  virtual shared_ptr<Node> Build() {
+    switch (_mode) {
+      case 0: return El("div");
+      case 1: return El("span");
+      case 2: return Tx("text");
+      default: return make_shared<CounterCell>();
+    }
+  }
+
+ private:
+  int _mode;
+};
+
+// Builds random rows, one more per click on any row, like SampleApp. The
+// list's title shows the row count.
+class RandomRowsTestState : public State {
+ public:
+  vector<int> values;
+
+  RandomRowsTestState() {
+    for (int i = 0; i < 3; i++) {
+      values.push_back(rand() % 1000);
+    }
+  }
+
+  virtual shared_ptr<Node> Build() {
+    auto list = El("div");
+    list->SetAttribute("title", to_string(values.size()));
+    for (int value : values) {
+      auto row = list->El("button");
+      row->SetText(to_string(value));
+      row->AddEventListener("click", [this](const Event& event) {
+        values.push_back(rand() % 1000);
+        ScheduleUpdate();
+      });
+    }
+    return list;
+  }
+};
+
+class RandomRowsTest : public StatefulWidget {
+ public:
+  virtual shared_ptr<State> CreateState() {
+    return make_shared<RandomRowsTestState>();
+  }
+};
+
+// A mutable description of an element tree, rendered by [ModelViewTest].
+class ModelNode {
+ public:
+  bool isText = false;
+  string value = "";
+  string tag = "div";
+  string key = "";
+  map<string, string> attributes;
+  vector<string> classNames;
+  string text = "";
+  bool listens = false;
+  vector<shared_ptr<ModelNode>> children;
+
+  shared_ptr<Node> Build() {
+    if (isText) {
+      return Tx(value);
+    }
+    auto element = El(tag);
+    element->SetKey(key);
+    for (auto& attribute : attributes) {
+      element->SetAttribute(attribute.first, attribute.second);
+    }
+    for (auto& className : classNames) {
+      element->AddClassName(className);
+    }
+    if (text != "") {
+      element->SetText(text);
+    }
+    if (listens) {
+      element->AddEventListener("click", [](const Event& event) { });
+    }
+    for (auto& child : children) {
+      element->AddChild(child->Build());
+    }
+    return element;
+  }
+};
+
+class ModelViewTestState : public State {
+ public:
+  ModelViewTestState(shared_ptr<ModelNode> model) : _model(model) { }
+  virtual shared_ptr<Node> Build() { return _model->Build(); }
+
+ private:
+  shared_ptr<ModelNode> _model;
+};
+
+class ModelViewTest : public StatefulWidget {
+ public:
+  ModelViewTest(shared_ptr<ModelNode> model) : _model(model) { }
+  shared_ptr<ModelViewTestState> state = nullptr;
+
+  virtual shared_ptr<State> CreateState() {
+    return state = make_shared<ModelViewTestState>(_model);
+  }
+
+ private:
+  shared_ptr<ModelNode> _model;
+};
+
+// Applies a random change to a random element of [root].
+void MutateModel(shared_ptr<ModelNode> root, mt19937& random, int& nextKey) {
+  vector<shared_ptr<ModelNode>> elements;
+  vector<shared_ptr<ModelNode>> stack = {root};
+  while (!stack.empty()) {
+    auto node = stack.back();
+    stack.pop_back();
+    if (!node->isText) {
+      elements.push_back(node);
+      stack.insert(stack.end(), node->children.begin(), node->children.end());
+    }
+  }
+  auto node = elements[random() % elements.size()];
+  auto pick = [&](vector<string> options) { return options[random() % options.size()]; };
+  auto& children = node->children;
+  switch (random() % 9) {
+    case 0:
+      node->attributes[pick({"title", "data-x", "disabled"})] = pick({"", "a", "b & c", "<d>"});
+      break;
+    case 1:
+      if (!node->attributes.empty()) {
+        node->attributes.erase(node->attributes.begin());
+      }
+      break;
+    case 2:
+      node->classNames.clear();
+      for (auto className : {"x", "y", "z"}) {
+        if (random() % 2) {
+          node->classNames.push_back(className);
+        }
+      }
+      break;
+    case 3:
+      // Elements use either SetText or children; the text op replaces all
+      // children on the client.
+      if (children.empty() && node != root && node->tag != "input") {
+        node->text = pick({"", "one", "two"});
+      }
+      break;
+    case 4:
+      node->listens = !node->listens;
+      break;
+    case 5:
+    case 6:
+      // Void elements such as <input> cannot have children in HTML.
+      if (node->text == "" && node->tag != "input" && children.size() < 8) {
+        auto child = make_shared<ModelNode>();
+        if (random() % 3 == 0) {
+          child->isText = true;
+          child->value = pick({"", "a", "b"});
+        } else {
+          child->tag = pick({"div", "span", "input"});
+          if (random() % 2) {
+            child->key = child->tag + to_string(nextKey++);
+          }
+        }
+        children.insert(children.begin() + random() % (children.size() + 1), child);
+      }
+      break;
+    case 7:
+      if (!children.empty()) {
+        children.erase(children.begin() + random() % children.size());
+      }
+      break;
+    case 8:
+      shuffle(children.begin(), children.end(), random);
+      for (auto& child : children) {
+        if (child->isText && random() % 2) {
+          child->value = pick({"", "a", "b", "c"});
+        }
+      }
+      break;
+  }
+}
+
 class BeforeAfterTestState : public State {
  public:
   BeforeAfterTestState(shared_ptr<Node> beforeState) : _state(beforeState) { };
@@ -133,6 +408,125 @@ class BeforeAfterTest : public StatefulWidget {
 };
 
 
+// A todo list row, built both from an [ElementTemplate] and from plain
+// [Element]s, so that the two can be compared.
+class TodoRowModel {
+ public:
+  string key;
+  string title;
+  bool completed = false;
+  bool editing = false;
+  vector<string> tags;
+};
+
+enum TodoRowSlot {
+  kTodoRowClasses,
+  kTodoControlsClasses,
+  kTodoChecked,
+  kTodoToggle,
+  kTodoTitle,
+  kTodoDestroy,
+  kTodoEditorClasses,
+  kTodoEditorValue,
+  kTodoTags,
+};
+
+shared_ptr<ElementTemplate> TodoRowTemplate() {
+  static shared_ptr<ElementTemplate> compiled = ElementTemplate::Compile(
+      TemplateElement("li")
+          .ClassSlot(kTodoRowClasses)
+          .AddChild(TemplateElement("div")
+              .ClassSlot(kTodoControlsClasses)
+              .AddChild(TemplateElement("input")
+                  .SetAttribute("type", "checkbox")
+                  .AddClassName("toggle")
+                  .AttributeSlot(kTodoChecked, "checked")
+                  .ListenerSlot(kTodoToggle, "click"))
+              .AddChild(TemplateElement("label").TextSlot(kTodoTitle))
+              .AddChild(TemplateElement("button")
+                  .AddClassName("destroy")
+                  .ListenerSlot(kTodoDestroy, "click")))
+          .AddChild(TemplateElement("div")
+              .AddChild(TemplateElement("input")
+                  .SetAttribute("type", "text")
+                  .AddClassName("edit")
+                  .ClassSlot(kTodoEditorClasses)
+                  .AttributeSlot(kTodoEditorValue, "value")))
+          .AddChild(TemplateElement("ul")
+              .AddClassName("tags")
+              .ChildrenSlot(kTodoTags))
+  );
+  return compiled;
+}
+
+shared_ptr<Node> BuildTodoRowFromTemplate(const TodoRowModel& model, vector<string>& eventLog) {
+  auto row = make_shared<TemplateNode>(TodoRowTemplate());
+  row->SetKey(model.key);
+  if (model.completed) {
+    row->AddClassName(kTodoRowClasses, "completed");
+    row->SetAttribute(kTodoChecked, "");
+  }
+  if (model.editing) {
+    row->AddClassName(kTodoControlsClasses, "hidden");
+    row->AddClassName(kTodoEditorClasses, "visible");
+  }
+  string key = model.key;
+  row->AddEventListener(kTodoToggle, [&eventLog, key](const Event& _) {
+    eventLog.push_back("toggle " + key);
+  });
+  row->SetText(kTodoTitle, model.title);
+  row->AddEventListener(kTodoDestroy, [&eventLog, key](const Event& _) {
+    eventLog.push_back("destroy " + key);
+  });
+  row->SetAttribute(kTodoEditorValue, model.title);
+  for (auto& tag : model.tags) {
+    auto tagElement = El("li");
+    tagElement->SetKey(tag);
+    tagElement->AddEventListener("click", [&eventLog, tag](const Event& _) {
+      eventLog.push_back("tag " + tag);
+    });
+    tagElement->AddChild(Tx(tag));
+    row->AddChild(kTodoTags, tagElement);
+  }
+  return row;
+}
+
+shared_ptr<Node> BuildTodoRowFromElements(const TodoRowModel& model) {
+  auto li = El("li");
+  li->SetKey(model.key);
+  auto controls = li->El("div");
+  if (model.editing) {
+    controls->AddClassName("hidden");
+  }
+  auto checkbox = controls->El("input");
+  checkbox->SetAttribute("type", "checkbox");
+  if (model.completed) {
+    li->AddClassName("completed");
+    checkbox->SetAttribute("checked", "");
+  }
+  checkbox->AddClassName("toggle");
+  checkbox->AddEventListener("click", [](const Event& _) {});
+  controls->El("label")->SetText(model.title);
+  auto removeButton = controls->El("button");
+  removeButton->AddClassName("destroy");
+  removeButton->AddEventListener("click", [](const Event& _) {});
+  auto input = li->El("div")->El("input");
+  input->SetAttribute("type", "text");
+  input->AddClassName("edit");
+  if (model.editing) {
+    input->AddClassName("visible");
+  }
+  input->SetAttribute("value", model.title);
+  auto tags = li->El("ul");
+  tags->AddClassName("tags");
+  for (auto& tag : model.tags) {
+    auto tagElement = tags->El("li");
+    tagElement->SetKey(tag);
+    tagElement->AddEventListener("click", [](const Event& _) {});
+    tagElement->AddChild(Tx(tag));
+  }
+  return li;
+}
 
 TEST(TestPrintTag)
   auto tree = make_shared<Tree>(make_shared<ElementTagTest>());
@@ -148,8 +542,7 @@ TEST(TestPrintText)
 
   auto update = TreeUpdate();
   auto& rootUpdate = update.CreateRootElement();
-  rootUpdate.SetTag("span");
-  rootUpdate.SetText("hello");
+  rootUpdate.SetNodeValue("hello");
   ExpectTreeUpdate(tree, update);
 END_TEST
 
@@ -160,8 +553,7 @@ TEST(TestPrintElementWithChildren)
   auto& div = update.CreateRootElement();
   div.SetTag("div");
   auto& child1 = div.InsertChildElement(0);
-  child1.SetTag("span");
-  child1.SetText("hello");
+  child1.SetNodeValue("hello");
   auto& child2 = div.InsertChildElement(0);
   child2.SetTag("span");
 
@@ -231,8 +623,7 @@ TEST(TestBasicStatefulWidget)
 
   auto update1 = TreeUpdate();
   auto& child1 = update1.CreateRootElement();
-  child1.SetTag("span");
-  child1.SetText("Hello");
+  child1.SetNodeValue("Hello");
   ExpectTreeUpdate(tree, update1);
 
   widget->state->label = "World";
@@ -243,7 +634,7 @@ TEST(TestBasicStatefulWidget)
   widget->state->ScheduleUpdate();
   auto update2 = TreeUpdate();
   auto& child2 = update2.UpdateRootElement();
-  child2.SetText("World");
+  child2.SetNodeValue("World");
   ExpectTreeUpdate(tree, update2);
 END_TEST
 
@@ -405,6 +796,18 @@ TEST(TestSyncerCreate)
   );
 END_TEST
 
+TEST(TestTextNodeHtml)
+  auto div = El("div");
+  div->AddChild(Tx("a"));
+  div->AddChild(Tx(""));
+  div->AddChild(Tx("b"));
+  auto tree = make_shared<Tree>(div);
+
+  nlohmann::json j;
+  j["create"] = "<div><!--t-->a<!--t--><!--t-->b</div>";
+  Expect(tree->RenderFrame(2), j.dump(2));
+END_TEST
+
 TEST(TestSyncerUpdate)
   auto treeUpdate = TreeUpdate();
   auto& rootUpdate = treeUpdate.UpdateRootElement();
@@ -449,7 +852,7 @@ TEST(TestAttrsUpdate)
   auto& childUpdate = rootUpdate.UpdateChildElement(0);
   childUpdate.SetAttribute("update", "a");
   childUpdate.SetAttribute("create", "b");
-  childUpdate.SetAttribute("remove", "");
+  childUpdate.RemoveAttribute("remove");
 
   auto before = make_shared<Element>("div");
   auto beforeChild = make_shared<Element>("span");
@@ -609,6 +1012,37 @@ TEST(TestListDiffSwap)
   );
 END_TEST
 
+TEST(TestListDiffInsertBeforeMovedChild)
+  // "n" and "b" are both inserted before "a"; the insertion must be applied
+  // before the move to keep them in order.
+  auto update = TreeUpdate();
+  auto& diff = update.UpdateRootElement();
+  auto& inserted = diff.InsertChildElement(0);
+  inserted.SetTag("div");
+  inserted.SetKey("n");
+  diff.MoveChild(0, 1);
+
+  ExpectChildDiff(
+      {
+          {"div", "a"},
+          {"div", "b"},
+      },
+      {
+          {"div", "n"},
+          {"div", "b"},
+          {"div", "a"},
+      },
+      update
+  );
+
+  TreeUpdate treeUpdate;
+  auto& root = treeUpdate.UpdateRootElement();
+  root.MoveChild(0, 1);
+  root.InsertChildElement(0).SetTag("div");
+  auto js = nlohmann::json::parse(treeUpdate.Render());
+  Expect(js["update"]["insert"][0]["movesBefore"].get<int>(), 1);
+END_TEST
+
 TEST(TestListDiffInsertMiddle)
   auto update = TreeUpdate();
   auto& diff = update.UpdateRootElement();
@@ -736,6 +1170,1297 @@ TEST(TestDetachedSubTreesDoNotLeakMemory)
   Expect(childPtr.expired(), true);
 END_TEST
 
+TEST(TestFrameAllocationBudget)
+  auto widget = make_shared<KeyedListTest>();
+  auto tree = make_shared<Tree>(widget);
+  tree->RenderFrame();
+  cout << "Initial frame: " << tree->GetLastFrameAllocations().ToString() << endl;
+  Expect(tree->GetLastFrameAllocations().Get(kPhaseBuild).GetCount() > 0, IsAllocationHookInstalled());
+
+  // Nothing scheduled: the frame should be close to free.
+  tree->RenderFrame();
+  cout << "Idle frame: " << tree->GetLastFrameAllocations().ToString() << endl;
+  ExpectFrameAllocationsAtMost(tree, 0, 0, 10);
+
+  widget->state->count++;
+  widget->state->ScheduleUpdate();
+  tree->RenderFrame();
+  cout << "Append frame: " << tree->GetLastFrameAllocations().ToString() << endl;
+  ExpectFrameAllocationsAtMost(tree, 25, 80, 80);
+END_TEST
+
+TEST(TestSparseChildUpdates)
+  auto table = El("table");
+  vector<shared_ptr<CounterCell>> cells;
+  for (int i = 0; i < 10000; i++) {
+    auto cell = make_shared<CounterCell>();
+    table->El("tr")->AddChild(cell);
+    cells.push_back(cell);
+  }
+  auto tree = make_shared<Tree>(table);
+  tree->RenderFrame();
+
+  // Only the path to the changed cell gets a patch node.
+  cells[5000]->state->count++;
+  cells[5000]->state->ScheduleUpdate();
+  Expect(tree->RenderFrame(),
+         string("{\"update\":{\"index\":0,\"update-elements\":[{\"index\":5000,"
+                "\"update-elements\":[{\"index\":0,\"text\":\"1\"}]}]}}"));
+  cout << "Single cell frame: " << tree->GetLastFrameAllocations().ToString() << endl;
+  ExpectFrameAllocationsAtMost(tree, 5, 10, 100);
+END_TEST
+
+TEST(TestTreeUpdateReuse)
+  auto update = TreeUpdate();
+  auto& root = update.CreateRootElement();
+  root.SetTag("div");
+  auto& first = root.InsertChildElement(0);
+  first.SetTag("span");
+  for (int i = 1; i < 1000; i++) {
+    root.InsertChildElement(i).SetTag("span");
+  }
+  // Siblings inserted later do not move earlier ones.
+  first.SetText("first");
+  auto html = update.Render();
+  Expect(html.substr(0, 40), string("{\"create\":\"<div><span>first</span><span>"));
+  Expect(update.GetPool().GetSize(), (size_t) 1001);
+
+  // Moving keeps the nodes in place.
+  auto moved = move(update);
+  Expect(moved.Render() == html, true);
+
+  // A reset update recycles its nodes.
+  size_t capacity = moved.GetPool().GetCapacity();
+  moved.Reset();
+  Expect(moved.GetPool().GetSize(), (size_t) 1);
+  auto& updatedRoot = moved.UpdateRootElement();
+  updatedRoot.UpdateChildElement(3).SetText("x");
+  Expect(moved.Render(), string("{\"update\":{\"index\":0,\"update-elements\":[{\"index\":3,\"text\":\"x\"}]}}"));
+  Expect(moved.GetPool().GetCapacity(), capacity);
+
+  // Discarding an update that is not the node acquired last keeps it in use,
+  // rather than recycling the node acquired after it.
+  updatedRoot.UpdateChildElement(4);
+  updatedRoot.InsertChildElement(0).SetTag("b");
+  size_t size = moved.GetPool().GetSize();
+  updatedRoot.DiscardChildElementUpdateIfEmpty();
+  Expect(moved.GetPool().GetSize(), size);
+  updatedRoot.UpdateChildElement(5).SetText("y");
+  Expect(moved.Render(), string("{\"update\":{\"index\":0,\"insert\":[{\"html\":\"<b></b>\",\"index\":0}],"
+                                "\"update-elements\":[{\"index\":3,\"text\":\"x\"},{\"index\":5,\"text\":\"y\"}]}}"));
+END_TEST
+
+TEST(TestDirtyChildTracking)
+  auto table = El("table");
+  vector<shared_ptr<CounterCell>> cells;
+  for (int i = 0; i < 10000; i++) {
+    auto cell = make_shared<CounterCell>();
+    table->El("tr")->AddChild(cell);
+    cells.push_back(cell);
+  }
+  auto tree = make_shared<Tree>(table);
+  tree->RenderFrame();
+
+  // Siblings of the scheduled cells are not visited, and the cells are
+  // updated in document order regardless of the order they were scheduled.
+  for (int index : {7000, 3, 7000}) {
+    cells[index]->state->count++;
+    cells[index]->state->ScheduleUpdate();
+  }
+  Expect(tree->RenderFrame(),
+         string("{\"update\":{\"index\":0,\"update-elements\":["
+                "{\"index\":3,\"update-elements\":[{\"index\":0,\"text\":\"1\"}]},"
+                "{\"index\":7000,\"update-elements\":[{\"index\":0,\"text\":\"2\"}]}]}}"));
+  // The table, and a row, cell widget and td per scheduled cell.
+  Expect(tree->GetLastFrameStats().GetNodesVisited(), (int64_t) 7);
+
+  // Only the table is visited when nothing is scheduled.
+  tree->RenderFrame();
+  Expect(tree->GetLastFrameStats().GetNodesVisited(), (int64_t) 1);
+END_TEST
+
+TEST(TestTraceEvents)
+  TraceRecorder::Clear();
+  auto widget = make_shared<KeyedListTest>();
+  auto tree = make_shared<Tree>(widget);
+  tree->SetTracing(true);
+  tree->RenderFrame();
+  widget->state->count = 12;
+  widget->state->ScheduleUpdate();
+  tree->RenderFrame();
+  tree->SetTracing(false);
+  tree->RenderFrame();
+
+  auto trace = nlohmann::json::parse(tree->DumpTrace());
+  map<string, int> spanCounts;
+  for (auto& event : trace["traceEvents"]) {
+    spanCounts[event["cat"].get<string>() + ":" + event["name"].get<string>()]++;
+    if (event["name"] == "ListDiff" && event["args"]["oldChildren"] == 10) {
+      Expect(event["args"]["newChildren"].get<int>(), 12);
+    }
+  }
+  Expect(spanCounts["frame:Frame"], 2);
+  Expect(spanCounts["serialize:Serialize"], 2);
+  Expect(spanCounts["update:KeyedListTest"], 2);
+  Expect(spanCounts["build:KeyedListTest"], 2);
+  Expect(spanCounts["diff:ListDiff"], 2);
+END_TEST
+
+TEST(TestFrameStats)
+  auto widget = make_shared<KeyedListTest>();
+  auto tree = make_shared<Tree>(widget);
+  auto diff = tree->RenderFrame();
+  auto& stats = tree->GetLastFrameStats();
+  Expect(stats.GetStatesCreated(), (int64_t) 1);
+  Expect(stats.GetStatefulBuilds(), (int64_t) 1);
+  Expect(stats.GetElementsInserted(), (int64_t) 10);
+  Expect(stats.GetNodesVisited(), (int64_t) 12);
+  Expect(stats.GetBytesEmitted(), (int64_t) diff.size());
+
+  // Idle frame visits only the root.
+  tree->RenderFrame();
+  Expect(stats.GetNodesVisited(), (int64_t) 1);
+  Expect(stats.GetStatefulBuilds(), (int64_t) 0);
+
+  widget->state->count = 8;
+  widget->state->ScheduleUpdate();
+  tree->RenderFrame();
+  Expect(stats.GetStatesCreated(), (int64_t) 0);
+  Expect(stats.GetStatefulBuilds(), (int64_t) 1);
+  Expect(stats.GetElementsInserted(), (int64_t) 0);
+  Expect(stats.GetElementsRemoved(), (int64_t) 2);
+  Expect(stats.GetListDiffs(), (int64_t) 1);
+  Expect(stats.GetLisInputMax(), (int64_t) 8);
+
+  auto js = nlohmann::json::parse(stats.ToJson());
+  Expect(js["elementsRemoved"].get<int>(), 2);
+END_TEST
+
+TEST(TestRecordAndReplay)
+  auto tree = make_shared<Tree>(make_shared<RandomRowsTest>());
+  tree->StartRecording(1234);
+  vector<string> frames;
+  frames.push_back(tree->RenderFrame());
+  int64_t firstBid = RenderElement::GetNextBaristaId() - 3;
+  for (int i = 0; i < 3; i++) {
+    tree->DispatchEvent(Event("click", to_string(firstBid + i), "{\"x\": 1}"));
+    frames.push_back(tree->RenderFrame(2));
+  }
+  Expect(frames[1].find("insert") != string::npos, true);
+  auto& entries = tree->GetRecorder()->GetLog().GetEntries();
+  Expect(entries.size(), (size_t) 7);
+  Expect(entries[1].GetData(), string("{\"x\":1}"));
+
+  string bytes = tree->GetRecorder()->GetLog().Serialize();
+  string decoded;
+  Expect(DecodeBase64(EncodeBase64(bytes), decoded), true);
+  Expect(decoded == bytes, true);
+
+  SessionLog log;
+  Expect(SessionLog::Parse(bytes, log), true);
+  Expect(log.GetSeed(), (unsigned int) 1234);
+  Expect(log.GetEntries().size(), (size_t) 7);
+  Expect(SessionLog::Parse(bytes.substr(0, bytes.size() - 1), log), false);
+  Expect(SessionLog::Parse("not a log", log), false);
+
+  // Disturb the initial conditions; replay must restore them.
+  srand(99);
+  RenderElement::SetNextBaristaId(500);
+  SessionLog::Parse(bytes, log);
+  auto replayed = ReplaySession(log, make_shared<RandomRowsTest>());
+  Expect(replayed.size(), frames.size());
+  for (size_t i = 0; i < replayed.size(); i++) {
+    Expect(replayed[i].Matches(), true);
+    Expect(replayed[i].GetOutputHash() == HashFrameOutput(frames[i]), true);
+  }
+
+  // Logs recorded before encoding options were stored replay without them.
+  Expect(SessionLog::Parse(string("BRS1\x05\x01", 6), log), true);
+  Expect(log.GetSeed(), (unsigned int) 5);
+  Expect(log.UsesStringTable(), false);
+END_TEST
+
+TEST(TestReplayEncoding)
+  auto tree = make_shared<Tree>(make_shared<RandomRowsTest>());
+  tree->StartRecording(1234);
+  tree->UseStringTable();
+  tree->UsePathAddressedEvents();
+  vector<string> frames;
+  frames.push_back(tree->RenderFrame());
+  for (int i = 0; i < 3; i++) {
+    tree->DispatchEvent(Event("click", "/" + to_string(i), "{}"));
+    frames.push_back(tree->RenderFrame(2));
+  }
+  Expect(frames[2].find("strings") != string::npos, true);
+
+  SessionLog log;
+  Expect(SessionLog::Parse(tree->GetRecorder()->GetLog().Serialize(), log), true);
+  Expect(log.UsesStringTable(), true);
+  Expect(log.UsesPathAddressedEvents(), true);
+  auto replayed = ReplaySession(log, make_shared<RandomRowsTest>());
+  Expect(replayed.size(), frames.size());
+  for (size_t i = 0; i < replayed.size(); i++) {
+    Expect(replayed[i].Matches(), true);
+  }
+END_TEST
+
+TEST(TestDomParseHtml)
+  auto nodes = ParseHtml(
+      "<div _bkey=\"k\" title=\"a &amp; b\" class=\" x y\" _bid=\"3\">"
+      "<!--t-->1 &lt; 2<!--t--><input type=\"checkbox\"></input><span>&#65;</span></div>"
+  );
+  Expect(nodes.size(), (size_t) 1);
+  MaterializeTextNodes(nodes[0]);
+  Expect(
+      nodes[0]->ToCanonicalString(false),
+      string("<div _bid=\"3\" _bkey=\"k\" title=\"a &amp; b\" class=\"x y\">"
+             "\"1 &lt; 2\"\"\"<input type=\"checkbox\"></input><span>\"A\"</span></div>")
+  );
+END_TEST
+
+// Mutates a random model for [frameCount] frames and fails unless the DOM
+// patched by each frame equals a fresh render of the model.
+void ExpectDomMatchesFreshRender(uint32_t seed, int frameCount, bool useStringTable) {
+  mt19937 random(seed);
+  int nextKey = 0;
+  auto model = make_shared<ModelNode>();
+  auto widget = make_shared<ModelViewTest>(model);
+  auto tree = make_shared<Tree>(widget);
+  if (useStringTable) {
+    tree->UseStringTable();
+  }
+  Dom dom;
+  dom.ApplyFrame(tree->RenderFrame());
+  for (int frame = 0; frame < frameCount; frame++) {
+    for (int i = 0; i < 3; i++) {
+      MutateModel(model, random, nextKey);
+    }
+    widget->state->ScheduleUpdate();
+    dom.ApplyFrame(tree->RenderFrame());
+
+    Dom fresh;
+    fresh.ApplyFrame(make_shared<Tree>(make_shared<ModelViewTest>(model))->RenderFrame());
+    string actual = dom.ToCanonicalString(true);
+    string expected = fresh.ToCanonicalString(true);
+    if (actual != expected) {
+      cout << "Test failed at frame " << frame << ":\n  Expected: " << expected
+           << "\n  Was:      " << actual << endl;
+      exit(1);
+    }
+  }
+  cout << "PASSED: " << frameCount << " frames, final DOM " << dom.ToCanonicalString(true).size()
+       << " chars" << endl;
+}
+
+TEST(TestDomMatchesFreshRender)
+  ExpectDomMatchesFreshRender(3, 300, false);
+END_TEST
+
+TEST(TestStringTable)
+  auto model = make_shared<ModelNode>();
+  auto child = make_shared<ModelNode>();
+  child->tag = "span";
+  model->children.push_back(child);
+  auto widget = make_shared<ModelViewTest>(model);
+  auto tree = make_shared<Tree>(widget);
+  tree->UseStringTable();
+  Dom dom;
+  dom.ApplyFrame(tree->RenderFrame());
+
+  // New strings are listed once, in the order they are first used.
+  child->attributes["title"] = "x";
+  child->classNames = {"x", "y"};
+  widget->state->ScheduleUpdate();
+  auto frame = nlohmann::json::parse(tree->RenderFrame());
+  Expect(frame["strings"].dump(), string("[\"title\",\"x\",\"y\"]"));
+  Expect(frame["update"]["update-elements"][0]["attrs"].dump(), string("[0,1]"));
+  Expect(frame["update"]["update-elements"][0]["classes"].dump(), string("[1,2]"));
+  dom.ApplyFrame(frame);
+  Expect(dom.ToCanonicalString(false),
+         string("<div id=\"host\"><div><span title=\"x\" class=\"x y\"></span></div></div>"));
+
+  // Later frames refer to known strings by index and only send new ones.
+  child->attributes["title"] = "y";
+  child->classNames = {"y", "z"};
+  widget->state->ScheduleUpdate();
+  frame = nlohmann::json::parse(tree->RenderFrame());
+  Expect(frame["strings"].dump(), string("[\"z\"]"));
+  Expect(frame["update"]["update-elements"][0]["attrs"].dump(), string("[0,2]"));
+  Expect(frame["update"]["update-elements"][0]["classes"].dump(), string("[2,3]"));
+  dom.ApplyFrame(frame);
+  Expect(dom.ToCanonicalString(false),
+         string("<div id=\"host\"><div><span title=\"y\" class=\"y z\"></span></div></div>"));
+
+  // Long strings are not worth remembering.
+  string longTitle(StringTable::kMaxStringLength + 1, 'a');
+  child->attributes["title"] = longTitle;
+  widget->state->ScheduleUpdate();
+  frame = nlohmann::json::parse(tree->RenderFrame());
+  Expect(frame.find("strings") == frame.end(), true);
+  Expect(frame["update"]["update-elements"][0]["attrs"][1].get<string>(), longTitle);
+
+  ExpectDomMatchesFreshRender(5, 200, true);
+END_TEST
+
+TEST(TestVirtualList)
+  RenderElement::DangerouslyResetBaristaIdCounterForTesting();
+  auto viewport = make_shared<Viewport>(100, 10);
+  viewport->SetOverscan(2);
+  int rowsBuilt = 0;
+  auto list = make_shared<VirtualList>(1000, [&rowsBuilt](int index) {
+    rowsBuilt++;
+    return El("div");
+  }, viewport);
+  auto tree = make_shared<Tree>(list);
+  tree->RenderFrame();
+  auto& stats = tree->GetLastFrameStats();
+
+  // 10 visible rows, 1 partially visible row and 2 overscan rows below.
+  Expect(rowsBuilt, 13);
+  Expect(stats.GetElementsInserted(), (int64_t) 15);
+
+  // Scrolling within the same row does not rebuild.
+  tree->DispatchEvent(Event("scroll", "1", "{\"scrollTop\": 5}"));
+  tree->RenderFrame();
+  Expect(rowsBuilt, 13);
+  Expect(stats.GetStatefulBuilds(), (int64_t) 0);
+
+  // Rows 48 to 62 are now materialized; rows 0 to 12 are dropped.
+  tree->DispatchEvent(Event("scroll", "1", "{\"scrollTop\": 500}"));
+  auto diff = tree->RenderFrame();
+  Expect(viewport->GetScrollTop(), 500);
+  Expect(rowsBuilt, 28);
+  Expect(stats.GetElementsRemoved(), (int64_t) 13);
+  Expect(stats.GetElementsInserted(), (int64_t) 15);
+  Expect(diff.find("height: 480px") != string::npos, true);
+  Expect(diff.find("height: 9370px") != string::npos, true);
+
+  // Malformed scroll positions are ignored.
+  tree->DispatchEvent(Event("scroll", "1", "{\"scrollTop\": \"10\"}"));
+  tree->DispatchEvent(Event("scroll", "1", "{\"scrollTop\": null}"));
+  tree->DispatchEvent(Event("scroll", "1", "[1]"));
+  Expect(viewport->GetScrollTop(), 500);
+
+  // The viewport outlives the state, so a fresh tree resumes at the same
+  // scroll position.
+  rowsBuilt = 0;
+  auto restored = make_shared<Tree>(make_shared<VirtualList>(1000, [&rowsBuilt](int index) {
+    rowsBuilt++;
+    return El("div");
+  }, viewport));
+  restored->RenderFrame();
+  Expect(rowsBuilt, 15);
+END_TEST
+
+TEST(TestReplaceChildOfDifferentKind)
+  auto test = make_shared<BeforeAfterTest>(El("div"));
+  auto tree = make_shared<Tree>(test);
+  Dom dom;
+  dom.ApplyFrame(tree->RenderFrame());
+  vector<int> modes = {1, 2, 0, 3, 3, 1, 0, 2, 2};
+  for (size_t i = 0; i < modes.size(); i++) {
+    // The child built by the stateless widget changes kind, first in a list
+    // and then directly under the stateful widget, which itself sees its
+    // child change kind when the wrapper goes away.
+    shared_ptr<Node> next = make_shared<KindSwitchTest>(modes[i]);
+    if (i < 5) {
+      auto container = El("main");
+      container->AddChild(next);
+      next = container;
+    }
+    test->state->NextState(next);
+    test->state->ScheduleUpdate();
+    auto frame = tree->RenderFrame();
+    Expect(frame.find("\"replace\"") != string::npos, i == 0 || i == 5 || modes[i] != modes[i - 1]);
+    dom.ApplyFrame(frame);
+
+    Dom fresh;
+    fresh.ApplyFrame(make_shared<Tree>(make_shared<BeforeAfterTest>(next))->RenderFrame());
+    Expect(dom.ToCanonicalString(true), fresh.ToCanonicalString(true));
+  }
+END_TEST
+
+// A list with the counter wrapped in a [KeepAlive] under [key], if
+// [visible], followed by a span.
+shared_ptr<Node> KeepAliveTestList(bool visible, string key, shared_ptr<Node> counter) {
+  auto list = El("div");
+  if (visible) {
+    list->AddChild(make_shared<KeepAlive>(key, counter));
+  }
+  list->El("span");
+  return list;
+}
+
+TEST(TestKeepAlive)
+  auto counter = make_shared<CounterCell>();
+  auto test = make_shared<BeforeAfterTest>(KeepAliveTestList(true, "a", counter));
+  auto tree = make_shared<Tree>(test);
+  auto& stats = tree->GetLastFrameStats();
+  Dom dom;
+  dom.ApplyFrame(tree->RenderFrame());
+  counter->state->count = 5;
+  counter->state->ScheduleUpdate();
+  dom.ApplyFrame(tree->RenderFrame());
+
+  // Hiding the counter keeps it, and its DOM, around.
+  test->state->NextState(KeepAliveTestList(false, "a", counter));
+  test->state->ScheduleUpdate();
+  auto frame = tree->RenderFrame();
+  Expect(frame.find("\"keepAlive\"") != string::npos, true);
+  Expect(stats.GetElementsKeptAlive(), (int64_t) 1);
+  Expect(stats.GetElementsRemoved(), (int64_t) 0);
+  dom.ApplyFrame(frame);
+  Expect(dom.GetRoot()->GetChildNodes().size(), (size_t) 1);
+  Expect(dom.GetRoot()->GetKeptAlive().size(), (size_t) 1);
+
+  // Updates scheduled while it is hidden show when it is put back, without
+  // creating a new state or new DOM.
+  counter->state->count = 7;
+  counter->state->ScheduleUpdate();
+  test->state->NextState(KeepAliveTestList(true, "a", counter));
+  test->state->ScheduleUpdate();
+  frame = tree->RenderFrame();
+  Expect(frame.find("\"restore\"") != string::npos, true);
+  Expect(frame.find("\"html\"") != string::npos, false);
+  Expect(stats.GetElementsRestored(), (int64_t) 1);
+  Expect(stats.GetStatesCreated(), (int64_t) 0);
+  dom.ApplyFrame(frame);
+  Expect(dom.GetRoot()->GetKeptAlive().size(), (size_t) 0);
+  Expect(dom.GetRoot()->ChildAt(0)->ChildAt(0)->GetNodeValue(), string("7"));
+
+  // The counter is evicted once it has been gone for longer than allowed.
+  auto shortLived = make_shared<KeepAlive>("a", counter);
+  shortLived->SetMaxFramesKeptAlive(1);
+  auto list = El("div");
+  list->AddChild(shortLived);
+  list->El("span");
+  test->state->NextState(list);
+  test->state->ScheduleUpdate();
+  dom.ApplyFrame(tree->RenderFrame());
+  for (int i = 0; i < 3; i++) {
+    test->state->NextState(KeepAliveTestList(false, "a", counter));
+    test->state->ScheduleUpdate();
+    dom.ApplyFrame(tree->RenderFrame());
+  }
+  Expect(dom.GetRoot()->GetKeptAlive().size(), (size_t) 0);
+  test->state->NextState(KeepAliveTestList(true, "a", counter));
+  test->state->ScheduleUpdate();
+  frame = tree->RenderFrame();
+  Expect(frame.find("\"restore\"") != string::npos, false);
+  Expect(stats.GetElementsInserted(), (int64_t) 1);
+  dom.ApplyFrame(frame);
+
+END_TEST
+
+TEST(TestKeepAliveLimit)
+  auto many = El("div");
+  for (size_t i = 0; i <= RenderMultiChildParent::kMaxKeptAliveChildren; i++) {
+    many->AddChild(make_shared<KeepAlive>(to_string(i), Tx(to_string(i))));
+  }
+  auto test = make_shared<BeforeAfterTest>(many);
+  auto tree = make_shared<Tree>(test);
+  auto& stats = tree->GetLastFrameStats();
+  Dom dom;
+  dom.ApplyFrame(tree->RenderFrame());
+
+  // A parent keeps a bounded number of children alive.
+  test->state->NextState(El("div"));
+  test->state->ScheduleUpdate();
+  dom.ApplyFrame(tree->RenderFrame());
+  Expect(stats.GetElementsKeptAlive(), (int64_t) RenderMultiChildParent::kMaxKeptAliveChildren + 1);
+  Expect(stats.GetKeptAliveEvicted(), (int64_t) 1);
+  Expect(dom.GetRoot()->GetKeptAlive().size(), RenderMultiChildParent::kMaxKeptAliveChildren);
+  Expect(dom.GetRoot()->GetChildNodes().size(), (size_t) 0);
+END_TEST
+
+// Rows [first] to [last] of a table, each with a counter.
+shared_ptr<Node> PooledRows(int first, int last) {
+  auto table = El("table");
+  for (int i = first; i <= last; i++) {
+    auto row = table->El("tr");
+    row->SetKey(to_string(i));
+    if (i % 2 == 0) {
+      row->AddClassName("even");
+    }
+    row->El("td")->SetText(to_string(i));
+    row->AddChild(make_shared<CounterCell>());
+  }
+  return table;
+}
+
+TEST(TestRenderNodePool)
+  auto test = make_shared<BeforeAfterTest>(PooledRows(0, 9));
+  auto tree = make_shared<Tree>(test);
+  auto& pool = tree->GetRenderNodePool();
+  Dom dom;
+  dom.ApplyFrame(tree->RenderFrame());
+  Expect(pool.GetHits(), (int64_t) 0);
+  int64_t initialMisses = pool.GetMisses();
+
+  // Removed rows are reused by the rows added in the next frames.
+  for (int frame = 1; frame <= 3; frame++) {
+    auto next = PooledRows(frame * 3, frame * 3 + 9);
+    test->state->NextState(next);
+    test->state->ScheduleUpdate();
+    dom.ApplyFrame(tree->RenderFrame());
+
+    Dom fresh;
+    fresh.ApplyFrame(make_shared<Tree>(make_shared<BeforeAfterTest>(next))->RenderFrame());
+    Expect(dom.ToCanonicalString(true), fresh.ToCanonicalString(true));
+  }
+  // Each frame removes 3 rows of 3 elements each before adding 3, so every
+  // added element reuses a removed one.
+  Expect(pool.GetHits(), (int64_t) 27);
+  Expect(pool.GetMisses(), initialMisses);
+  Expect(pool.GetSize(), (size_t) 0);
+
+  // A stale state of a recycled row does not reach the live tree.
+  auto stale = make_shared<CounterCell>();
+  auto rows = PooledRows(0, 0);
+  static_pointer_cast<Element>(rows)->AddChild(stale);
+  test->state->NextState(rows);
+  test->state->ScheduleUpdate();
+  dom.ApplyFrame(tree->RenderFrame());
+  test->state->NextState(PooledRows(0, 0));
+  test->state->ScheduleUpdate();
+  dom.ApplyFrame(tree->RenderFrame());
+  stale->state->count = 42;
+  stale->state->ScheduleUpdate();
+  Expect(tree->RenderFrame(), string("null"));
+
+  // Without room in the pool, removed nodes are dropped.
+  pool.Clear();
+  pool.SetMaxPerTag(0);
+  test->state->NextState(PooledRows(1, 1));
+  test->state->ScheduleUpdate();
+  dom.ApplyFrame(tree->RenderFrame());
+  Expect(pool.GetSize(), (size_t) 0);
+  Expect(pool.GetDropped() > 0, true);
+END_TEST
+
+TEST(TestStateSurvivesParentRebuild)
+  auto row = [](string first, string second) {
+    auto tr = El("tr");
+    tr->AddChild(make_shared<LabelCell>(first));
+    tr->AddChild(make_shared<LabelCell>(second));
+    return tr;
+  };
+  auto test = make_shared<BeforeAfterTest>(row("a", "b"));
+  auto tree = make_shared<Tree>(test);
+  auto& stats = tree->GetLastFrameStats();
+  Dom dom;
+  dom.ApplyFrame(tree->RenderFrame());
+  shared_ptr<LabelCellState> first = nullptr;
+  tree->VisitChildren([&first](shared_ptr<RenderNode> root) {
+    root->VisitChildren([&first](shared_ptr<RenderNode> tr) {
+      tr->VisitChildren([&first](shared_ptr<RenderNode> cell) {
+        if (first == nullptr) {
+          first = static_pointer_cast<LabelCellState>(static_pointer_cast<RenderStatefulWidget>(cell)->GetState());
+        }
+      });
+    });
+  });
+  first->clicks = 3;
+  first->ScheduleUpdate();
+  dom.ApplyFrame(tree->RenderFrame());
+
+  // The parent builds new widgets. The states are kept and only the cell
+  // whose label changed is rebuilt.
+  test->state->NextState(row("a", "c"));
+  test->state->ScheduleUpdate();
+  dom.ApplyFrame(tree->RenderFrame());
+  Expect(stats.GetStatesCreated(), (int64_t) 0);
+  Expect(stats.GetStatefulBuilds(), (int64_t) 2);
+  Expect(first->builds, 2);
+  Expect(first->previousLabels.size(), (size_t) 1);
+  Expect(first->previousLabels[0], string("a"));
+
+  // A rebuild keeps what the state holds.
+  test->state->NextState(row("x", "c"));
+  test->state->ScheduleUpdate();
+  dom.ApplyFrame(tree->RenderFrame());
+  Expect(first->builds, 3);
+  Expect(dom.GetRoot()->ChildAt(0)->ChildAt(0)->GetNodeValue(), string("x: 3"));
+
+  // A widget of another class still gets a new state.
+  auto replaced = El("tr");
+  replaced->AddChild(make_shared<CounterCell>());
+  replaced->AddChild(make_shared<LabelCell>("c"));
+  test->state->NextState(replaced);
+  test->state->ScheduleUpdate();
+  dom.ApplyFrame(tree->RenderFrame());
+  Expect(stats.GetStatesCreated(), (int64_t) 1);
+END_TEST
+
+TEST(TestTemplateHtml)
+  TodoRowModel model;
+  model.key = "7";
+  model.title = "buy milk";
+  model.completed = true;
+  model.tags = {"home", "food"};
+  vector<string> eventLog;
+
+  RenderElement::DangerouslyResetBaristaIdCounterForTesting();
+  auto html = make_shared<Tree>(BuildTodoRowFromTemplate(model, eventLog))->RenderFrame();
+  RenderElement::DangerouslyResetBaristaIdCounterForTesting();
+  auto expected = make_shared<Tree>(BuildTodoRowFromElements(model))->RenderFrame();
+  Expect(html, expected);
+
+  // Unset attribute slots and empty class slots print nothing.
+  model.completed = false;
+  model.tags.clear();
+  RenderElement::DangerouslyResetBaristaIdCounterForTesting();
+  html = make_shared<Tree>(BuildTodoRowFromTemplate(model, eventLog))->RenderFrame();
+  RenderElement::DangerouslyResetBaristaIdCounterForTesting();
+  expected = make_shared<Tree>(BuildTodoRowFromElements(model))->RenderFrame();
+  Expect(html, expected);
+END_TEST
+
+TEST(TestTemplateUpdate)
+  TodoRowModel model;
+  model.key = "1";
+  model.title = "a";
+  vector<string> eventLog;
+  auto test = make_shared<BeforeAfterTest>(BuildTodoRowFromTemplate(model, eventLog));
+  auto tree = make_shared<Tree>(test);
+  tree->RenderFrame();
+
+  // Unchanged slots produce no patch.
+  test->state->NextState(BuildTodoRowFromTemplate(model, eventLog));
+  test->state->ScheduleUpdate();
+  Expect(tree->RenderFrame(), string("null"));
+
+  // Only the elements owning changed slots are visited.
+  model.title = "b";
+  model.completed = true;
+  test->state->NextState(BuildTodoRowFromTemplate(model, eventLog));
+  test->state->ScheduleUpdate();
+  auto frame = nlohmann::json::parse(tree->RenderFrame());
+  Expect(frame["update"].dump(), string(
+      "{\"classes\":[\"completed\"],\"index\":0,\"update-elements\":["
+      "{\"index\":0,\"update-elements\":["
+      "{\"attrs\":{\"checked\":\"\"},\"index\":0},{\"index\":1,\"text\":\"b\"}]},"
+      "{\"index\":1,\"update-elements\":[{\"attrs\":{\"value\":\"b\"},\"index\":0}]}]}"));
+
+  // Attributes that are no longer set are removed, and classes cleared.
+  model.completed = false;
+  model.tags = {"x"};
+  test->state->NextState(BuildTodoRowFromTemplate(model, eventLog));
+  test->state->ScheduleUpdate();
+  frame = nlohmann::json::parse(tree->RenderFrame());
+  Expect(frame["update"]["classes"].dump(), string("[\"__clear__\"]"));
+  Expect(frame["update"]["update-elements"][0].dump(), string(
+      "{\"index\":0,\"update-elements\":[{\"index\":0,\"removeAttrs\":[\"checked\"]}]}"));
+  Expect(frame["update"]["update-elements"][1]["index"].get<int>(), 2);
+  Expect(frame["update"]["update-elements"][1]["insert"].size(), (size_t) 1);
+END_TEST
+
+TEST(TestTemplateEvents)
+  RenderElement::DangerouslyResetBaristaIdCounterForTesting();
+  TodoRowModel model;
+  model.key = "1";
+  model.tags = {"x", "y"};
+  vector<string> eventLog;
+  auto test = make_shared<BeforeAfterTest>(BuildTodoRowFromTemplate(model, eventLog));
+  auto tree = make_shared<Tree>(test);
+  Dom dom;
+  dom.ApplyFrame(tree->RenderFrame());
+  auto bids = dom.GetBaristaIds();
+  ExpectVector(bids, vector<string>({"1", "2", "3", "4"}));
+
+  tree->DispatchEvent(Event("click", "1", "{}"));
+  tree->DispatchEvent(Event("keyup", "2", "{}"));
+  tree->DispatchEvent(Event("click", "2", "{}"));
+  tree->DispatchEvent(Event("click", "4", "{}"));
+  ExpectVector(eventLog, vector<string>({"toggle 1", "destroy 1", "tag y"}));
+
+  // Listeners of the latest instance are called, and IDs are kept.
+  model.key = "1";
+  model.tags = {"y"};
+  eventLog.clear();
+  vector<string> newEventLog;
+  test->state->NextState(BuildTodoRowFromTemplate(model, newEventLog));
+  test->state->ScheduleUpdate();
+  dom.ApplyFrame(tree->RenderFrame());
+  ExpectVector(dom.GetBaristaIds(), vector<string>({"1", "2", "4"}));
+  tree->DispatchEvent(Event("click", "1", "{}"));
+  tree->DispatchEvent(Event("click", "4", "{}"));
+  ExpectVector(eventLog, vector<string>());
+  ExpectVector(newEventLog, vector<string>({"toggle 1", "tag y"}));
+END_TEST
+
+TEST(TestTemplateMatchesElements)
+  mt19937 random(7);
+  vector<TodoRowModel> rows;
+  int nextKey = 0;
+  vector<string> eventLog;
+  auto buildList = [&](bool useTemplate) {
+    auto list = El("ul");
+    for (auto& row : rows) {
+      list->AddChild(useTemplate ? BuildTodoRowFromTemplate(row, eventLog) : BuildTodoRowFromElements(row));
+    }
+    return list;
+  };
+
+  auto test = make_shared<BeforeAfterTest>(buildList(true));
+  auto tree = make_shared<Tree>(test);
+  Dom dom;
+  dom.ApplyFrame(tree->RenderFrame());
+  for (int frame = 0; frame < 300; frame++) {
+    for (int i = 0; i < 3; i++) {
+      TodoRowModel* row = rows.empty() ? nullptr : &rows[random() % rows.size()];
+      switch (random() % 7) {
+        case 0:
+          rows.insert(rows.begin() + random() % (rows.size() + 1), TodoRowModel());
+          rows.back().key = to_string(nextKey++);
+          break;
+        case 1:
+          if (row != nullptr) {
+            rows.erase(rows.begin() + (row - &rows[0]));
+          }
+          break;
+        case 2:
+          if (row != nullptr) row->completed = !row->completed;
+          break;
+        case 3:
+          if (row != nullptr) row->editing = !row->editing;
+          break;
+        case 4:
+          if (row != nullptr) row->title = string(random() % 3, 'a' + random() % 3);
+          break;
+        case 5:
+          if (row != nullptr) {
+            string tag = string(1, 'a' + random() % 4);
+            auto existing = find(row->tags.begin(), row->tags.end(), tag);
+            if (existing != row->tags.end()) {
+              row->tags.erase(existing);
+            } else {
+              row->tags.insert(row->tags.begin() + random() % (row->tags.size() + 1), tag);
+            }
+          }
+          break;
+        case 6:
+          shuffle(rows.begin(), rows.end(), random);
+          break;
+      }
+    }
+    test->state->NextState(buildList(true));
+    test->state->ScheduleUpdate();
+    dom.ApplyFrame(tree->RenderFrame());
+
+    Dom fresh;
+    fresh.ApplyFrame(make_shared<Tree>(buildList(false))->RenderFrame());
+    string actual = dom.ToCanonicalString(true);
+    string expected = fresh.ToCanonicalString(true);
+    if (actual != expected) {
+      cout << "Test failed at frame " << frame << ":\n  Expected: " << expected
+           << "\n  Was:      " << actual << endl;
+      exit(1);
+    }
+  }
+END_TEST
+
+// Fires events on every node of a list of template rows in a tree using
+// barista IDs and in one using paths, and checks that the same listeners
+// are called.
+TEST(TestPathAddressedEvents)
+  mt19937 random(11);
+  vector<TodoRowModel> rows;
+  int nextKey = 0;
+  auto buildList = [&](vector<string>& eventLog) {
+    auto list = El("ul");
+    list->AddEventListener("click", [&eventLog](const Event& _) {
+      eventLog.push_back("list");
+    });
+    for (auto& row : rows) {
+      list->AddChild(BuildTodoRowFromTemplate(row, eventLog));
+    }
+    return list;
+  };
+  auto allNodes = [](Dom& dom) {
+    vector<shared_ptr<DomNode>> nodes;
+    vector<shared_ptr<DomNode>> stack = {dom.GetRoot()};
+    while (!stack.empty()) {
+      auto node = stack.back();
+      stack.pop_back();
+      nodes.push_back(node);
+      auto& children = node->GetChildNodes();
+      for (auto child = children.rbegin(); child != children.rend(); child++) {
+        stack.push_back(*child);
+      }
+    }
+    return nodes;
+  };
+
+  vector<string> bidEventLog;
+  vector<string> pathEventLog;
+  auto bidTest = make_shared<BeforeAfterTest>(buildList(bidEventLog));
+  auto pathTest = make_shared<BeforeAfterTest>(buildList(pathEventLog));
+  auto bidTree = make_shared<Tree>(bidTest);
+  auto pathTree = make_shared<Tree>(pathTest);
+  pathTree->UsePathAddressedEvents();
+  Dom bidDom;
+  Dom pathDom;
+  bidDom.ApplyFrame(bidTree->RenderFrame());
+  pathDom.ApplyFrame(pathTree->RenderFrame());
+  for (int frame = 0; frame < 100; frame++) {
+    for (int i = 0; i < 3; i++) {
+      TodoRowModel* row = rows.empty() ? nullptr : &rows[random() % rows.size()];
+      switch (random() % 4) {
+        case 0:
+          rows.insert(rows.begin() + random() % (rows.size() + 1), TodoRowModel());
+          rows.back().key = to_string(nextKey++);
+          break;
+        case 1:
+          if (row != nullptr) {
+            rows.erase(rows.begin() + (row - &rows[0]));
+          }
+          break;
+        case 2:
+          if (row != nullptr) {
+            row->tags.insert(row->tags.begin(), to_string(nextKey++));
+          }
+          break;
+        case 3:
+          shuffle(rows.begin(), rows.end(), random);
+          break;
+      }
+    }
+    bidTest->state->NextState(buildList(bidEventLog));
+    bidTest->state->ScheduleUpdate();
+    bidDom.ApplyFrame(bidTree->RenderFrame());
+    pathTest->state->NextState(buildList(pathEventLog));
+    pathTest->state->ScheduleUpdate();
+    pathDom.ApplyFrame(pathTree->RenderFrame());
+    Expect(pathDom.GetBaristaIds().size(), (size_t) 0);
+
+    auto bidNodes = allNodes(bidDom);
+    auto pathNodes = allNodes(pathDom);
+    Expect(pathNodes.size(), bidNodes.size());
+    for (size_t node = 0; node < bidNodes.size(); node++) {
+      bidTree->DispatchEvent(Event("click", bidDom.GetEventTarget(bidNodes[node]), "{}"));
+      pathTree->DispatchEvent(Event("click", pathDom.GetEventTarget(pathNodes[node]), "{}"));
+    }
+    // Every node has exactly one element with listeners nearest to it.
+    Expect(bidEventLog.size(), bidNodes.size());
+    ExpectVector(pathEventLog, bidEventLog);
+    bidEventLog.clear();
+    pathEventLog.clear();
+  }
+  // Events on the host itself, e.g. on its padding, have no path.
+  Expect(pathDom.GetEventTarget(pathDom.GetHost()), string(""));
+END_TEST
+
+// A list of todo rows built from templates, with a button that adds rows.
+class SnapshotListState : public State {
+ public:
+  vector<TodoRowModel> rows;
+  int nextKey = 0;
+  vector<string> eventLog;
+
+  void AddRow() {
+    TodoRowModel row;
+    row.key = to_string(nextKey++);
+    row.title = "Row " + row.key;
+    row.tags.push_back("tag" + row.key);
+    rows.push_back(row);
+  }
+
+  virtual shared_ptr<Node> Build() {
+    auto container = El("div");
+    auto button = container->El("button");
+    button->AddEventListener("click", [this](const Event& _) {
+      eventLog.push_back("add");
+      AddRow();
+      ScheduleUpdate();
+    });
+    auto list = container->El("ul");
+    for (auto& row : rows) {
+      list->AddChild(BuildTodoRowFromTemplate(row, eventLog));
+    }
+    return container;
+  }
+
+  // The next key and the keys of the rows; everything else is derived.
+  virtual bool SaveState(string& data) {
+    data = to_string(nextKey);
+    for (auto& row : rows) {
+      data += " " + row.key;
+    }
+    return true;
+  }
+
+  virtual void RestoreState(const string& data) {
+    istringstream in(data);
+    in >> nextKey;
+    int key;
+    int savedNextKey = nextKey;
+    while (in >> key) {
+      nextKey = key;
+      AddRow();
+    }
+    nextKey = savedNextKey;
+  }
+};
+
+class SnapshotList : public StatefulWidget {
+ public:
+  shared_ptr<SnapshotListState> state = nullptr;
+
+  virtual shared_ptr<State> CreateState() {
+    return state = make_shared<SnapshotListState>();
+  }
+};
+
+TEST(TestTreeSnapshot)
+  auto liveList = make_shared<SnapshotList>();
+  auto liveTree = make_shared<Tree>(liveList);
+  Dom liveDom;
+  liveDom.ApplyFrame(liveTree->RenderFrame());
+  for (int i = 0; i < 5; i++) {
+    liveList->state->AddRow();
+  }
+  liveList->state->rows.erase(liveList->state->rows.begin() + 2);
+  liveList->state->ScheduleUpdate();
+  liveDom.ApplyFrame(liveTree->RenderFrame());
+  auto snapshot = liveTree->TakeSnapshot();
+
+  // The first frame is the snapshot's and shows the live tree, barista IDs
+  // included.
+  auto restoredList = make_shared<SnapshotList>();
+  auto restoredTree = make_shared<Tree>(restoredList);
+  Expect(restoredTree->RestoreSnapshot(snapshot), true);
+  Dom restoredDom;
+  restoredDom.ApplyFrame(restoredTree->RenderFrame());
+  Expect(restoredDom.ToCanonicalString(false), liveDom.ToCanonicalString(false));
+  Expect(restoredList->state == nullptr, true);
+
+  // Events are dispatched to the listeners that would have received them
+  // in the live tree, and later frames are patches.
+  auto bids = liveDom.GetBaristaIds();
+  Expect(bids.size() > 5, true);
+  for (auto& bid : bids) {
+    liveTree->DispatchEvent(Event("click", bid, "{}"));
+    restoredTree->DispatchEvent(Event("click", bid, "{}"));
+  }
+  Expect(restoredTree->IsRestoredFromSnapshot(), true);
+  ExpectVector(restoredList->state->eventLog, liveList->state->eventLog);
+  auto frame = restoredTree->RenderFrame();
+  Expect(frame.find("\"create\"") == string::npos, true);
+  liveDom.ApplyFrame(liveTree->RenderFrame());
+  restoredDom.ApplyFrame(frame);
+  Expect(restoredDom.ToCanonicalString(true), liveDom.ToCanonicalString(true));
+
+  // A snapshot taken before the tree is built is the one it was restored
+  // from.
+  auto unbuiltTree = make_shared<Tree>(make_shared<SnapshotList>());
+  unbuiltTree->RestoreSnapshot(snapshot);
+  Expect(unbuiltTree->TakeSnapshot(), snapshot);
+
+  // A tree that does not build what the snapshot shows starts over with a
+  // "create" frame.
+  auto otherTree = make_shared<Tree>(El("p"));
+  otherTree->RestoreSnapshot(snapshot);
+  Dom otherDom;
+  otherDom.ApplyFrame(otherTree->RenderFrame());
+  otherDom.ApplyFrame(otherTree->RenderFrame());
+  Expect(otherTree->IsRestoredFromSnapshot(), false);
+  Expect(otherDom.ToCanonicalString(false), string("<div id=\"host\"><p></p></div>"));
+
+  // Bytes that are not a snapshot are rejected.
+  Expect(make_shared<Tree>(El("p"))->RestoreSnapshot("BTS1"), false);
+END_TEST
+
+TEST(TestHydration)
+  vector<TodoRowModel> rows(3);
+  for (size_t i = 0; i < rows.size(); i++) {
+    rows[i].key = to_string(i);
+    rows[i].title = "Row " + rows[i].key;
+    rows[i].tags.push_back("tag" + rows[i].key);
+  }
+  auto buildList = [&](vector<string>& eventLog) {
+    auto list = El("ul");
+    list->AddEventListener("click", [&eventLog](const Event& _) {
+      eventLog.push_back("list");
+    });
+    for (auto& row : rows) {
+      list->AddChild(BuildTodoRowFromTemplate(row, eventLog));
+    }
+    return list;
+  };
+
+  // The server renders the page and hashes its markup.
+  vector<string> serverEventLog;
+  auto serverTree = make_shared<Tree>(buildList(serverEventLog));
+  auto serverFrame = serverTree->RenderFrame();
+  auto serverHtml = nlohmann::json::parse(serverFrame)["create"].get<string>();
+  Dom serverDom;
+  serverDom.ApplyFrame(serverFrame);
+
+  // The client's tree numbers its elements differently and only sends those
+  // numbers.
+  vector<string> clientEventLog;
+  auto clientTest = make_shared<BeforeAfterTest>(buildList(clientEventLog));
+  auto clientTree = make_shared<Tree>(clientTest);
+  clientTree->UseHydration(HashMarkup(serverHtml));
+  Dom clientDom;
+  clientDom.GetHost()->SetInnerHtml(serverHtml);
+  auto hydrateFrame = clientTree->RenderFrame();
+  Expect(clientTree->IsHydrated(), true);
+  Expect(hydrateFrame.find("\"create\"") == string::npos, true);
+  Expect(hydrateFrame.size() < serverFrame.size() / 10, true);
+  clientDom.ApplyFrame(hydrateFrame);
+  Expect(clientDom.ToCanonicalString(true), serverDom.ToCanonicalString(true));
+  Expect(clientDom.GetBaristaIds() != serverDom.GetBaristaIds(), true);
+
+  // Events reach the same listeners as on the server, and updates apply to
+  // the hydrated markup.
+  auto serverBids = serverDom.GetBaristaIds();
+  auto clientBids = clientDom.GetBaristaIds();
+  for (size_t i = 0; i < serverBids.size(); i++) {
+    serverTree->DispatchEvent(Event("click", serverBids[i], "{}"));
+    clientTree->DispatchEvent(Event("click", clientBids[i], "{}"));
+  }
+  Expect(clientEventLog.size(), serverBids.size());
+  ExpectVector(clientEventLog, serverEventLog);
+  rows[1].completed = true;
+  clientTest->state->NextState(buildList(clientEventLog));
+  clientTest->state->ScheduleUpdate();
+  clientDom.ApplyFrame(clientTree->RenderFrame());
+  Dom freshDom;
+  freshDom.ApplyFrame(make_shared<Tree>(buildList(clientEventLog))->RenderFrame());
+  Expect(clientDom.ToCanonicalString(true), freshDom.ToCanonicalString(true));
+
+  // Markup that does not match is replaced.
+  rows.pop_back();
+  auto mismatchTree = make_shared<Tree>(buildList(clientEventLog));
+  mismatchTree->UseHydration(HashMarkup(serverHtml));
+  Expect(mismatchTree->RenderFrame().find("\"create\"") != string::npos, true);
+  Expect(mismatchTree->IsHydrated(), false);
+
+  // Only the values of barista IDs are left out of the hash.
+  vector<string> bids;
+  Expect(HashMarkup("<p _bid=\"1\">a</p>", &bids), HashMarkup("<p _bid=\"22\">a</p>"));
+  ExpectVector(bids, vector<string>({"1"}));
+  Expect(HashMarkup("<p _bid=\"1\">a</p>") != HashMarkup("<p>a</p>"), true);
+  Expect(HashMarkup("<p>a _bid=\"1\"</p>") != HashMarkup("<p>a _bid=\"2\"</p>"), true);
+END_TEST
+
+TEST(TestHtmlEscaping)
+  // Every scanner finds the first character that needs escaping, wherever
+  // it is and however long the string.
+  mt19937 random(5);
+  string specials = "&<>\"";
+  for (int scanner = kScalarHtmlScanner; scanner <= kAvx2HtmlScanner; scanner++) {
+    if (!IsHtmlScannerSupported((HtmlScanner) scanner)) {
+      continue;
+    }
+    UseHtmlScanner((HtmlScanner) scanner);
+    int misses = 0;
+    for (int size = 0; size < 100; size++) {
+      for (int position = 0; position <= size; position++) {
+        string text(size, 'a');
+        if (position < size) {
+          text[position] = specials[random() % specials.size()];
+        }
+        bool isAttribute = random() % 2 == 0;
+        size_t expected = position < size && (isAttribute || text[position] != '"') ? position : size;
+        if (FindHtmlEscape(text.data(), text.size(), isAttribute) != expected) {
+          misses++;
+        }
+      }
+    }
+    Expect(misses, 0);
+  }
+  UseHtmlScanner(GetBestHtmlScanner());
+
+  HtmlWriter writer;
+  writer.WriteText("1 < 2 & \"3\" > 0");
+  Expect(writer.GetHtml(), string("1 &lt; 2 &amp; \"3\" &gt; 0"));
+  writer.Clear();
+  writer.WriteAttributeValue("say \"<hi>\" & go");
+  Expect(writer.GetHtml(), string("say &quot;&lt;hi&gt;&quot; &amp; go"));
+
+  // Elements and templates print user content so that the client reads it
+  // back as it was.
+  TodoRowModel model;
+  model.key = "<&>";
+  model.title = "<b>\"Tom\" & Jerry</b>";
+  model.tags.push_back("a&b");
+  vector<string> eventLog;
+  RenderElement::DangerouslyResetBaristaIdCounterForTesting();
+  auto html = make_shared<Tree>(BuildTodoRowFromTemplate(model, eventLog))->RenderFrame();
+  RenderElement::DangerouslyResetBaristaIdCounterForTesting();
+  Expect(html, make_shared<Tree>(BuildTodoRowFromElements(model))->RenderFrame());
+  Dom dom;
+  dom.ApplyFrame(html);
+  auto row = dom.GetRoot();
+  Expect(row->GetAttribute("_bkey"), model.key);
+  Expect(row->ChildAt(0)->ChildAt(1)->ChildAt(0)->GetNodeValue(), model.title);
+  Expect(row->ChildAt(1)->ChildAt(0)->GetAttribute("value"), model.title);
+  Expect(row->ChildAt(2)->ChildAt(0)->GetAttribute("_bkey"), string("a&b"));
+END_TEST
+
+// Runs tasks one after another, last to first, so that results that depend
+// on the order tasks run in show up.
+class ReversingTaskRunner : public TaskRunner {
+ public:
+  int batches = 0;
+
+  virtual void RunAll(const vector<function<void()>>& tasks) {
+    batches++;
+    for (size_t i = tasks.size(); i > 0; i--) {
+      tasks[i - 1]();
+    }
+  }
+};
+
+// Serializes the same frames on one thread and split into tasks of a few
+// nodes each, which must give the same bytes.
+TEST(TestParallelSerialization)
+  mt19937 random(13);
+  vector<TodoRowModel> rows;
+  int nextKey = 0;
+  vector<string> eventLog;
+  auto buildList = [&]() {
+    auto list = El("ul");
+    for (auto& row : rows) {
+      // Both templates, whose markup is printed in one piece, and elements.
+      list->AddChild(stoi(row.key) % 2 == 0 ? BuildTodoRowFromTemplate(row, eventLog) : BuildTodoRowFromElements(row));
+    }
+    return list;
+  };
+  for (int i = 0; i < 40; i++) {
+    rows.push_back(TodoRowModel());
+    rows.back().key = to_string(nextKey++);
+    rows.back().title = "<row \"" + rows.back().key + "\" & co>";
+    rows.back().tags.push_back("t" + to_string(i % 3));
+  }
+
+  ReversingTaskRunner runner;
+  int mismatches = 0;
+  for (bool pathEvents : {false, true}) {
+    auto test = make_shared<BeforeAfterTest>(buildList());
+    auto tree = make_shared<Tree>(test);
+    TreeUpdate update;
+    update.SetPathAddressedEvents(pathEvents);
+    for (int frame = 0; frame < 100; frame++) {
+      if (frame > 0) {
+        for (int i = 0; i < 5; i++) {
+          TodoRowModel* row = &rows[random() % rows.size()];
+          switch (random() % 4) {
+            case 0: {
+              TodoRowModel inserted;
+              inserted.key = to_string(nextKey++);
+              rows.insert(rows.begin() + random() % (rows.size() + 1), inserted);
+              break;
+            }
+            case 1:
+              row->completed = !row->completed;
+              break;
+            case 2:
+              row->title = string(random() % 3, 'a' + random() % 3) + "&";
+              break;
+            case 3:
+              swap(*row, rows[random() % rows.size()]);
+              break;
+          }
+        }
+        test->state->NextState(buildList());
+        test->state->ScheduleUpdate();
+      }
+      tree->RenderFrameIntoUpdate(update);
+      update.SetParallelSerialization(nullptr, 0);
+      string serial = update.Render();
+      update.SetParallelSerialization(&runner, 4);
+      if (update.Render() != serial) {
+        mismatches++;
+      }
+    }
+  }
+  Expect(mismatches, 0);
+  Expect(runner.batches > 0, true);
+END_TEST
+
+// Schedules a keystroke-like urgent update along with background updates of
+// a table's cells, and checks that the urgent one is rendered right away
+// while the others are spread over frames within the budget.
+TEST(TestUpdatePriorities)
+  auto tr = El("tr");
+  for (int i = 0; i < 6; i++) {
+    tr->AddChild(make_shared<LabelCell>(to_string(i)));
+  }
+  auto tree = make_shared<Tree>(make_shared<BeforeAfterTest>(tr));
+  auto& stats = tree->GetLastFrameStats();
+  Dom dom;
+  dom.ApplyFrame(tree->RenderFrame());
+  vector<shared_ptr<LabelCellState>> cells;
+  tree->VisitChildren([&cells](shared_ptr<RenderNode> root) {
+    root->VisitChildren([&cells](shared_ptr<RenderNode> tr) {
+      tr->VisitChildren([&cells](shared_ptr<RenderNode> cell) {
+        cells.push_back(static_pointer_cast<LabelCellState>(static_pointer_cast<RenderStatefulWidget>(cell)->GetState()));
+      });
+    });
+  });
+  Expect(cells.size(), (size_t) 6);
+
+  // With no budget, one background update is started per frame.
+  tree->SetBackgroundBudget(0);
+  for (int i = 1; i < 6; i++) {
+    cells[i]->clicks++;
+    cells[i]->ScheduleUpdate(kBackgroundUpdate);
+  }
+  cells[0]->clicks++;
+  cells[0]->ScheduleUpdate();
+  Expect(tree->HasBackgroundUpdates(), true);
+  dom.ApplyFrame(tree->RenderFrame());
+  Expect(stats.GetUpdatesRendered(kUrgentUpdate), (int64_t) 1);
+  Expect(stats.GetUpdatesRendered(kBackgroundUpdate), (int64_t) 1);
+  Expect(stats.GetBackgroundUpdatesDeferred(), (int64_t) 4);
+  Expect(cells[0]->builds, 2);
+  Expect(cells[1]->builds, 2);
+  Expect(cells[2]->builds, 1);
+
+  // An urgent update of a cell waiting in the background lane renders it
+  // right away, and takes it out of the queue.
+  cells[3]->ScheduleUpdate();
+  dom.ApplyFrame(tree->RenderFrame());
+  Expect(stats.GetUpdatesRendered(kUrgentUpdate), (int64_t) 1);
+  Expect(stats.GetUpdatesRendered(kBackgroundUpdate), (int64_t) 2);
+  Expect(stats.GetBackgroundUpdatesDeferred(), (int64_t) 2);
+  Expect(cells[3]->builds, 2);
+
+  int frames = 0;
+  while (tree->HasBackgroundUpdates()) {
+    dom.ApplyFrame(tree->RenderFrame());
+    frames++;
+  }
+  Expect(frames, 2);
+  for (auto& cell : cells) {
+    Expect(cell->builds, 2);
+  }
+  Expect(dom.GetRoot()->ChildAt(5)->ChildAt(0)->GetNodeValue(), string("5: 1"));
+
+  auto& urgent = tree->GetUpdateLatencies(kUrgentUpdate);
+  auto& background = tree->GetUpdateLatencies(kBackgroundUpdate);
+  Expect(urgent.GetCount(), (int64_t) 2);
+  Expect(urgent.GetMaxFramesDeferred(), (int64_t) 0);
+  Expect(background.GetCount(), (int64_t) 5);
+  Expect(background.GetMaxFramesDeferred(), (int64_t) 3);
+
+  // Cells this cheap all fit into the default budget.
+  tree->SetBackgroundBudget(Tree::kDefaultBackgroundBudgetMicros);
+  background.Clear();
+  for (int i = 0; i < 6; i++) {
+    cells[i]->clicks++;
+    cells[i]->ScheduleUpdate(kBackgroundUpdate);
+  }
+  dom.ApplyFrame(tree->RenderFrame());
+  Expect(stats.GetUpdatesRendered(kBackgroundUpdate), (int64_t) 6);
+  Expect(tree->HasBackgroundUpdates(), false);
+  Expect(background.GetMaxFramesDeferred(), (int64_t) 0);
+END_TEST
+
 void TestChildListDiffing() {
   // Adding things
   TestListDiffAppendChild();
@@ -751,6 +2476,7 @@ void TestChildListDiffing() {
 
   // Moving things
   TestListDiffSwap();
+  TestListDiffInsertBeforeMovedChild();
 }
 
 void TestKeyedHtmlDiffing() {
@@ -778,6 +2504,7 @@ int main() {
   TestDetachedSubTreesDoNotLeakMemory();
   TestSyncerCreate();
   TestSyncerUpdate();
+  TestTextNodeHtml();
   TestPrintTag();
   TestPrintText();
   TestPrintElementWithChildren();
@@ -794,6 +2521,33 @@ int main() {
   TestPreserveEventListeners();
   TestDispatchEvent();
   TestChildListDiffing();
+  TestFrameAllocationBudget();
+  TestSparseChildUpdates();
+  TestDirtyChildTracking();
+  TestTreeUpdateReuse();
+  TestTraceEvents();
+  TestFrameStats();
+  TestRecordAndReplay();
+  TestReplayEncoding();
+  TestDomParseHtml();
+  TestDomMatchesFreshRender();
+  TestStringTable();
+  TestVirtualList();
+  TestReplaceChildOfDifferentKind();
+  TestKeepAlive();
+  TestKeepAliveLimit();
+  TestRenderNodePool();
+  TestStateSurvivesParentRebuild();
+  TestTemplateHtml();
+  TestTemplateUpdate();
+  TestTemplateEvents();
+  TestTemplateMatchesElements();
+  TestPathAddressedEvents();
+  TestTreeSnapshot();
+  TestHydration();
+  TestHtmlEscaping();
+  TestParallelSerialization();
+  TestUpdatePriorities();
   cout << "End tests" << endl;
   return 0;
 }
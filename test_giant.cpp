@@ -1,3 +1,4 @@
+#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <vector>
@@ -5,8 +6,10 @@
 #include <chrono>
 
 #include "api.h"
+#include "dom.h"
 #include "test.h"
 #include "giant_widgets.h"
+#include "server.h"
 
 using namespace std;
 using namespace std::chrono;
@@ -16,37 +19,56 @@ class WrapperState : public State {
  public:
   bool visible = true;
 
-  WrapperState() : State() { };
+  WrapperState(bool keepAlive) : State(), _keepAlive(keepAlive) { };
 
   virtual shared_ptr<Node> Build() {
     auto container = El("div");
     if (visible) {
-      container->AddChild(make_shared<SampleApp>());
+      if (_keepAlive) {
+        // The same app instance each time, so that it is not rebuilt when
+        // it is put back.
+        container->AddChild(make_shared<KeepAlive>("app", _app));
+      } else {
+        container->AddChild(make_shared<SampleApp>());
+      }
     }
     return container;
   }
+
+ private:
+  bool _keepAlive;
+  shared_ptr<SampleApp> _app = make_shared<SampleApp>();
 };
 
 class Wrapper : public StatefulWidget {
  public:
   shared_ptr<WrapperState> state = nullptr;
 
-  Wrapper() : StatefulWidget() {}
+  Wrapper(bool keepAlive) : StatefulWidget(), _keepAlive(keepAlive) {}
 
   virtual shared_ptr<State> CreateState() {
-    return state = make_shared<WrapperState>();
+    return state = make_shared<WrapperState>(_keepAlive);
   }
+
+ private:
+  bool _keepAlive;
 };
 
+// When set, a Chrome trace of the run is written to this path.
+string traceOutputPath = "";
+
 TEST(TestBootstrapGiantApp)
   auto before_boot = system_clock::now();
   cout << "In main " << duration_cast<milliseconds>(before_boot.time_since_epoch()).count() << endl;
-  auto wrapper = make_shared<Wrapper>();
+  auto wrapper = make_shared<Wrapper>(false);
   auto tree = make_shared<Tree>(wrapper);
+  tree->SetTracing(traceOutputPath != "");
   auto html = tree->RenderFrame();
   auto after_boot = system_clock::now();
   duration<double> delta = after_boot - before_boot;
   cout << "Bootstrap time: " << delta.count() * 1000 << "ms; tree size: " << html.size() << " chars" << endl;
+  cout << "  allocations: " << tree->GetLastFrameAllocations().ToString() << endl;
+  cout << "  stats: " << tree->GetLastFrameStats().ToJson() << endl;
 
   for (int flip = 1; flip <= 10; flip++) {
     auto before_flip = system_clock::now();
@@ -56,12 +78,160 @@ TEST(TestBootstrapGiantApp)
     auto after_flip = system_clock::now();
     duration<double> delta = after_flip - before_flip;
     cout << "Flip #" << flip << " took: " << delta.count() * 1000 << "ms; tree size: " << html.size() << " chars" << endl;
+    cout << "  allocations: " << tree->GetLastFrameAllocations().ToString() << endl;
+    cout << "  stats: " << tree->GetLastFrameStats().ToJson() << endl;
+  }
+
+  if (tree->IsTracing()) {
+    ofstream traceFile(traceOutputPath);
+    traceFile << tree->DumpTrace();
+    cout << "Trace written to " << traceOutputPath << endl;
+  }
+END_TEST
+
+// Flips the app with and without a string table and compares frame sizes.
+TEST(TestGiantAppStringTable)
+  for (bool useStringTable : {false, true}) {
+    auto wrapper = make_shared<Wrapper>(false);
+    auto tree = make_shared<Tree>(wrapper);
+    if (useStringTable) {
+      tree->UseStringTable();
+    }
+    size_t bootstrapBytes = tree->RenderFrame().size();
+    size_t flipBytes = 0;
+    for (int flip = 1; flip <= 10; flip++) {
+      wrapper->state->visible = !wrapper->state->visible;
+      wrapper->state->ScheduleUpdate();
+      flipBytes += tree->RenderFrame().size();
+    }
+    cout << (useStringTable ? "With" : "Without") << " string table: bootstrap "
+         << bootstrapBytes << " chars; flips " << flipBytes / 10 << " chars per frame" << endl;
+  }
+END_TEST
+
+// Flips the app wrapped in a [KeepAlive], so that it is hidden and put back
+// rather than thrown away and rebuilt.
+TEST(TestGiantAppKeepAlive)
+  auto wrapper = make_shared<Wrapper>(true);
+  auto tree = make_shared<Tree>(wrapper);
+  tree->RenderFrame();
+  for (int flip = 1; flip <= 10; flip++) {
+    auto before_flip = system_clock::now();
+    wrapper->state->visible = !wrapper->state->visible;
+    wrapper->state->ScheduleUpdate();
+    auto html = tree->RenderFrame();
+    duration<double> delta = system_clock::now() - before_flip;
+    cout << "Kept-alive flip #" << flip << " took: " << delta.count() * 1000 << "ms; tree size: "
+         << html.size() << " chars" << endl;
+    cout << "  stats: " << tree->GetLastFrameStats().ToJson() << endl;
   }
 END_TEST
 
-int main() {
+// Rebuilds the wrapper, which passes a new app widget down the tree. States
+// are kept, and only those whose inputs changed rebuild.
+TEST(TestGiantAppParentRebuild)
+  auto wrapper = make_shared<Wrapper>(false);
+  auto tree = make_shared<Tree>(wrapper);
+  tree->RenderFrame();
+  for (int rebuild = 1; rebuild <= 5; rebuild++) {
+    auto before_rebuild = system_clock::now();
+    wrapper->state->ScheduleUpdate();
+    auto html = tree->RenderFrame();
+    duration<double> delta = system_clock::now() - before_rebuild;
+    cout << "Parent rebuild #" << rebuild << " took: " << delta.count() * 1000 << "ms; tree size: "
+         << html.size() << " chars" << endl;
+    cout << "  stats: " << tree->GetLastFrameStats().ToJson() << endl;
+  }
+END_TEST
+
+// Compares the time to the first frame of a fresh tree with that of a tree
+// restored from a snapshot, and the cost of the restored tree's build.
+TEST(TestGiantAppSnapshot)
+  auto liveTree = make_shared<Tree>(make_shared<Wrapper>(false));
+  auto before_cold = system_clock::now();
+  liveTree->RenderFrame();
+  duration<double> cold = system_clock::now() - before_cold;
+  auto snapshot = liveTree->TakeSnapshot();
+
+  auto restoredTree = make_shared<Tree>(make_shared<Wrapper>(false));
+  auto before_restore = system_clock::now();
+  restoredTree->RestoreSnapshot(snapshot);
+  auto html = restoredTree->RenderFrame();
+  duration<double> restore = system_clock::now() - before_restore;
+  auto before_build = system_clock::now();
+  auto frame = restoredTree->RenderFrame();
+  duration<double> build = system_clock::now() - before_build;
+  cout << "Snapshot: " << snapshot.size() << " bytes; first frame " << cold.count() * 1000 << "ms cold, "
+       << restore.count() * 1000 << "ms restored; build after restoring " << build.count() * 1000 << "ms, "
+       << (restoredTree->IsRestoredFromSnapshot() ? "matched" : "did not match") << ", next frame "
+       << frame.size() << " chars" << endl;
+END_TEST
+
+// Compares starting a client from a "create" frame with hydrating markup the
+// server rendered, counting both rendering the first frame and applying it.
+TEST(TestGiantAppHydration)
+  auto serverFrame = make_shared<Tree>(make_shared<Wrapper>(false))->RenderFrame();
+  auto serverHtml = nlohmann::json::parse(serverFrame)["create"].get<string>();
+  auto serverMarkupHash = HashMarkup(serverHtml);
+
+  for (bool hydrate : {false, true}) {
+    Dom dom;
+    dom.GetHost()->SetInnerHtml(serverHtml);
+    auto tree = make_shared<Tree>(make_shared<Wrapper>(false));
+    if (hydrate) {
+      tree->UseHydration(serverMarkupHash);
+    }
+    auto before_render = system_clock::now();
+    auto frame = tree->RenderFrame();
+    auto after_render = system_clock::now();
+    dom.ApplyFrame(frame);
+    auto after_apply = system_clock::now();
+    duration<double> render = after_render - before_render;
+    duration<double> apply = after_apply - after_render;
+    cout << (hydrate ? "Hydrated" : "Created") << " first frame: render " << render.count() * 1000
+         << "ms, apply " << apply.count() * 1000 << "ms, " << frame.size() << " chars"
+         << (hydrate && !tree->IsHydrated() ? " (markup did not match)" : "") << endl;
+  }
+END_TEST
+
+// Compares serializing the first frame on one thread with serializing it on
+// thread pools of several sizes.
+TEST(TestGiantAppParallelSerialization)
+  auto tree = make_shared<Tree>(make_shared<Wrapper>(false));
+  TreeUpdate update;
+  tree->RenderFrameIntoUpdate(update);
+  auto before_serial = system_clock::now();
+  auto serial = update.Render();
+  duration<double> serialTime = system_clock::now() - before_serial;
+  cout << "Serialized first frame on one thread: " << serialTime.count() * 1000 << "ms, " << serial.size()
+       << " chars" << endl;
+  for (int threadCount : {2, 4, 8}) {
+    // The rendering thread takes part in serializing too.
+    ThreadPool pool(threadCount - 1);
+    update.SetParallelSerialization(&pool, 2000);
+    auto before_parallel = system_clock::now();
+    auto parallel = update.Render();
+    duration<double> parallelTime = system_clock::now() - before_parallel;
+    cout << "  on " << threadCount << " threads: " << parallelTime.count() * 1000 << "ms"
+         << (parallel == serial ? "" : " (frames differ)") << endl;
+  }
+  update.SetParallelSerialization(nullptr, 0);
+END_TEST
+
+int main(int argc, char** argv) {
+  if (argc > 1) {
+    traceOutputPath = argv[1];
+  }
   cout << "Start tests" << endl;
+  // See the --templates flag of bin/make_giant.dart.
+  cout << "Widgets built from " << (kGiantAppUsesTemplates ? "element templates" : "elements") << endl;
   TestBootstrapGiantApp();
+  TestGiantAppStringTable();
+  TestGiantAppKeepAlive();
+  TestGiantAppParentRebuild();
+  TestGiantAppSnapshot();
+  TestGiantAppHydration();
+  TestGiantAppParallelSerialization();
   cout << "End tests" << endl;
   return 0;
 }
@@ -0,0 +1,346 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <list>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "api.h"
+#include "html.h"
+#include "test.h"
+#include "lib/json/src/json.hpp"
+
+using namespace std;
+using namespace std::chrono;
+using namespace barista;
+
+// Stress tests and benchmarks for the child list diff in
+// `RenderMultiChildParent::Update`.
+//
+// Each case renders a list of <span k="label"> children, mutates the list
+// randomly, renders again, and then applies the resulting patch to a plain
+// vector of labels the way sync.js applies it to the DOM. The result must
+// equal the new list, and the number of moves must be minimal, i.e. equal to
+// the number of retained children minus the length of their longest
+// increasing subsequence.
+
+class ListDiffState : public State {
+ public:
+  vector<string> labels;
+  bool keyed = true;
+
+  virtual shared_ptr<Node> Build() {
+    auto container = El("div");
+    for (auto& label : labels) {
+      auto child = container->El("span");
+      child->SetAttribute("k", label);
+      if (keyed) {
+        child->SetKey(label);
+      }
+    }
+    return container;
+  }
+};
+
+class ListDiff : public StatefulWidget {
+ public:
+  shared_ptr<ListDiffState> state = nullptr;
+
+  virtual shared_ptr<State> CreateState() {
+    return state = make_shared<ListDiffState>();
+  }
+};
+
+// Extracts the labels of the children printed into [html], in order.
+vector<string> ParseLabels(const string& html) {
+  vector<string> labels;
+  const string marker = " k=\"";
+  size_t pos = html.find(marker);
+  while (pos != string::npos) {
+    size_t start = pos + marker.size();
+    size_t end = html.find('"', start);
+    labels.push_back(html.substr(start, end - start));
+    pos = html.find(marker, end);
+  }
+  return labels;
+}
+
+// Applies a root element update to the children of the root, mirroring
+// `applyElementUpdate` in sync.js: all referenced children are looked up by
+// their index before any mutation.
+void ApplyChildListPatch(vector<string>& labels, const nlohmann::json& update) {
+  list<string> children(labels.begin(), labels.end());
+  vector<list<string>::iterator> byIndex;
+  for (auto child = children.begin(); child != children.end(); child++) {
+    byIndex.push_back(child);
+  }
+  auto item = [&](int index) {
+    return index < (int) byIndex.size() ? byIndex[index] : children.end();
+  };
+
+  if (update.find("update-elements") != update.end()) {
+    for (auto& childUpdate : update["update-elements"]) {
+      auto attrs = childUpdate.find("attrs");
+      if (attrs != childUpdate.end() && attrs->find("k") != attrs->end()) {
+        *item(childUpdate["index"].get<int>()) = (*attrs)["k"].get<string>();
+      }
+    }
+  }
+
+  vector<list<string>::iterator> removes;
+  if (update.find("remove") != update.end()) {
+    for (auto& index : update["remove"]) {
+      removes.push_back(item(index.get<int>()));
+    }
+  }
+  vector<list<string>::iterator> moves;
+  if (update.find("move") != update.end()) {
+    for (auto& index : update["move"]) {
+      moves.push_back(item(index.get<int>()));
+    }
+  }
+  vector<tuple<string, list<string>::iterator, size_t>> insertions;
+  if (update.find("insert") != update.end()) {
+    for (auto& insertion : update["insert"]) {
+      auto inserted = ParseLabels(insertion["html"].get<string>());
+      Expect(inserted.size(), (size_t) 1);
+      size_t movesBefore = 0;
+      if (insertion.find("movesBefore") != insertion.end()) {
+        movesBefore = insertion["movesBefore"].get<size_t>();
+      }
+      insertions.push_back({inserted[0], item(insertion["index"].get<int>()), movesBefore});
+    }
+  }
+
+  for (auto removed : removes) {
+    children.erase(removed);
+  }
+  size_t appliedMoves = 0;
+  auto applyMovesUpTo = [&](size_t count) {
+    for (; appliedMoves < count; appliedMoves++) {
+      children.splice(moves[2 * appliedMoves], children, moves[2 * appliedMoves + 1]);
+    }
+  };
+  for (auto& insertion : insertions) {
+    applyMovesUpTo(get<2>(insertion));
+    children.insert(get<1>(insertion), get<0>(insertion));
+  }
+  applyMovesUpTo(moves.size() / 2);
+
+  labels.assign(children.begin(), children.end());
+}
+
+// Length of the longest strictly increasing subsequence, computed
+// independently of `ComputeLongestIncreasingSubsequence`.
+int64_t LisLength(const vector<int>& sequence) {
+  vector<int> tails;
+  for (int value : sequence) {
+    auto pos = lower_bound(tails.begin(), tails.end(), value);
+    if (pos == tails.end()) {
+      tails.push_back(value);
+    } else {
+      *pos = value;
+    }
+  }
+  return (int64_t) tails.size();
+}
+
+enum Mutation {
+  kShuffle,
+  kReverse,
+  kSwapPairs,
+  kInsertRandom,
+  kRemoveRandom,
+  kMixed,
+};
+
+const char* MutationName(Mutation mutation) {
+  switch (mutation) {
+    case kShuffle: return "shuffle";
+    case kReverse: return "reverse";
+    case kSwapPairs: return "swap-pairs";
+    case kInsertRandom: return "insert";
+    case kRemoveRandom: return "remove";
+    case kMixed: return "mixed";
+  }
+  return "?";
+}
+
+vector<string> Mutate(vector<string> labels, Mutation mutation, mt19937& random, int& nextLabel) {
+  auto fresh = [&]() { return "n" + to_string(nextLabel++); };
+  auto chance = [&](int percent) { return (int) (random() % 100) < percent; };
+  int n = (int) labels.size();
+  switch (mutation) {
+    case kShuffle:
+      shuffle(labels.begin(), labels.end(), random);
+      break;
+    case kReverse:
+      reverse(labels.begin(), labels.end());
+      break;
+    case kSwapPairs:
+      for (int i = 0; i < n / 100 + 1 && n > 1; i++) {
+        swap(labels[random() % n], labels[random() % n]);
+      }
+      break;
+    case kInsertRandom: {
+      vector<string> result;
+      for (auto& label : labels) {
+        if (chance(10)) {
+          result.push_back(fresh());
+        }
+        result.push_back(label);
+      }
+      result.push_back(fresh());
+      labels = result;
+      break;
+    }
+    case kRemoveRandom: {
+      vector<string> result;
+      for (auto& label : labels) {
+        if (!chance(10)) {
+          result.push_back(label);
+        }
+      }
+      labels = result;
+      break;
+    }
+    case kMixed: {
+      vector<string> result;
+      for (auto& label : labels) {
+        if (chance(5)) {
+          continue;
+        }
+        if (chance(5)) {
+          result.push_back(fresh());
+        }
+        result.push_back(label);
+      }
+      for (int i = 0; i < (int) result.size() / 20 && result.size() > 1; i++) {
+        swap(result[random() % result.size()], result[random() % result.size()]);
+      }
+      labels = result;
+      break;
+    }
+  }
+  return labels;
+}
+
+struct DiffResult {
+  double millis;
+  size_t patchBytes;
+  int64_t moves;
+};
+
+// Renders [before], then [after], checks the patch and reports its cost.
+DiffResult CheckDiff(vector<string> before, vector<string> after, bool keyed) {
+  auto widget = make_shared<ListDiff>();
+  auto tree = make_shared<Tree>(widget);
+  tree->RenderFrame();
+  widget->state->keyed = keyed;
+  widget->state->labels = before;
+  widget->state->ScheduleUpdate();
+  auto created = nlohmann::json::parse(tree->RenderFrame());
+  vector<string> dom;
+  if (!before.empty()) {
+    ApplyChildListPatch(dom, created["update"]);
+  }
+  Expect(dom == before, true);
+
+  widget->state->labels = after;
+  widget->state->ScheduleUpdate();
+  auto start = steady_clock::now();
+  auto patch = tree->RenderFrame();
+  duration<double> elapsed = steady_clock::now() - start;
+
+  auto js = nlohmann::json::parse(patch);
+  if (js.find("update") != js.end()) {
+    ApplyChildListPatch(dom, js["update"]);
+  }
+  if (dom != after) {
+    cout << "FAILED: patched child list differs from the target list" << endl;
+    exit(1);
+  }
+
+  auto& stats = tree->GetLastFrameStats();
+  int64_t retained = 0;
+  if (keyed) {
+    map<string, int> oldIndex;
+    for (int i = 0; i < (int) before.size(); i++) {
+      oldIndex[before[i]] = i;
+    }
+    vector<int> sequence;
+    for (auto& label : after) {
+      auto entry = oldIndex.find(label);
+      if (entry != oldIndex.end()) {
+        sequence.push_back(entry->second);
+      }
+    }
+    retained = (int64_t) sequence.size();
+    if (stats.GetElementsMoved() != retained - LisLength(sequence)) {
+      cout << "FAILED: " << stats.GetElementsMoved() << " moves, expected "
+           << retained - LisLength(sequence) << endl;
+      exit(1);
+    }
+  } else {
+    // Unkeyed children of the same tag are matched by position.
+    retained = (int64_t) min(before.size(), after.size());
+    Expect(stats.GetElementsMoved(), (int64_t) 0);
+  }
+  Expect(stats.GetElementsRemoved(), (int64_t) before.size() - retained);
+  Expect(stats.GetElementsInserted(), (int64_t) after.size() - retained);
+
+  return {elapsed.count() * 1000, patch.size(), stats.GetElementsMoved()};
+}
+
+vector<string> MakeLabels(int n, int& nextLabel) {
+  vector<string> labels;
+  for (int i = 0; i < n; i++) {
+    labels.push_back("n" + to_string(nextLabel++));
+  }
+  return labels;
+}
+
+const Mutation kMutations[] = {kShuffle, kReverse, kSwapPairs, kInsertRandom, kRemoveRandom, kMixed};
+
+TEST(TestRandomListDiffs)
+  mt19937 random(42);
+  int nextLabel = 0;
+  int cases = 0;
+  for (int round = 0; round < 50; round++) {
+    int n = (int) (random() % 200);
+    for (Mutation mutation : kMutations) {
+      for (bool keyed : {true, false}) {
+        auto before = MakeLabels(n, nextLabel);
+        auto after = Mutate(before, mutation, random, nextLabel);
+        CheckDiff(before, after, keyed);
+        cases++;
+      }
+    }
+  }
+  cout << cases << " random diffs verified" << endl;
+END_TEST
+
+TEST(BenchmarkLargeListDiffs)
+  mt19937 random(7);
+  for (int n : {1000, 10000, 100000}) {
+    for (Mutation mutation : kMutations) {
+      for (bool keyed : {true, false}) {
+        int nextLabel = 0;
+        auto before = MakeLabels(n, nextLabel);
+        auto after = Mutate(before, mutation, random, nextLabel);
+        auto result = CheckDiff(before, after, keyed);
+        cout << n << " " << (keyed ? "keyed" : "unkeyed") << " " << MutationName(mutation)
+             << ": " << result.millis << "ms ("
+             << result.millis * 1000000 / n << "ns/child), patch "
+             << result.patchBytes << " bytes, " << result.moves << " moves" << endl;
+      }
+    }
+  }
+END_TEST
+
+int main() {
+  TestRandomListDiffs();
+  BenchmarkLargeListDiffs();
+  return 0;
+}
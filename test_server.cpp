@@ -0,0 +1,141 @@
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "api.h"
+#include "html.h"
+#include "server.h"
+#include "sync.h"
+#include "test.h"
+
+using namespace std;
+using namespace barista;
+
+// Tests of libserver, which uses sockets and threads and is therefore not
+// part of the emscripten builds that test_all.cpp is compiled into.
+
+class EventListenerTest : public StatelessWidget {
+ public:
+  EventListenerTest() : StatelessWidget() {}
+  shared_ptr<Node> Build() {
+    auto div = make_shared<Element>("div");
+    auto btn = make_shared<Element>("button");
+    btn->AddEventListener("click", [this](const Event& _) {
+      eventLog.push_back("click");
+    });
+    div->AddChild(btn);
+    return div;
+  }
+
+  vector<string> eventLog;
+};
+
+TEST(TestRendererSession)
+  RenderElement::DangerouslyResetBaristaIdCounterForTesting();
+  auto widget = make_shared<EventListenerTest>();
+  int toServer[2];
+  int toClient[2];
+  Expect(socketpair(AF_UNIX, SOCK_STREAM, 0, toServer), 0);
+  Expect(socketpair(AF_UNIX, SOCK_STREAM, 0, toClient), 0);
+  RendererSession session(make_shared<Tree>(widget), toServer[1], toClient[1]);
+  thread server([&session] { session.Run(); });
+
+  // Events are sent without waiting for frames.
+  WriteMessage(toServer[0], EncodeEventMessage("click", "1", "{}"));
+  WriteMessage(toServer[0], "malformed");
+  WriteMessage(toServer[0], EncodeEventMessage("click", "1", "{not json"));
+  WriteMessage(toServer[0], EncodeEventMessage("click", "does not exist", "{}"));
+  WriteMessage(toServer[0], EncodeEventMessage("click", "1", "{\"x\": 1}"));
+  close(toServer[0]);
+
+  string message;
+  int64_t eventsDispatched = -1;
+  string frame;
+  Expect(ReadMessage(toClient[0], message), true);
+  Expect(DecodeFrameMessage(message, eventsDispatched, frame), true);
+  Expect(eventsDispatched, (int64_t) 0);
+  Expect(frame, string("{\"create\":\"<div><button _bid=\\\"1\\\"></button></div>\"}"));
+  int64_t frames = 1;
+  while (eventsDispatched < 3) {
+    Expect(ReadMessage(toClient[0], message), true);
+    Expect(DecodeFrameMessage(message, eventsDispatched, frame), true);
+    Expect(frame, string("null"));
+    frames++;
+  }
+  server.join();
+  Expect(eventsDispatched, (int64_t) 3);
+  Expect(session.GetEventCount(), (int64_t) 3);
+  Expect(session.GetFrameCount(), frames);
+  ExpectVector(widget->eventLog, vector<string>({"click", "click"}));
+  close(toServer[1]);
+  close(toClient[0]);
+  close(toClient[1]);
+
+  // A message announced as longer than the limit ends the stream rather than
+  // being allocated.
+  int oversized[2];
+  Expect(socketpair(AF_UNIX, SOCK_STREAM, 0, oversized), 0);
+  unsigned char header[4] = {0xff, 0xff, 0xff, 0xff};
+  Expect(write(oversized[0], header, 4), (ssize_t) 4);
+  Expect(ReadMessage(oversized[1], message), false);
+  close(oversized[0]);
+  close(oversized[1]);
+END_TEST
+
+// Hands batches of tasks to a pool from several threads at once, and
+// serializes a wide frame using it.
+TEST(TestThreadPool)
+  ThreadPool pool(3);
+  Expect(pool.GetThreadCount(), 3);
+  vector<atomic<int>> runs(400);
+  for (auto& count : runs) {
+    count = 0;
+  }
+  auto submit = [&pool, &runs](size_t first) {
+    for (int batch = 0; batch < 50; batch++) {
+      vector<function<void()>> tasks;
+      for (size_t i = first; i < first + 200; i += 10) {
+        tasks.push_back([&runs, i] {
+          for (size_t j = i; j < i + 10; j++) {
+            runs[j]++;
+          }
+        });
+      }
+      pool.RunAll(tasks);
+    }
+  };
+  thread other(submit, 200);
+  submit(0);
+  other.join();
+  int wrongCounts = 0;
+  for (auto& count : runs) {
+    if (count != 50) {
+      wrongCounts++;
+    }
+  }
+  Expect(wrongCounts, 0);
+
+  auto table = El("table");
+  for (int i = 0; i < 500; i++) {
+    auto row = table->El("tr");
+    row->SetKey(to_string(i));
+    row->El("td")->SetText("<" + to_string(i) + ">");
+    row->El("td")->SetAttribute("title", "\"" + to_string(i) + "\"");
+  }
+  TreeUpdate update;
+  make_shared<Tree>(table)->RenderFrameIntoUpdate(update);
+  string serial = update.Render();
+  update.SetParallelSerialization(&pool, 50);
+  Expect(update.Render() == serial, true);
+END_TEST
+
+int main() {
+  cout << "Start tests" << endl;
+  TestRendererSession();
+  TestThreadPool();
+  cout << "End tests" << endl;
+  return 0;
+}
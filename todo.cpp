@@ -1,7 +1,9 @@
 #include <iostream>
+#include <ctime>
 #include <emscripten/emscripten.h>
 
 #include "api.h"
+#include "record.h"
 #include "todo_widgets.h"
 
 using namespace std;
@@ -12,6 +14,8 @@ shared_ptr<Tree> tree;
 // This is intentionally static so that the string is not
 // destroyed after it is returned to the JS side.
 string lastDiff;
+string lastFrameStats;
+string sessionRecording;
 
 extern "C" {
 
@@ -20,6 +24,17 @@ const char* RenderFrame() {
   return lastDiff.c_str();
 }
 
+const char* GetLastFrameStats() {
+  lastFrameStats = tree->GetLastFrameStats().ToJson();
+  return lastFrameStats.c_str();
+}
+
+// Base64-encoded session recording, for `replay todo <file>`.
+const char* GetSessionRecording() {
+  sessionRecording = EncodeBase64(tree->GetRecorder()->GetLog().Serialize());
+  return sessionRecording.c_str();
+}
+
 void DispatchEvent(char* type, char* baristaId, char* data) {
   auto event = Event(type, baristaId, data);
   tree->DispatchEvent(event);
@@ -30,6 +45,7 @@ int main() {
       enteredMain();
   );
   tree = make_shared<Tree>(make_shared<TodoApp>());
+  tree->StartRecording((uint32_t) time(nullptr));
   EM_ASM(
     allReady();
   );
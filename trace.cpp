@@ -0,0 +1,126 @@
+#include "trace.h"
+#include "lib/json/src/json.hpp"
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#if defined(__GNUC__) || defined(__clang__)
+#include <cxxabi.h>
+#include <cstdlib>
+#endif
+
+namespace barista {
+
+namespace {
+
+mutex _registryMutex;
+
+// Buffers are never freed so that events recorded by threads that have since
+// exited can still be dumped.
+vector<TraceBuffer*>& _buffers() {
+  static vector<TraceBuffer*>* buffers = new vector<TraceBuffer*>();
+  return *buffers;
+}
+
+map<string, string>& _typeNames() {
+  static map<string, string>* typeNames = new map<string, string>();
+  return *typeNames;
+}
+
+thread_local TraceBuffer* _threadBuffer = nullptr;
+
+// Avoids taking [_registryMutex] for types the thread has already seen.
+thread_local map<const type_info*, const char*>* _threadTypeNames = nullptr;
+
+const chrono::steady_clock::time_point _epoch = chrono::steady_clock::now();
+
+}  // namespace
+
+TraceBuffer& TraceRecorder::GetThreadBuffer() {
+  if (_threadBuffer == nullptr) {
+    lock_guard<mutex> lock(_registryMutex);
+    _threadBuffer = new TraceBuffer((int) _buffers().size() + 1, kBufferCapacity);
+    _buffers().push_back(_threadBuffer);
+  }
+  return *_threadBuffer;
+}
+
+string TraceRecorder::Dump() {
+  auto jsEvents = nlohmann::json::array();
+  lock_guard<mutex> lock(_registryMutex);
+  for (TraceBuffer* buffer : _buffers()) {
+    uint64_t written = buffer->_written.load(memory_order_acquire);
+    uint64_t capacity = buffer->_events.size();
+    uint64_t first = written > capacity ? written - capacity : 0;
+    for (uint64_t i = first; i < written; i++) {
+      const TraceEvent& event = buffer->_events[i % capacity];
+      auto jsEvent = nlohmann::json::object();
+      jsEvent["name"] = event._name;
+      jsEvent["cat"] = event._category;
+      jsEvent["ph"] = "X";
+      jsEvent["ts"] = event._startMicros;
+      jsEvent["dur"] = event._durationMicros;
+      jsEvent["pid"] = 1;
+      jsEvent["tid"] = buffer->_threadId;
+      if (event._argCount > 0) {
+        auto jsArgs = nlohmann::json::object();
+        for (int a = 0; a < event._argCount; a++) {
+          jsArgs[event._argNames[a]] = event._argValues[a];
+        }
+        jsEvent["args"] = jsArgs;
+      }
+      jsEvents.push_back(jsEvent);
+    }
+  }
+  nlohmann::json js;
+  js["traceEvents"] = jsEvents;
+  js["displayTimeUnit"] = "ms";
+  return js.dump();
+}
+
+void TraceRecorder::Clear() {
+  lock_guard<mutex> lock(_registryMutex);
+  for (TraceBuffer* buffer : _buffers()) {
+    buffer->_written.store(0, memory_order_release);
+  }
+}
+
+int64_t TraceRecorder::NowMicros() {
+  auto elapsed = chrono::steady_clock::now() - _epoch;
+  return chrono::duration_cast<chrono::microseconds>(elapsed).count();
+}
+
+const char* TraceRecorder::InternTypeName(const type_info& type) {
+  if (_threadTypeNames == nullptr) {
+    _threadTypeNames = new map<const type_info*, const char*>();
+  }
+  auto cached = _threadTypeNames->find(&type);
+  if (cached != _threadTypeNames->end()) {
+    return cached->second;
+  }
+
+  lock_guard<mutex> lock(_registryMutex);
+  auto& typeNames = _typeNames();
+  auto entry = typeNames.find(type.name());
+  if (entry != typeNames.end()) {
+    (*_threadTypeNames)[&type] = entry->second.c_str();
+    return entry->second.c_str();
+  }
+
+  string name = type.name();
+#if defined(__GNUC__) || defined(__clang__)
+  int status = 0;
+  char* demangled = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+  if (status == 0 && demangled != nullptr) {
+    name = demangled;
+  }
+  free(demangled);
+#endif
+  const char* interned = typeNames.insert({type.name(), name}).first->second.c_str();
+  (*_threadTypeNames)[&type] = interned;
+  return interned;
+}
+
+}  // namespace barista
@@ -0,0 +1,144 @@
+#ifndef BARISTA2_TRACE_H
+#define BARISTA2_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+using namespace std;
+
+namespace barista {
+
+/// A complete ("ph": "X") event in Chrome's trace-event format.
+///
+/// Names and categories point to static or interned strings so that
+/// recording an event never allocates.
+class TraceEvent {
+ public:
+  const char* GetName() const { return _name; }
+  const char* GetCategory() const { return _category; }
+  int64_t GetStartMicros() const { return _startMicros; }
+  int64_t GetDurationMicros() const { return _durationMicros; }
+
+ private:
+  static const int kMaxArgs = 2;
+
+  const char* _name = "";
+  const char* _category = "";
+  int64_t _startMicros = 0;
+  int64_t _durationMicros = 0;
+  int _argCount = 0;
+  const char* _argNames[kMaxArgs];
+  int64_t _argValues[kMaxArgs];
+
+  friend class TraceSpan;
+  friend class TraceRecorder;
+};
+
+/// Fixed-size ring buffer of events recorded by a single thread.
+///
+/// Only the owning thread writes. Events are copied in and out without
+/// synchronization, so [TraceRecorder::Dump] and [TraceRecorder::Clear] must
+/// not run while any thread is recording. Once full, the oldest events are
+/// overwritten.
+class TraceBuffer {
+ public:
+  TraceBuffer(int threadId, size_t capacity)
+      : _threadId(threadId), _events(capacity) { }
+
+  void Add(const TraceEvent& event) {
+    uint64_t written = _written.load(memory_order_relaxed);
+    _events[written % _events.size()] = event;
+    _written.store(written + 1, memory_order_release);
+  }
+
+ private:
+  int _threadId;
+  vector<TraceEvent> _events;
+  atomic<uint64_t> _written{0};
+
+  friend class TraceRecorder;
+};
+
+/// Process-wide collection of per-thread trace buffers.
+class TraceRecorder {
+ public:
+  /// Number of events each thread keeps before overwriting the oldest ones.
+  static const size_t kBufferCapacity = 1 << 16;
+
+  /// Returns the calling thread's buffer, creating it on first use.
+  static TraceBuffer& GetThreadBuffer();
+
+  /// Serializes all buffered events as a Chrome trace-event JSON document
+  /// that can be loaded into chrome://tracing or Perfetto.
+  ///
+  /// Recording must be stopped: no thread may be inside a [TraceSpan], e.g.
+  /// call it between frames.
+  static string Dump();
+
+  /// Drops all buffered events. Recording must be stopped, as for [Dump].
+  static void Clear();
+
+  /// Microseconds since the recorder was first used.
+  static int64_t NowMicros();
+
+  /// Returns the demangled name of [type]. The string lives as long as the
+  /// process.
+  static const char* InternTypeName(const type_info& type);
+};
+
+/// Records a [TraceEvent] spanning the lifetime of this object.
+///
+/// Does nothing when constructed with `enabled == false`, so it is cheap to
+/// leave in hot paths.
+class TraceSpan {
+ public:
+  TraceSpan(bool enabled, const char* category, const char* name) : _enabled(enabled) {
+    if (_enabled) {
+      _event._category = category;
+      _event._name = name;
+      _event._startMicros = TraceRecorder::NowMicros();
+    }
+  }
+
+  ~TraceSpan() {
+    if (_enabled) {
+      _event._durationMicros = TraceRecorder::NowMicros() - _event._startMicros;
+      TraceRecorder::GetThreadBuffer().Add(_event);
+    }
+  }
+
+  bool IsEnabled() const { return _enabled; }
+
+  void SetName(const char* name) { _event._name = name; }
+
+  /// Labels the span with the class name of [object].
+  template<typename T>
+  void SetTypeName(const T& object) {
+    if (_enabled) {
+      _event._name = TraceRecorder::InternTypeName(typeid(object));
+    }
+  }
+
+  /// Attaches a numeric argument. At most two arguments are kept.
+  void AddArg(const char* name, int64_t value) {
+    if (_enabled && _event._argCount < TraceEvent::kMaxArgs) {
+      _event._argNames[_event._argCount] = name;
+      _event._argValues[_event._argCount] = value;
+      _event._argCount++;
+    }
+  }
+
+ private:
+  bool _enabled;
+  TraceEvent _event;
+
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+};
+
+}  // namespace barista
+
+#endif //BARISTA2_TRACE_H
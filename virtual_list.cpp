@@ -0,0 +1,78 @@
+#include "virtual_list.h"
+
+#include <algorithm>
+
+namespace barista {
+
+namespace {
+
+shared_ptr<Element> _spacer(string key, int64_t height) {
+  auto spacer = El("div");
+  spacer->SetKey(key);
+  spacer->SetAttribute("style", "height: " + to_string(height) + "px");
+  return spacer;
+}
+
+}  // namespace
+
+int Viewport::GetFirstRow(int rowCount) {
+  int first = _scrollTop / _rowHeight - _overscan;
+  return max(0, min(first, rowCount));
+}
+
+int Viewport::GetLastRow(int rowCount) {
+  int last = (_scrollTop + _height) / _rowHeight + 1 + _overscan;
+  return max(0, min(last, rowCount));
+}
+
+shared_ptr<State> VirtualList::CreateState() {
+  return make_shared<VirtualListState>();
+}
+
+shared_ptr<Node> VirtualListState::Build() {
+  auto config = static_pointer_cast<VirtualList>(GetConfig());
+  auto viewport = config->GetViewport();
+  int rowCount = config->GetRowCount();
+  int64_t rowHeight = viewport->GetRowHeight();
+  _firstRow = viewport->GetFirstRow(rowCount);
+  _lastRow = viewport->GetLastRow(rowCount);
+
+  auto container = El("div");
+  container->AddClassName("virtual-list");
+  container->SetAttribute(
+      "style",
+      "overflow-y: auto; height: " + to_string(viewport->GetHeight()) + "px"
+  );
+  container->AddEventListener("scroll", [this](const Event& event) {
+    _onScroll(event);
+  });
+
+  container->AddChild(_spacer("__top", _firstRow * rowHeight));
+  auto rowBuilder = config->GetRowBuilder();
+  for (int i = _firstRow; i < _lastRow; i++) {
+    auto row = rowBuilder(i);
+    row->SetKey(to_string(i));
+    container->AddChild(row);
+  }
+  container->AddChild(_spacer("__bottom", (rowCount - _lastRow) * rowHeight));
+  return container;
+}
+
+void VirtualListState::_onScroll(const Event& event) {
+  auto& data = event.GetData();
+  auto scrollTop = data.find("scrollTop");
+  if (scrollTop == data.end() || !scrollTop->is_number()) {
+    return;
+  }
+
+  auto config = static_pointer_cast<VirtualList>(GetConfig());
+  auto viewport = config->GetViewport();
+  viewport->SetScrollTop(scrollTop->get<int>());
+
+  int rowCount = config->GetRowCount();
+  if (viewport->GetFirstRow(rowCount) != _firstRow || viewport->GetLastRow(rowCount) != _lastRow) {
+    ScheduleUpdate();
+  }
+}
+
+}  // namespace barista
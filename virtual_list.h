@@ -0,0 +1,91 @@
+#ifndef BARISTA2_VIRTUAL_LIST_H
+#define BARISTA2_VIRTUAL_LIST_H
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "api.h"
+#include "html.h"
+
+namespace barista {
+
+using namespace std;
+
+/// Builds the row at the given index of a [VirtualList].
+typedef function<shared_ptr<Node>(int index)> RowBuilder;
+
+/// Scroll position and geometry of a [VirtualList].
+///
+/// Owned by the application rather than by the list's [State], so that the
+/// scroll position survives rebuilds of the list's parent.
+class Viewport {
+ public:
+  Viewport(int height, int rowHeight) : _height(height), _rowHeight(rowHeight) { }
+
+  int GetHeight() { return _height; }
+  int GetRowHeight() { return _rowHeight; }
+  int GetScrollTop() { return _scrollTop; }
+  void SetScrollTop(int scrollTop) { _scrollTop = scrollTop < 0 ? 0 : scrollTop; }
+
+  /// Number of rows materialized above and below the visible ones, so that
+  /// small scrolls do not expose empty space before the next frame lands.
+  int GetOverscan() { return _overscan; }
+  void SetOverscan(int overscan) { _overscan = overscan; }
+
+  /// Index of the first materialized row.
+  int GetFirstRow(int rowCount);
+
+  /// Index one past the last materialized row.
+  int GetLastRow(int rowCount);
+
+ private:
+  int _height;
+  int _rowHeight;
+  int _scrollTop = 0;
+  int _overscan = 5;
+};
+
+/// A scrollable list of fixed-height rows that only materializes the rows
+/// inside its [Viewport], plus overscan.
+///
+/// Rendered as a scroll container holding a top spacer, the visible rows
+/// keyed by their index, and a bottom spacer. The spacers are sized so that
+/// the container's scroll height matches that of the full list. The list
+/// listens to "scroll" events and rebuilds only when the visible window
+/// changes.
+class VirtualList : public StatefulWidget {
+ public:
+  VirtualList(int rowCount, RowBuilder rowBuilder, shared_ptr<Viewport> viewport)
+      : StatefulWidget(),
+        _rowCount(rowCount),
+        _rowBuilder(rowBuilder),
+        _viewport(viewport) { }
+
+  virtual shared_ptr<State> CreateState();
+
+  int GetRowCount() { return _rowCount; }
+  RowBuilder GetRowBuilder() { return _rowBuilder; }
+  shared_ptr<Viewport> GetViewport() { return _viewport; }
+
+ private:
+  int _rowCount;
+  RowBuilder _rowBuilder;
+  shared_ptr<Viewport> _viewport;
+};
+
+class VirtualListState : public State {
+ public:
+  virtual shared_ptr<Node> Build();
+
+ private:
+  void _onScroll(const Event& event);
+
+  // Window materialized by the last build.
+  int _firstRow = 0;
+  int _lastRow = 0;
+};
+
+}  // namespace barista
+
+#endif //BARISTA2_VIRTUAL_LIST_H